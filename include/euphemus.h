@@ -75,13 +75,25 @@ struct eu_type_descriptor {
 		EU_TDESC_STRUCT_PTR_V1,
 		EU_TDESC_STRUCT_V1,
 		EU_TDESC_ARRAY_V1,
+		EU_TDESC_STRUCT_PTR_V2,
+		EU_TDESC_STRUCT_V2,
+		EU_TDESC_STRUCT_PTR_V3,
+		EU_TDESC_STRUCT_V3,
+		EU_TDESC_ARRAY_V2,
+		EU_TDESC_CHUNKED_ARRAY_V1,
 	} kind;
 };
 
 /* eu_introduce gets or builds the eu_metadata instance for an
-   eu_type_descriptor. */
+   eu_type_descriptor.  It is safe to call from several threads at
+   once. */
 const struct eu_metadata *eu_introduce(const struct eu_type_descriptor *d);
 
+/* Introduce all the descriptors in a NULL-terminated array, e.g. at
+   startup, so that the metadata isn't built on first use.  Returns 0
+   if any of them failed. */
+int eu_introduce_all(const struct eu_type_descriptor *const *descriptors);
+
 extern const struct eu_type_descriptor eu_string_descriptor;
 extern const struct eu_type_descriptor eu_double_descriptor;
 extern const struct eu_type_descriptor eu_integer_descriptor;
@@ -120,20 +132,170 @@ static __inline__ struct eu_value eu_value_get_cstr(struct eu_value val,
 	return eu_value_get(val, eu_cstr(name));
 }
 
+/* Memory allocation.  By default, memory is obtained with malloc,
+   realloc and free.  An eu_allocator supplies alternatives.  The user
+   pointer is passed to each of the functions. */
+struct eu_allocator {
+	void *(*alloc)(void *user, size_t size);
+	void *(*realloc)(void *user, void *ptr, size_t size);
+	void (*free)(void *user, void *ptr);
+	void *user;
+};
+
+extern const struct eu_allocator eu_default_allocator;
+
+/* Release the resources associated with a value that was allocated
+   with the given allocator.  The type-specific fini functions assume
+   the default allocator. */
+void eu_value_fini(struct eu_value val, const struct eu_allocator *allocator);
+
 /* Parsing */
 
 struct eu_parse;
 
 struct eu_parse *eu_parse_create(struct eu_value result);
+
+/* Create a parse that uses the allocator for all its memory, including
+   the result.  The result should be released with eu_value_fini. */
+struct eu_parse *eu_parse_create_with_allocator(struct eu_value result,
+				const struct eu_allocator *allocator);
+
+/* Options affecting parsing, for eu_parse_set_options. */
+enum {
+	/* Strings that need no unescaping and that arrive within a
+	   single eu_parse call refer directly into the input buffer
+	   rather than being copied.  The caller must keep the input
+	   buffers alive, and unmodified, as long as the result. */
+	EU_PARSE_BORROW_STRINGS = 0x1,
+
+	/* Objects and arrays parsed into variants (other than the
+	   outermost value) are only skipped over, recording where they
+	   are in the input, and are parsed when first accessed through
+	   the eu_value functions (or eu_variant_materialize).  The
+	   skipping checks that brackets match and strings are
+	   terminated, failing the parse if not, but other syntax
+	   errors only show up as the value being absent on access.  As with EU_PARSE_BORROW_STRINGS, the caller must
+	   keep the input buffers alive and unmodified.  A value that
+	   is split between eu_parse calls is parsed eagerly (though
+	   values nested within it can still be lazy).  Lazy values are
+	   materialized with the default allocator, so this option has
+	   no effect on parses into an arena or created with
+	   eu_parse_create_with_allocator.  Access modifies the
+	   variant, so variants holding lazy values must not be
+	   accessed concurrently. */
+	EU_PARSE_LAZY = 0x2,
+
+	/* What to do about a member name that is repeated within an
+	   object.  By default, a repeated declared member of a struct
+	   replaces the earlier value, while repeated extra members
+	   (including the members of variant objects) are all kept, and
+	   lookups find the first.  The other policies apply to both.
+	   Checking extra members costs a lookup for each, which uses a
+	   hash index in large objects. */
+	EU_PARSE_DUPLICATES_KEEP = 0x0,
+
+	/* The last value is kept */
+	EU_PARSE_DUPLICATES_LAST = 0x4,
+
+	/* The first value is kept, and later values are skipped over
+	   (checking only that brackets and strings are balanced) */
+	EU_PARSE_DUPLICATES_FIRST = 0x8,
+
+	/* A repeated member is a parse error */
+	EU_PARSE_DUPLICATES_ERROR = 0xc,
+
+	EU_PARSE_DUPLICATES_MASK = 0xc
+};
+
+/* Set the options for a parse.  This should be called before the
+   first call to eu_parse. */
+void eu_parse_set_options(struct eu_parse *ep, unsigned int options);
+
+/* An arena holds the memory for parse results, so that it can all be
+   released in one go.  Results parsed into an arena are released by
+   eu_arena_destroy, and must not be passed to the fini functions, or
+   modified in ways that free or reallocate their contents. */
+struct eu_arena;
+
+struct eu_arena *eu_arena_create(void);
+struct eu_arena *eu_arena_create_with_allocator(
+				const struct eu_allocator *allocator);
+void eu_arena_destroy(struct eu_arena *arena);
+
+/* Allocate the result of a parse from the arena.  This should be
+   called before the first call to eu_parse.  Several parses can share
+   an arena, but not concurrently. */
+void eu_parse_set_arena(struct eu_parse *ep, struct eu_arena *arena);
+
+/* Parse a stream of JSON documents, separated by optional whitespace
+   (so newline-delimited JSON works, as do concatenated documents).
+   Each document is parsed into the parse's result, and passed to the
+   callback as soon as it is complete.  The callback takes
+   responsibility for the value (as eu_parse_finish would), and
+   should move it elsewhere, because the next document is parsed
+   into the same place.  Returning 0 from the callback stops the
+   parse with an error.  Documents may be split between eu_parse
+   calls arbitrarily.  eu_parse_finish succeeds if the stream ended
+   between documents, and leaves no result to claim.  This should be
+   called before the first call to eu_parse. */
+typedef int (*eu_parse_document_cb_t)(struct eu_value value, void *data);
+
+void eu_parse_set_document_callback(struct eu_parse *ep,
+				    eu_parse_document_cb_t cb, void *data);
+
+/* Parse newline-delimited JSON held in a buffer, in parallel.  Each
+   non-blank line is parsed as a value of the type given by metadata
+   (which the threads share, so it should come from eu_introduce
+   before the call), and passed to the callback along with the offset
+   of the line in the buffer.  The callback takes responsibility for
+   the value as in eu_parse_set_document_callback, and can return 0 to
+   stop the parse.  The options are those for eu_parse_set_options,
+   plus EU_NDJSON_ORDERED.  threads is the number of threads to use,
+   including the calling thread, or 0 for one per CPU.  Returns 1 if
+   all records were parsed and accepted. */
+enum {
+	/* Call the callback for each record in input order, from one
+	   thread at a time.  Otherwise, it is called concurrently from
+	   all the threads, with records in no particular order. */
+	EU_NDJSON_ORDERED = 0x10000
+};
+
+typedef int (*eu_ndjson_record_cb_t)(struct eu_value value, size_t offset,
+				     void *data);
+
+int eu_parse_ndjson(const struct eu_metadata *metadata,
+		    const char *buf, size_t len, unsigned int threads,
+		    unsigned int options, eu_ndjson_record_cb_t cb,
+		    void *data);
+
+/* Statistics gathered during a parse. */
+struct eu_parse_stats {
+	/* Struct members found (or not) where the member order
+	   prediction expected them. */
+	unsigned long member_predict_hits;
+	unsigned long member_predict_misses;
+};
+
+void eu_parse_get_stats(struct eu_parse *ep, struct eu_parse_stats *stats);
+
 int eu_parse(struct eu_parse *ep, const char *input, size_t len);
 int eu_parse_finish(struct eu_parse *ep);
 void eu_parse_destroy(struct eu_parse *ep);
 
+/* Prepare to parse another document into result, as if the parse had
+   been destroyed and recreated.  But the memory the parse has
+   allocated for its own use is retained, so a parse that is reset
+   for each of many similar documents stops allocating.  The options,
+   arena and document callback remain set. */
+void eu_parse_reset(struct eu_parse *ep, struct eu_value result);
+
 /* Generation */
 
 struct eu_generate;
 
 struct eu_generate *eu_generate_create(struct eu_value value);
+struct eu_generate *eu_generate_create_with_allocator(struct eu_value value,
+				const struct eu_allocator *allocator);
 
 /* Returns the number of bytes produced.  If the output buffer was not
    filled, then either generation is complete or an error occured.
@@ -143,6 +305,10 @@ size_t eu_generate(struct eu_generate *eg, char *output, size_t len);
 int eu_generate_ok(struct eu_generate *eg);
 void eu_generate_destroy(struct eu_generate *eg);
 
+/* Prepare to generate another value, retaining memory as
+   eu_parse_reset does. */
+void eu_generate_reset(struct eu_generate *eg, struct eu_value value);
+
 /* Path resolution */
 
 struct eu_value eu_get_path(struct eu_value val, struct eu_string_ref path);
@@ -171,6 +337,11 @@ static __inline__ void eu_object_init(struct eu_object *obj)
 void eu_object_fini(struct eu_object *obj);
 struct eu_value eu_object_value(struct eu_object *obj);
 
+/* Get the member with the given name, adding it if it is absent.
+   Members are added with the allocator of the object's existing
+   members, or the default allocator if there are none yet.  Members
+   cannot be added to an object whose members were parsed into an
+   arena, so NULL is returned for an absent name. */
 struct eu_variant *eu_object_get(struct eu_object *obj,
 				 struct eu_string_ref name);
 
@@ -179,6 +350,13 @@ struct eu_variant *eu_object_get(struct eu_object *obj,
 struct eu_string {
 	char *chars;
 	size_t len;
+
+	struct {
+		/* Set if chars points into memory that the string
+		   does not own (e.g. a parser input buffer, see
+		   EU_PARSE_BORROW_STRINGS), so must not be freed. */
+		unsigned char borrowed;
+	} priv;
 };
 
 static __inline__ struct eu_string_ref eu_string_to_ref(struct eu_string *str)
@@ -189,6 +367,8 @@ static __inline__ struct eu_string_ref eu_string_to_ref(struct eu_string *str)
 static __inline__ int eu_string_init(struct eu_string *str,
 				     struct eu_string_ref s)
 {
+	str->priv.borrowed = 0;
+
 	if ((str->chars = strdup(s.chars))) {
 		str->len = s.len;
 		return 1;
@@ -201,7 +381,7 @@ static __inline__ int eu_string_init(struct eu_string *str,
 
 static __inline__ void eu_string_fini(struct eu_string *str)
 {
-	if (str->len)
+	if (str->len && !str->priv.borrowed)
 		free(str->chars);
 }
 
@@ -210,31 +390,22 @@ static __inline__ void eu_string_reset(struct eu_string *str)
 	eu_string_fini(str);
 	str->chars = NULL;
 	str->len = 0;
+	str->priv.borrowed = 0;
 }
 
 static __inline__ int eu_string_assign(struct eu_string *str,
 				       struct eu_string_ref s)
 {
-	if (str->len)
-		free(str->chars);
-
-	if ((str->chars = strdup(s.chars))) {
-		str->len = s.len;
-		return 1;
-	}
-	else {
-		str->len = 0;
-		return 0;
-	}
+	eu_string_fini(str);
+	return eu_string_init(str, s);
 }
 
 static __inline__ void eu_string_assign_empty(struct eu_string *str)
 {
-	if (str->len)
-		free(str->chars);
-
+	eu_string_fini(str);
 	str->chars = EU_ZERO_LENGTH_PTR;
 	str->len = 0;
+	str->priv.borrowed = 0;
 }
 
 extern const struct eu_metadata eu_string_metadata;
@@ -251,6 +422,17 @@ struct eu_array_descriptor_v1 {
 	const struct eu_type_descriptor *element_descriptor;
 };
 
+/* Version 2 array descriptors add hints about the number of
+   elements, from a schema's minItems, maxItems and
+   euphemusExpectedItems.  They size the buffer allocated when an
+   array is parsed, but are not checked.  Zero means no hint. */
+struct eu_array_descriptor_v2 {
+	struct eu_array_descriptor_v1 v1;
+	size_t min_items;
+	size_t max_items;
+	size_t expected_items;
+};
+
 struct eu_array {
 	void *a;
 	size_t len;
@@ -262,8 +444,99 @@ struct eu_array {
 
 void eu_array_fini(const struct eu_metadata *gmetadata, void *value);
 struct eu_value eu_array_get(struct eu_value val, struct eu_string_ref name);
+
+/* Make room for at least one more element.  The capacity beyond len
+   is not initialized, in grown and parsed arrays alike; the push
+   functions zero each element as they add it. */
 int eu_array_grow(struct eu_array *array, size_t el_size);
 
+/* Chunked arrays keep their elements in a series of separately
+   allocated chunks, rather than in one buffer.  So growing a large
+   array never copies the elements, and never needs more than one
+   chunk of memory beyond what the elements occupy.  They are
+   selected with euphemusChunked in a schema, and use a descriptor
+   with the EU_TDESC_CHUNKED_ARRAY_V1 kind and the
+   eu_array_descriptor_v2 layout.
+
+   Each chunk holds 1 << priv.shift elements, except that the first
+   chunk starts smaller and grows in place until it is full.  The
+   value of a chunked array is a struct eu_chunked_array, not a
+   struct eu_array, so eu_value_to_array does not apply. */
+struct eu_chunked_array {
+	void **chunks;
+	size_t len;
+
+	struct {
+		size_t capacity;
+		size_t chunks_capacity;
+		unsigned int shift;
+	} priv;
+};
+
+static __inline__ void *eu_chunked_array_at(struct eu_chunked_array *array,
+					    size_t el_size, size_t i)
+{
+	size_t mask = ((size_t)1 << array->priv.shift) - 1;
+
+	return (char *)array->chunks[i >> array->priv.shift]
+		+ (i & mask) * el_size;
+}
+
+int eu_chunked_array_grow(struct eu_chunked_array *array, size_t el_size);
+
+/* Move the elements into a single contiguous buffer, and return it,
+   or NULL if the memory for it could not be allocated (in which case
+   the array is unchanged).  allocator must be the one the array was
+   allocated with: eu_default_allocator for arrays built with push,
+   or the allocator given to eu_parse_create_with_allocator.  Arrays
+   parsed into an arena cannot be compacted, as their chunks belong to
+   the arena.
+
+   The result is not a struct eu_array: the array remains a chunked
+   array, with the buffer as its only chunk, so that it can still be
+   finalized, generated and pushed to through its own metadata, which
+   a struct eu_array of the same elements would lack.  The chunks are
+   freed as they are copied, but the buffer is allocated up front, so
+   for a moment the array needs twice its size. */
+void *eu_chunked_array_compact(struct eu_chunked_array *array,
+			       size_t el_size,
+			       const struct eu_allocator *allocator);
+
+struct eu_chunked_array_iter {
+	void *element;
+
+	struct {
+		char *next;
+		char *end;
+		void **chunk;
+		size_t chunk_size;
+		size_t el_size;
+		size_t remaining;
+	} priv;
+};
+
+void eu_chunked_array_iter_init(struct eu_chunked_array_iter *iter,
+				struct eu_chunked_array *array,
+				size_t el_size);
+
+/* Advance to the next element, returning 0 at the end of the array */
+static __inline__ int eu_chunked_array_iter_next(
+					struct eu_chunked_array_iter *iter)
+{
+	if (!iter->priv.remaining)
+		return 0;
+
+	if (iter->priv.next == iter->priv.end) {
+		iter->priv.next = *++iter->priv.chunk;
+		iter->priv.end = iter->priv.next + iter->priv.chunk_size;
+	}
+
+	iter->element = iter->priv.next;
+	iter->priv.next += iter->priv.el_size;
+	iter->priv.remaining--;
+	return 1;
+}
+
 /* Others */
 
 typedef int64_t eu_integer_t;
@@ -328,6 +601,11 @@ static __inline__ void eu_variant_init(struct eu_variant *var)
 void eu_variant_fini(struct eu_variant *variant);
 void eu_variant_reset(struct eu_variant *variant);
 
+/* Parse a value left unparsed by EU_PARSE_LAZY, so that the variant's
+   union can be used directly.  Values within it can remain lazy.
+   Returns 0 if it could not be parsed. */
+int eu_variant_materialize(struct eu_variant *variant);
+
 static __inline__ void eu_variant_assign_null(struct eu_variant *var)
 {
 	if (var->metadata)
@@ -404,12 +682,18 @@ static __inline__ struct eu_value eu_variant_array_value(
 static __inline__ struct eu_variant *eu_variant_array_push(
 					       struct eu_variant_array *array)
 {
+	struct eu_variant *el;
+
 	if (array->len < array->priv.capacity
 	    || eu_array_grow((struct eu_array *)array,
-			     sizeof(struct eu_variant)))
-		return array->a + array->len++;
-	else
+			     sizeof(struct eu_variant))) {
+		el = array->a + array->len++;
+		memset(el, 0, sizeof *el);
+		return el;
+	}
+	else {
 		return NULL;
+	}
 }
 
 extern const struct eu_metadata eu_variant_metadata;
@@ -468,6 +752,10 @@ struct eu_struct_member_descriptor_v1 {
 	const struct eu_type_descriptor *descriptor;
 };
 
+/* If extra_value_descriptor is NULL, the struct is closed: members
+   other than the declared members are skipped over, rather than being
+   parsed into the extras.  The extras struct member is still present
+   (and always empty). */
 struct eu_struct_descriptor_v1 {
 	struct eu_type_descriptor struct_base;
 	struct eu_type_descriptor struct_ptr_base;
@@ -480,6 +768,82 @@ struct eu_struct_descriptor_v1 {
 	const struct eu_type_descriptor *extra_value_descriptor;
 };
 
+/* Version 2 struct descriptors add a member name recognizer, as
+   generated by schemac.  It returns the index of the named member in
+   the members array, or -1 if there is no such member. */
+struct eu_struct_descriptor_v2 {
+	struct eu_struct_descriptor_v1 v1;
+	int (*recognize_member)(const char *name, size_t len);
+};
+
+/* How far a schema-specialized parse function got through an
+   object.  p points just past the last member value it parsed, or is
+   NULL if it has not parsed any.  member is the index of the declared
+   member it parsed last, or -1. */
+struct eu_struct_parse_point {
+	const char *p;
+	int member;
+};
+
+/* Version 3 struct descriptors add a schema-specialized parse
+   function, as generated by schemac -S.  It parses an object directly
+   from the input buffer: p points to the opening '{', and it returns
+   a pointer just past the closing '}'.  If it meets anything out of
+   the ordinary, or the input runs out other than within a member
+   value, it returns NULL, and the general resumable parser carries
+   on from *point.  If a member value fails to parse, or the input
+   runs out within it, it returns NULL straight away: the helper below
+   that parsed the value has recorded the error, or the state needed
+   to resume the value. */
+struct eu_struct_descriptor_v3 {
+	struct eu_struct_descriptor_v2 v2;
+	const char *(*parse)(struct eu_parse *ep, const char *p,
+			     const char *end, void *result,
+			     struct eu_struct_parse_point *point);
+};
+
+/* Helpers for specialized parse functions.  The *_value functions
+   parse a value starting at p, which must be before end but may be
+   whitespace, and return a pointer just past it, or NULL as above. */
+const char *eu_parse_string_value(struct eu_parse *ep, const char *p,
+				  const char *end, struct eu_string *result);
+const char *eu_parse_integer_value(struct eu_parse *ep, const char *p,
+				   const char *end, eu_integer_t *result);
+const char *eu_parse_double_value(struct eu_parse *ep, const char *p,
+				  const char *end, double *result);
+const char *eu_parse_bool_value(struct eu_parse *ep, const char *p,
+				const char *end, eu_bool_t *result);
+const char *eu_parse_value(struct eu_parse *ep, const char *p,
+			   const char *end, const struct eu_type_descriptor *d,
+			   void *result);
+
+/* Parse the value of a member that is not among the declared members
+   of the struct, adding it to the extras.  It also returns NULL,
+   without recording anything, if the member is a repeated extra
+   member, leaving it to the general parser. */
+const char *eu_parse_extra_member(struct eu_parse *ep, const char *p,
+				  const char *end,
+				  const struct eu_metadata *struct_metadata,
+				  void *s, const char *name,
+				  const char *name_end);
+
+/* Allocate zeroed memory for a value within the result. */
+void *eu_parse_alloc(struct eu_parse *ep, size_t size);
+
+/* Find the closing '"' of a member name starting at p.  Returns NULL
+   if the name runs past end or contains escapes. */
+const char *eu_scan_member_name(const char *p, const char *end);
+
+static __inline__ const char *eu_skip_whitespace(const char *p,
+						 const char *end)
+{
+	while (p != end && (*p == ' ' || *p == '\n' || *p == '\r'
+			    || *p == '\t'))
+		p++;
+
+	return p;
+}
+
 void eu_struct_extras_fini(const struct eu_metadata *md, void *v_extras);
 size_t eu_object_size(struct eu_value val);
 
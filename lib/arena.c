@@ -0,0 +1,122 @@
+#include <stdlib.h>
+
+#include <euphemus.h>
+#include "euphemus_int.h"
+
+/* Chunks start small, so that arenas used for small documents are
+   cheap, and double in size up to a limit. */
+#define MIN_CHUNK_SIZE 1024
+#define MAX_CHUNK_SIZE (1024 * 1024)
+
+/* The header of a chunk, followed by its data */
+struct eu_arena_chunk {
+	struct eu_arena_chunk *next;
+	union eu_arena_align align;
+};
+
+#define CHUNK_HEADER_SIZE offsetof(struct eu_arena_chunk, align)
+
+struct eu_arena *eu_arena_create(void)
+{
+	return eu_arena_create_with_allocator(&eu_default_allocator);
+}
+
+struct eu_arena *eu_arena_create_with_allocator(
+					const struct eu_allocator *allocator)
+{
+	struct eu_arena *arena = eu_allocator_alloc(allocator, sizeof *arena);
+
+	if (arena) {
+		arena->allocator = allocator;
+		arena->next = arena->end = arena->last = NULL;
+		arena->chunks = NULL;
+		arena->chunk_size = MIN_CHUNK_SIZE;
+	}
+
+	return arena;
+}
+
+void eu_arena_destroy(struct eu_arena *arena)
+{
+	struct eu_arena_chunk *chunk, *next;
+
+	if (!arena)
+		return;
+
+	for (chunk = arena->chunks; chunk; chunk = next) {
+		next = chunk->next;
+		eu_allocator_free(arena->allocator, chunk);
+	}
+
+	eu_allocator_free(arena->allocator, arena);
+}
+
+void *eu_arena_alloc_slow(struct eu_arena *arena, size_t size)
+{
+	struct eu_arena_chunk *chunk;
+	char *data;
+
+	if (size > arena->chunk_size / 4) {
+		/* A big allocation gets a chunk to itself, so that
+		   the remainder of the current chunk is not wasted. */
+		chunk = eu_allocator_alloc(arena->allocator,
+					   CHUNK_HEADER_SIZE + size);
+		if (!chunk)
+			return NULL;
+
+		if (arena->chunks) {
+			chunk->next = arena->chunks->next;
+			arena->chunks->next = chunk;
+		}
+		else {
+			chunk->next = NULL;
+			arena->chunks = chunk;
+		}
+
+		return (char *)chunk + CHUNK_HEADER_SIZE;
+	}
+
+	chunk = eu_allocator_alloc(arena->allocator,
+				   CHUNK_HEADER_SIZE + arena->chunk_size);
+	if (!chunk)
+		return NULL;
+
+	chunk->next = arena->chunks;
+	arena->chunks = chunk;
+
+	data = (char *)chunk + CHUNK_HEADER_SIZE;
+	arena->last = data;
+	arena->next = data + EU_ARENA_ROUND_UP(size);
+	arena->end = data + arena->chunk_size;
+
+	if (arena->chunk_size < MAX_CHUNK_SIZE)
+		arena->chunk_size *= 2;
+
+	return data;
+}
+
+void *eu_arena_realloc(struct eu_arena *arena, void *ptr, size_t old_size,
+		       size_t size)
+{
+	void *new_ptr;
+
+	if (!ptr)
+		return eu_arena_alloc(arena, size);
+
+	/* The most recent allocation can be resized in place, if
+	   there is room. */
+	if (ptr == arena->last
+	    && size <= (size_t)(arena->end - arena->last)) {
+		arena->next = arena->last + EU_ARENA_ROUND_UP(size);
+		return ptr;
+	}
+
+	if (size <= old_size)
+		return ptr;
+
+	new_ptr = eu_arena_alloc(arena, size);
+	if (new_ptr)
+		memcpy(new_ptr, ptr, old_size);
+
+	return new_ptr;
+}
@@ -1,11 +1,77 @@
 #include <euphemus.h>
 #include "euphemus_int.h"
 
+/* The capacity allocated when parsing an array, without hints */
+#define ARRAY_INITIAL_CAPACITY 8
+
 struct eu_array_metadata {
 	struct eu_metadata base;
 	const struct eu_metadata *element_metadata;
+
+	/* The capacity allocated when parsing an array, from the
+	   descriptor's hints */
+	size_t initial_capacity;
+
+	/* Growth doesn't go beyond max_items, until an array exceeds
+	   it.  Zero means no limit. */
+	size_t max_items;
+
+	/* Whether to track last_len.  Variant arrays all share one
+	   metadata, so it would mix the lengths of unrelated arrays. */
+	int adaptive;
+
+	/* The length of the last array parsed with this metadata that
+	   outgrew its initial capacity.  When another array outgrows
+	   its initial capacity, it grows straight to this. */
+	size_t last_len;
 };
 
+static size_t grown_capacity(const struct eu_array_metadata *md,
+			     size_t capacity)
+{
+	size_t new_capacity = capacity * 2;
+	size_t last_len;
+
+	if (md->adaptive) {
+		last_len = __atomic_load_n(&md->last_len, __ATOMIC_RELAXED);
+		if (last_len > new_capacity)
+			new_capacity = last_len;
+	}
+
+	if (md->max_items > capacity && md->max_items < new_capacity)
+		new_capacity = md->max_items;
+
+	return new_capacity;
+}
+
+/* Record the outcome of parsing an array, and trim the buffer if the
+   estimate of its length overshot. */
+static void array_parse_done(const struct eu_array_metadata *md,
+			     struct eu_parse *ep, struct eu_array *result,
+			     size_t len, size_t capacity)
+{
+	char *a;
+
+	if (md->adaptive && len > md->initial_capacity
+	    && __atomic_load_n(&md->last_len, __ATOMIC_RELAXED) != len)
+		__atomic_store_n((size_t *)&md->last_len, len,
+				 __ATOMIC_RELAXED);
+
+	/* Doubling never leaves the buffer more than half empty */
+	if (capacity > ARRAY_INITIAL_CAPACITY && capacity / 2 > len) {
+		a = eu_realloc(&ep->heap, result->a,
+			       capacity * md->element_metadata->size,
+			       len * md->element_metadata->size);
+		if (a) {
+			result->a = a;
+			capacity = len;
+		}
+	}
+
+	result->len = len;
+	result->priv.capacity = capacity;
+}
+
 enum array_parse_state {
 	ARRAY_PARSE_OPEN,
 	ARRAY_PARSE_ELEMENT,
@@ -15,13 +81,14 @@ enum array_parse_state {
 struct array_parse_frame {
 	struct eu_stack_frame base;
 	enum array_parse_state state;
-	const struct eu_metadata *el_metadata;
+	const struct eu_array_metadata *metadata;
 	struct eu_array *result;
 };
 
 static enum eu_result array_parse_resume(struct eu_stack_frame *gframe,
 					 void *v_ep);
-static void array_parse_frame_destroy(struct eu_stack_frame *gframe);
+static void array_parse_frame_destroy(struct eu_stack_frame *gframe,
+				      void *v_ep);
 
 static enum eu_result array_parse_aux(const struct eu_metadata *gmetadata,
 				      struct eu_parse *ep, void *v_result)
@@ -34,7 +101,7 @@ static enum eu_result array_parse_aux(const struct eu_metadata *gmetadata,
 	size_t el_size = el_metadata->size;
 	struct eu_array *result = v_result;
 	size_t len = 0;
-	size_t capacity = 8;
+	size_t capacity = metadata->initial_capacity;
 	char *el;
 
 	ep->input++;
@@ -49,7 +116,8 @@ static enum eu_result array_parse_resume(struct eu_stack_frame *gframe,
 	struct array_parse_frame *frame = (struct array_parse_frame *)gframe;
 	struct eu_parse *ep = v_ep;
 	enum array_parse_state state = frame->state;
-	const struct eu_metadata *el_metadata = frame->el_metadata;
+	const struct eu_array_metadata *metadata = frame->metadata;
+	const struct eu_metadata *el_metadata = metadata->element_metadata;
 	size_t el_size = el_metadata->size;
 	struct eu_array *result = frame->result;
 	size_t capacity = result->priv.capacity;
@@ -80,34 +148,45 @@ static enum eu_result array_parse(const struct eu_metadata *gmetadata,
 
 
 static void array_fini(const struct eu_metadata *el_metadata,
-		       struct eu_array *array)
+		       struct eu_array *array,
+		       const struct eu_allocator *allocator)
 {
 	if (array->len) {
 		char *el = array->a;
 		size_t i;
 
 		for (i = 0; i < array->len; i++) {
-			el_metadata->fini(el_metadata, el);
+			el_metadata->fini(el_metadata, el, allocator);
 			el += el_metadata->size;
 		}
 	}
 
 	if (array->priv.capacity)
-		free(array->a);
+		eu_allocator_free(allocator, array->a);
 }
 
-void eu_array_fini(const struct eu_metadata *gmetadata, void *value)
+static void array_metadata_fini(const struct eu_metadata *gmetadata,
+				void *value,
+				const struct eu_allocator *allocator)
 {
 	struct eu_array_metadata *metadata
 		= (struct eu_array_metadata *)gmetadata;
-	array_fini(metadata->element_metadata, value);
+	array_fini(metadata->element_metadata, value, allocator);
 }
 
-static void array_parse_frame_destroy(struct eu_stack_frame *gframe)
+void eu_array_fini(const struct eu_metadata *gmetadata, void *value)
+{
+	gmetadata->fini(gmetadata, value, &eu_default_allocator);
+}
+
+static void array_parse_frame_destroy(struct eu_stack_frame *gframe,
+				      void *v_ep)
 {
 	struct array_parse_frame *frame = (struct array_parse_frame *)gframe;
+	struct eu_parse *ep = v_ep;
 
-	array_fini(frame->el_metadata, frame->result);
+	array_fini(frame->metadata->element_metadata, frame->result,
+		   ep->heap.allocator);
 
 	/* To avoid fini functions being called multiple times. */
 	frame->result->a = NULL;
@@ -123,27 +202,19 @@ int eu_array_grow(struct eu_array *array, size_t el_size)
 		char *new_a;
 
 		if (!array->priv.capacity) {
-			cap = 8;
+			cap = ARRAY_INITIAL_CAPACITY;
 			new_a = malloc(el_size * cap);
 			if (!new_a)
 				return 0;
-
-			memset(new_a, 0, el_size * 8);
 		}
 		else {
-			size_t sz = array->priv.capacity * el_size;
-			size_t new_sz = sz;
-
-			do {
+			do
 				cap *= 2;
-				new_sz *= 2;
-			} while (cap < len);
+			while (cap < len);
 
-			new_a = realloc(array->a, new_sz);
+			new_a = realloc(array->a, cap * el_size);
 			if (!new_a)
 				return 0;
-
-			memset(new_a + sz, 0, new_sz - sz);
 		}
 
 		array->a = new_a;
@@ -153,10 +224,10 @@ int eu_array_grow(struct eu_array *array, size_t el_size)
 	return 1;
 }
 
-struct eu_value eu_array_get(struct eu_value val, struct eu_string_ref name)
+/* Parse an array index from a path component.  Returns len if it is
+   not a valid index less than len. */
+static size_t array_index(struct eu_string_ref name, size_t len)
 {
-	struct eu_array_metadata *md = (struct eu_array_metadata *)val.metadata;
-	struct eu_array *array = val.value;
 	size_t index, i;
 	unsigned char digit;
 
@@ -181,11 +252,24 @@ struct eu_value eu_array_get(struct eu_value val, struct eu_string_ref name)
 		index += digit;
 	}
 
-	return eu_value((char *)array->a + index * md->element_metadata->size,
-			md->element_metadata);
+	if (index < len)
+		return index;
 
  fail:
-	return eu_value_none;
+	return len;
+}
+
+struct eu_value eu_array_get(struct eu_value val, struct eu_string_ref name)
+{
+	struct eu_array_metadata *md = (struct eu_array_metadata *)val.metadata;
+	struct eu_array *array = val.value;
+	size_t index = array_index(name, array->len);
+
+	if (index == array->len)
+		return eu_value_none;
+
+	return eu_value((char *)array->a + index * md->element_metadata->size,
+			md->element_metadata);
 }
 
 enum array_gen_state {
@@ -199,6 +283,9 @@ struct array_gen_frame {
 	char *el;
 	const struct eu_metadata *el_md;
 	enum array_gen_state state;
+	void **chunk;
+	char *chunk_end;
+	size_t chunk_size;
 };
 
 static enum eu_result array_gen_resume(struct eu_stack_frame *gframe,
@@ -216,6 +303,12 @@ static enum eu_result array_generate(const struct eu_metadata *gmetadata,
 	enum array_gen_state state;
 	struct array_gen_frame *frame;
 
+	/* A contiguous array is one chunk, which we never reach the
+	   end of */
+	void **chunk = NULL;
+	char *chunk_end = NULL;
+	size_t chunk_size = 0;
+
 	if (array->len == 0)
 		return eu_fixed_gen_32(eg, 2, MULTICHAR_2('[',']'), "[]");
 
@@ -238,6 +331,9 @@ static enum eu_result array_gen_resume(struct eu_stack_frame *gframe,
 	char *el = frame->el;
 	const struct eu_metadata *el_md = frame->el_md;
 	enum array_gen_state state = frame->state;
+	void **chunk = frame->chunk;
+	char *chunk_end = frame->chunk_end;
+	size_t chunk_size = frame->chunk_size;
 
 #define RESUME_ONLY(x) x
 	switch (state) {
@@ -248,20 +344,377 @@ static enum eu_result array_gen_resume(struct eu_stack_frame *gframe,
 	}
 }
 
+/* Chunked arrays */
+
+/* The size that chunks are made up to */
+#define CHUNK_SIZE 65536
+
+/* The initial capacity of the chunks array */
+#define CHUNKS_INITIAL_CAPACITY 4
+
+/* The most elements in a chunk, as a shift */
+#define CHUNK_SHIFT_MAX 16
+
+static unsigned int chunk_shift(size_t el_size)
+{
+	unsigned int shift = 0;
+
+	while ((el_size << shift) < CHUNK_SIZE && shift < CHUNK_SHIFT_MAX)
+		shift++;
+
+	return shift;
+}
+
+static size_t chunk_count(struct eu_chunked_array *array)
+{
+	size_t chunk_len = (size_t)1 << array->priv.shift;
+
+	if (!array->priv.capacity)
+		return 0;
+	else if (array->priv.capacity < chunk_len)
+		return 1;
+	else
+		return array->priv.capacity >> array->priv.shift;
+}
+
+/* Make room for at least one more element.  first is the capacity
+   to start the first chunk with. */
+static int chunked_grow(const struct eu_heap *heap,
+			struct eu_chunked_array *array, size_t el_size,
+			size_t first)
+{
+	size_t capacity = array->priv.capacity;
+	size_t chunk_len, n;
+	void **chunks;
+	char *chunk;
+
+	if (!capacity) {
+		array->priv.shift = chunk_shift(el_size);
+		chunk_len = (size_t)1 << array->priv.shift;
+		if (first > chunk_len)
+			first = chunk_len;
+
+		chunks = eu_alloc(heap,
+				  CHUNKS_INITIAL_CAPACITY * sizeof *chunks);
+		if (!chunks)
+			return 0;
+
+		chunk = eu_alloc(heap, first * el_size);
+		if (!chunk) {
+			eu_free(heap, chunks);
+			return 0;
+		}
+
+		chunks[0] = chunk;
+		array->chunks = chunks;
+		array->priv.chunks_capacity = CHUNKS_INITIAL_CAPACITY;
+		array->priv.capacity = first;
+		return 1;
+	}
+
+	chunk_len = (size_t)1 << array->priv.shift;
+	if (capacity < chunk_len) {
+		/* The first chunk grows in place until it is full */
+		n = capacity * 2;
+		if (n > chunk_len)
+			n = chunk_len;
+
+		chunk = eu_realloc(heap, array->chunks[0], capacity * el_size,
+				   n * el_size);
+		if (!chunk)
+			return 0;
+
+		array->chunks[0] = chunk;
+		array->priv.capacity = n;
+		return 1;
+	}
+
+	n = capacity >> array->priv.shift;
+	if (n == array->priv.chunks_capacity) {
+		chunks = eu_realloc(heap, array->chunks, n * sizeof *chunks,
+				    2 * n * sizeof *chunks);
+		if (!chunks)
+			return 0;
+
+		array->chunks = chunks;
+		array->priv.chunks_capacity = 2 * n;
+	}
+
+	chunk = eu_alloc(heap, chunk_len * el_size);
+	if (!chunk)
+		return 0;
+
+	array->chunks[n] = chunk;
+	array->priv.capacity = capacity + chunk_len;
+	return 1;
+}
+
+int eu_chunked_array_grow(struct eu_chunked_array *array, size_t el_size)
+{
+	if (array->len < array->priv.capacity)
+		return 1;
+
+	return chunked_grow(&eu_default_heap, array, el_size,
+			    ARRAY_INITIAL_CAPACITY);
+}
+
+void *eu_chunked_array_compact(struct eu_chunked_array *array,
+			       size_t el_size,
+			       const struct eu_allocator *allocator)
+{
+	size_t chunk_size = el_size << array->priv.shift;
+	size_t n = chunk_count(array);
+	size_t i, len;
+	char *a, *p;
+
+	if (!array->len)
+		return EU_ZERO_LENGTH_PTR;
+
+	if (n == 1) {
+		/* Just trim the first chunk */
+		if (array->priv.capacity > array->len) {
+			a = eu_allocator_realloc(allocator, array->chunks[0],
+						 array->len * el_size);
+			if (a) {
+				array->chunks[0] = a;
+				array->priv.capacity = array->len;
+			}
+		}
+
+		return array->chunks[0];
+	}
+
+	a = p = eu_allocator_alloc(allocator, array->len * el_size);
+	if (!a)
+		return NULL;
+
+	for (i = 0, len = array->len; len; i++) {
+		size_t sz = len * el_size < chunk_size
+			? len * el_size : chunk_size;
+
+		memcpy(p, array->chunks[i], sz);
+		eu_allocator_free(allocator, array->chunks[i]);
+		p += sz;
+		len -= sz / el_size;
+	}
+
+	for (; i < n; i++)
+		eu_allocator_free(allocator, array->chunks[i]);
+
+	/* A single chunk, as large as the array.  The usual chunk size
+	   is kept if the array fits within it, so that later growth
+	   adds chunks of that size. */
+	array->chunks[0] = a;
+	array->priv.capacity = array->len;
+	array->priv.shift = chunk_shift(el_size);
+	while (((size_t)1 << array->priv.shift) < array->len)
+		array->priv.shift++;
+
+	return a;
+}
+
+void eu_chunked_array_iter_init(struct eu_chunked_array_iter *iter,
+				struct eu_chunked_array *array,
+				size_t el_size)
+{
+	iter->element = NULL;
+	iter->priv.el_size = el_size;
+	iter->priv.chunk_size = el_size << array->priv.shift;
+	iter->priv.remaining = array->len;
+
+	if (array->len) {
+		iter->priv.chunk = array->chunks;
+		iter->priv.next = array->chunks[0];
+		iter->priv.end = iter->priv.next + iter->priv.chunk_size;
+	}
+	else {
+		iter->priv.chunk = NULL;
+		iter->priv.next = iter->priv.end = NULL;
+	}
+}
+
+struct chunked_array_parse_frame {
+	struct eu_stack_frame base;
+	enum array_parse_state state;
+	const struct eu_array_metadata *metadata;
+	struct eu_chunked_array *result;
+};
+
+static enum eu_result chunked_array_parse_resume(
+					struct eu_stack_frame *gframe,
+					void *v_ep);
+static void chunked_array_parse_frame_destroy(struct eu_stack_frame *gframe,
+					      void *v_ep);
+
+static enum eu_result chunked_array_parse(const struct eu_metadata *gmetadata,
+					  struct eu_parse *ep, void *v_result)
+{
+	struct chunked_array_parse_frame *frame;
+	const struct eu_array_metadata *metadata
+		= (const struct eu_array_metadata *)gmetadata;
+	enum array_parse_state state = ARRAY_PARSE_OPEN;
+	const struct eu_metadata *el_metadata = metadata->element_metadata;
+	size_t el_size = el_metadata->size;
+	struct eu_chunked_array *result = v_result;
+	enum eu_result res;
+	size_t len = 0;
+	char *el = NULL;
+
+	res = eu_consume_whitespace_until(gmetadata, ep, result, '[');
+	if (res != EU_OK)
+		return res;
+
+	ep->input++;
+	result->chunks = NULL;
+	result->len = result->priv.capacity = 0;
+
+#define RESUME_ONLY(x)
+#include "chunked_array_parse_sm.c"
+}
+
+static enum eu_result chunked_array_parse_resume(
+					struct eu_stack_frame *gframe,
+					void *v_ep)
+{
+	struct chunked_array_parse_frame *frame
+		= (struct chunked_array_parse_frame *)gframe;
+	struct eu_parse *ep = v_ep;
+	enum array_parse_state state = frame->state;
+	const struct eu_array_metadata *metadata = frame->metadata;
+	const struct eu_metadata *el_metadata = metadata->element_metadata;
+	size_t el_size = el_metadata->size;
+	struct eu_chunked_array *result = frame->result;
+	size_t len = result->len;
+	char *el = NULL;
+
+	if (len < result->priv.capacity)
+		el = eu_chunked_array_at(result, el_size, len);
+
+	switch (state) {
+#define RESUME_ONLY(x) x
+#include "chunked_array_parse_sm.c"
+	}
+
+	/* Without -O, gcc incorrectly reports that execution can reach
+	   here. */
+	abort();
+}
+
+static void chunked_array_fini(const struct eu_metadata *el_metadata,
+			       struct eu_chunked_array *array,
+			       const struct eu_allocator *allocator)
+{
+	size_t chunk_len = (size_t)1 << array->priv.shift;
+	size_t n = chunk_count(array);
+	size_t i, j, end;
+	char *el;
+
+	for (i = 0, j = 0; j < array->len; i++) {
+		el = array->chunks[i];
+		end = array->len - j < chunk_len ? array->len : j + chunk_len;
+		for (; j < end; j++) {
+			el_metadata->fini(el_metadata, el, allocator);
+			el += el_metadata->size;
+		}
+	}
+
+	for (i = 0; i < n; i++)
+		eu_allocator_free(allocator, array->chunks[i]);
+
+	if (n)
+		eu_allocator_free(allocator, array->chunks);
+}
+
+static void chunked_array_metadata_fini(const struct eu_metadata *gmetadata,
+					void *value,
+					const struct eu_allocator *allocator)
+{
+	struct eu_array_metadata *metadata
+		= (struct eu_array_metadata *)gmetadata;
+	chunked_array_fini(metadata->element_metadata, value, allocator);
+}
+
+static void chunked_array_parse_frame_destroy(struct eu_stack_frame *gframe,
+					      void *v_ep)
+{
+	struct chunked_array_parse_frame *frame
+		= (struct chunked_array_parse_frame *)gframe;
+	struct eu_parse *ep = v_ep;
+
+	chunked_array_fini(frame->metadata->element_metadata, frame->result,
+			   ep->heap.allocator);
+
+	/* To avoid fini functions being called multiple times. */
+	frame->result->chunks = NULL;
+	frame->result->priv.capacity = frame->result->len = 0;
+}
+
+static struct eu_value chunked_array_get(struct eu_value val,
+					 struct eu_string_ref name)
+{
+	struct eu_array_metadata *md = (struct eu_array_metadata *)val.metadata;
+	struct eu_chunked_array *array = val.value;
+	size_t index = array_index(name, array->len);
+
+	if (index == array->len)
+		return eu_value_none;
+
+	return eu_value(eu_chunked_array_at(array,
+					    md->element_metadata->size,
+					    index),
+			md->element_metadata);
+}
+
+static enum eu_result chunked_array_generate(
+					const struct eu_metadata *gmetadata,
+					struct eu_generate *eg, void *value)
+{
+	const struct eu_array_metadata *metadata
+		= (const struct eu_array_metadata *)gmetadata;
+	struct eu_chunked_array *array = value;
+	size_t i;
+	char *el;
+	const struct eu_metadata *el_md = metadata->element_metadata;
+	enum array_gen_state state;
+	struct array_gen_frame *frame;
+	void **chunk;
+	char *chunk_end;
+	size_t chunk_size;
+
+	if (array->len == 0)
+		return eu_fixed_gen_32(eg, 2, MULTICHAR_2('[',']'), "[]");
+
+	/* There is always at least one char of space in the output buffer. */
+	*eg->output++ = '[';
+
+	i = array->len;
+	chunk = array->chunks;
+	el = *chunk;
+	chunk_size = el_md->size << array->priv.shift;
+	chunk_end = el + chunk_size;
+
+#define RESUME_ONLY(x)
+#include "array_gen_sm.c"
+}
+
 const struct eu_array_metadata eu_variant_array_metadata = {
 	{
 		EU_JSON_ARRAY,
 		sizeof(struct eu_array),
 		array_parse,
 		array_generate,
-		eu_array_fini,
+		array_metadata_fini,
 		eu_array_get,
 		eu_object_iter_init_fail,
 		eu_object_size_fail,
 		eu_to_double_fail,
 		eu_to_integer_fail,
 	},
-	&eu_variant_metadata
+	&eu_variant_metadata,
+	ARRAY_INITIAL_CAPACITY,
+	0,
+	0,
+	0
 };
 
 enum eu_result eu_variant_array(const void *unused_metadata,
@@ -275,13 +728,34 @@ enum eu_result eu_variant_array(const void *unused_metadata,
 
 void eu_variant_array_fini(struct eu_variant_array *array)
 {
-	array_fini(&eu_variant_metadata, (struct eu_array *)array);
+	array_fini(&eu_variant_metadata, (struct eu_array *)array,
+		   &eu_default_allocator);
+}
+
+static void release_array_metadata(struct eu_metadata *md)
+{
+	free(md);
+}
+
+static size_t hinted_capacity(const struct eu_array_descriptor_v2 *ad)
+{
+	size_t capacity = ad->expected_items;
+
+	if (!capacity)
+		capacity = ARRAY_INITIAL_CAPACITY;
+
+	if (capacity < ad->min_items)
+		capacity = ad->min_items;
+
+	if (ad->max_items && capacity > ad->max_items)
+		capacity = ad->max_items;
+
+	return capacity;
 }
 
 const struct eu_metadata *eu_introduce_array(const struct eu_type_descriptor *d,
-					     struct eu_introduce_chain *chain)
+					     struct eu_introduce_chain **chain)
 {
-	struct eu_introduce_chain chain_head;
 	struct eu_array_metadata *md = malloc(sizeof *md);
 	struct eu_array_descriptor_v1 *ad
 		= container_of(d, struct eu_array_descriptor_v1, base);
@@ -289,24 +763,50 @@ const struct eu_metadata *eu_introduce_array(const struct eu_type_descriptor *d,
 	if (md == NULL)
 		return NULL;
 
-	chain_head.descriptor = &ad->base;
-	chain_head.metadata = &md->base;
-	chain_head.next = chain;
+	if (!eu_introduce_chain_add(chain, d, &md->base,
+				    release_array_metadata)) {
+		free(md);
+		return NULL;
+	}
 
 	md->base.json_type = EU_JSON_ARRAY;
-	md->base.size = sizeof(struct eu_array);
-	md->base.parse = array_parse;
-	md->base.generate = array_generate;
-	md->base.fini = eu_array_fini;
-	md->base.get = eu_array_get;
+	if (d->kind == EU_TDESC_CHUNKED_ARRAY_V1) {
+		md->base.size = sizeof(struct eu_chunked_array);
+		md->base.parse = chunked_array_parse;
+		md->base.generate = chunked_array_generate;
+		md->base.fini = chunked_array_metadata_fini;
+		md->base.get = chunked_array_get;
+	}
+	else {
+		md->base.size = sizeof(struct eu_array);
+		md->base.parse = array_parse;
+		md->base.generate = array_generate;
+		md->base.fini = array_metadata_fini;
+		md->base.get = eu_array_get;
+	}
+
 	md->base.object_iter_init = eu_object_iter_init_fail;
 	md->base.object_size = eu_object_size_fail;
 	md->base.to_double = eu_to_double_fail;
 	md->base.to_integer = eu_to_integer_fail;
 
-	md->element_metadata = eu_introduce_aux(ad->element_descriptor,
-						&chain_head);
+	md->initial_capacity = ARRAY_INITIAL_CAPACITY;
+	md->max_items = 0;
+	md->adaptive = 1;
+	md->last_len = 0;
+
+	if (d->kind == EU_TDESC_ARRAY_V2
+	    || d->kind == EU_TDESC_CHUNKED_ARRAY_V1) {
+		struct eu_array_descriptor_v2 *ad2
+			= container_of(ad, struct eu_array_descriptor_v2, v1);
+
+		md->initial_capacity = hinted_capacity(ad2);
+		md->max_items = ad2->max_items;
+	}
+
+	md->element_metadata = eu_introduce_aux(ad->element_descriptor, chain);
+	if (!md->element_metadata)
+		return NULL;
 
-	*d->metadata = &md->base;
 	return &md->base;
 }
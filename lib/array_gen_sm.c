@@ -1,5 +1,5 @@
 /* This is the object JSON generation state machine.  It is not a
-   self-contained C file: it gets included in a couple of places in
+   self-contained C file: it gets included in a few places in
    array.c */
 
 	for (;;) {
@@ -29,6 +29,10 @@ RESUME_ONLY(case ARRAY_GEN_ELEMENT:)
 
 		*eg->output++ = ',';
 		el += el_md->size;
+		if (unlikely(el == chunk_end)) {
+			el = *++chunk;
+			chunk_end = el + chunk_size;
+		}
 	}
 
 	*eg->output++ = ']';
@@ -48,6 +52,9 @@ RESUME_ONLY(case ARRAY_GEN_ELEMENT:)
 	frame->el = el;
 	frame->el_md = el_md;
 	frame->state = state;
+	frame->chunk = chunk;
+	frame->chunk_end = chunk_end;
+	frame->chunk_size = chunk_size;
 	return EU_PAUSED;
 
  alloc_error:
@@ -10,14 +10,16 @@ RESUME_ONLY(case ARRAY_PARSE_OPEN:)
 	if (*ep->input == ']')
 		goto empty;
 
-	el = result->a = malloc(el_size * capacity);
-	memset(el, 0, el_size * capacity);
-	if (!el)
+	el = result->a = eu_alloc(&ep->heap, el_size * capacity);
+	if (!el) {
+		capacity = 0;
 		goto error;
+	}
 
 	for (;;) {
 		state = ARRAY_PARSE_ELEMENT;
 		len++;
+		memset(el, 0, el_size);
 		switch (el_metadata->parse(el_metadata, ep, el)) {
 		case EU_OK:
 			break;
@@ -58,29 +60,23 @@ RESUME_ONLY(case ARRAY_PARSE_COMMA:)
 			goto pause;
 
 		if (len == capacity) {
-			size_t sz = capacity * el_size;
-			char *new_a = realloc(result->a, sz * 2);
-
-			capacity *= 2;
-			if (new_a) {
-				result->a = new_a;
-				el = new_a + sz;
-				memset(el, 0, sz);
-			}
-			else {
-				free(result->a);
-				result->a = NULL;
-				result->len = 0;
-				result->priv.capacity = 0;
+			size_t new_capacity = grown_capacity(metadata, capacity);
+			char *new_a = eu_realloc(&ep->heap, result->a,
+						 capacity * el_size,
+						 new_capacity * el_size);
+
+			if (!new_a)
 				goto error;
-			}
+
+			capacity = new_capacity;
+			result->a = new_a;
+			el = new_a + len * el_size;
 		}
 	}
 
  done:
 	ep->input++;
-	result->len = len;
-	result->priv.capacity = capacity;
+	array_parse_done(metadata, ep, result, len, capacity);
 	return EU_OK;
 
  empty:
@@ -98,7 +94,7 @@ RESUME_ONLY(case ARRAY_PARSE_COMMA:)
 		frame->base.resume = array_parse_resume;
 		frame->base.destroy = array_parse_frame_destroy;
 		frame->state = state;
-		frame->el_metadata = el_metadata;
+		frame->metadata = metadata;
 		frame->result = result;
 		result->len = len;
 		result->priv.capacity = capacity;
@@ -106,6 +102,9 @@ RESUME_ONLY(case ARRAY_PARSE_COMMA:)
 	}
 
  error:
+	/* Leave the elements parsed so far for the fini function */
+	result->len = len;
+	result->priv.capacity = capacity;
 	return EU_ERROR;
 
 #undef RESUME_ONLY
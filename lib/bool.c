@@ -37,6 +37,17 @@ static enum eu_result bool_parse(const struct eu_metadata *metadata,
 	}
 }
 
+const char *eu_parse_bool_value(struct eu_parse *ep, const char *p,
+				const char *end, eu_bool_t *result)
+{
+	if (p == end)
+		return NULL;
+
+	ep->input = p;
+	return eu_parse_value_result(ep, bool_parse(&eu_bool_metadata, ep,
+						    result));
+}
+
 static struct fixed_gen_64 bool_fixed_gens[2] = {
 	FIXED_GEN_64_INIT(4, MULTICHAR_4('t','r','u','e'), "true"),
 	FIXED_GEN_64_INIT(5, MULTICHAR_5('f','a','l','s','e'), "false")
@@ -0,0 +1,96 @@
+/* This is the chunked array parsing state machine.  It is not a
+   self-contained C file: it gets included in a couple of places in
+   array.c */
+
+RESUME_ONLY(case ARRAY_PARSE_OPEN:)
+	ep->input = skip_whitespace(ep->input, ep->input_end);
+	if (ep->input == ep->input_end)
+		goto pause;
+
+	if (*ep->input == ']')
+		goto empty;
+
+	for (;;) {
+		if (len == result->priv.capacity) {
+			if (!chunked_grow(&ep->heap, result, el_size,
+					  metadata->initial_capacity))
+				goto error;
+
+			el = eu_chunked_array_at(result, el_size, len);
+		}
+
+		state = ARRAY_PARSE_ELEMENT;
+		len++;
+		memset(el, 0, el_size);
+		switch (el_metadata->parse(el_metadata, ep, el)) {
+		case EU_OK:
+			break;
+
+		case EU_PAUSED:
+			goto pause_in_element;
+
+		default:
+			goto error;
+		}
+
+		el += el_size;
+
+RESUME_ONLY(case ARRAY_PARSE_ELEMENT:)
+		if (ep->input == ep->input_end)
+			goto pause;
+
+		if (unlikely(*ep->input != ',')) {
+			if (*ep->input == ']')
+				goto done;
+
+			ep->input = skip_whitespace(ep->input, ep->input_end);
+			if (ep->input == ep->input_end)
+				goto pause;
+
+			if (unlikely(*ep->input != ',')) {
+				if (*ep->input == ']')
+					goto done;
+				else
+					goto error;
+			}
+		}
+
+		ep->input++;
+		state = ARRAY_PARSE_COMMA;
+RESUME_ONLY(case ARRAY_PARSE_COMMA:)
+		if (ep->input == ep->input_end)
+			goto pause;
+	}
+
+ done:
+	ep->input++;
+	result->len = len;
+	return EU_OK;
+
+ empty:
+	ep->input++;
+	result->chunks = EU_ZERO_LENGTH_PTR;
+	result->priv.capacity = result->len = 0;
+	return EU_OK;
+
+ pause:
+	eu_stack_begin_pause(&ep->stack);
+
+ pause_in_element:
+	frame = eu_stack_alloc(&ep->stack, sizeof *frame);
+	if (frame) {
+		frame->base.resume = chunked_array_parse_resume;
+		frame->base.destroy = chunked_array_parse_frame_destroy;
+		frame->state = state;
+		frame->metadata = metadata;
+		frame->result = result;
+		result->len = len;
+		return EU_PAUSED;
+	}
+
+ error:
+	/* Leave the elements parsed so far for the fini function */
+	result->len = len;
+	return EU_ERROR;
+
+#undef RESUME_ONLY
@@ -1,10 +1,47 @@
 #include <euphemus.h>
 #include "euphemus_int.h"
 
-void eu_noop_fini(const struct eu_metadata *metadata, void *value)
+static void *default_alloc(void *user, size_t size)
+{
+	(void)user;
+	return malloc(size);
+}
+
+static void *default_realloc(void *user, void *ptr, size_t size)
+{
+	(void)user;
+	return realloc(ptr, size);
+}
+
+static void default_free(void *user, void *ptr)
+{
+	(void)user;
+	free(ptr);
+}
+
+const struct eu_allocator eu_default_allocator = {
+	default_alloc,
+	default_realloc,
+	default_free,
+	NULL
+};
+
+const struct eu_heap eu_default_heap = {
+	&eu_default_allocator,
+	NULL
+};
+
+void eu_value_fini(struct eu_value val, const struct eu_allocator *allocator)
+{
+	val.metadata->fini(val.metadata, val.value, allocator);
+}
+
+void eu_noop_fini(const struct eu_metadata *metadata, void *value,
+		  const struct eu_allocator *allocator)
 {
 	(void)metadata;
 	(void)value;
+	(void)allocator;
 }
 
 static enum eu_result fail_parse(const struct eu_metadata *metadata,
@@ -25,10 +62,12 @@ enum eu_result eu_generate_fail(const struct eu_metadata *metadata,
 	return EU_ERROR;
 }
 
-static void fail_fini(const struct eu_metadata *metadata, void *value)
+static void fail_fini(const struct eu_metadata *metadata, void *value,
+		      const struct eu_allocator *allocator)
 {
 	(void)metadata;
 	(void)value;
+	(void)allocator;
 }
 
 struct eu_value eu_get_fail(struct eu_value val, struct eu_string_ref name)
@@ -78,35 +117,125 @@ static struct eu_metadata fail_metadata = {
 	eu_to_integer_fail,
 };
 
+/* Publish the metadata built for d, and for the other descriptors
+   reached from it.  Another thread might have published metadata for
+   d in the meantime, in which case we use that and release ours.  If
+   we win for d but lose for some other descriptor, our metadata for
+   it might be referenced from what we published, so it is retained.
+   It is equivalent to the winner's, so that is harmless. */
+static const struct eu_metadata *publish(const struct eu_type_descriptor *d,
+					 const struct eu_metadata *md,
+					 struct eu_introduce_chain *chain)
+{
+	const struct eu_metadata *expected = NULL;
+	struct eu_introduce_chain *c;
+
+	if (!__atomic_compare_exchange_n(d->metadata, &expected, md, 0,
+					 __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+		for (c = chain; c; c = c->next)
+			c->release(c->metadata);
+
+		return expected;
+	}
+
+	for (c = chain; c; c = c->next) {
+		expected = NULL;
+		if (c->descriptor != d)
+			__atomic_compare_exchange_n(c->descriptor->metadata,
+						    &expected, c->metadata, 0,
+						    __ATOMIC_RELEASE,
+						    __ATOMIC_RELAXED);
+	}
+
+	return md;
+}
+
 const struct eu_metadata *eu_introduce(const struct eu_type_descriptor *d)
 {
-	const struct eu_metadata *res = eu_introduce_aux(d, NULL);
+	struct eu_introduce_chain *chain = NULL, *c, *next;
+	const struct eu_metadata *res
+		= __atomic_load_n(d->metadata, __ATOMIC_ACQUIRE);
+
+	if (res)
+		return res;
+
+	res = eu_introduce_aux(d, &chain);
+	if (res && chain) {
+		res = publish(d, res, chain);
+	}
+	else {
+		for (c = chain; c; c = c->next)
+			c->release(c->metadata);
+	}
+
+	for (c = chain; c; c = next) {
+		next = c->next;
+		free(c);
+	}
+
 	return res != NULL ? res : &fail_metadata;
 }
 
+int eu_introduce_all(const struct eu_type_descriptor *const *descriptors)
+{
+	int ok = 1;
+
+	for (; *descriptors; descriptors++)
+		if (eu_introduce(*descriptors) == &fail_metadata)
+			ok = 0;
+
+	return ok;
+}
+
+int eu_introduce_chain_add(struct eu_introduce_chain **chain,
+			   const struct eu_type_descriptor *d,
+			   struct eu_metadata *md,
+			   void (*release)(struct eu_metadata *md))
+{
+	struct eu_introduce_chain *c = malloc(sizeof *c);
+
+	if (!c)
+		return 0;
+
+	c->descriptor = d;
+	c->metadata = md;
+	c->release = release;
+	c->next = *chain;
+	*chain = c;
+	return 1;
+}
+
 const struct eu_metadata *eu_introduce_aux(const struct eu_type_descriptor *d,
-					   struct eu_introduce_chain *chain)
+					   struct eu_introduce_chain **chain)
 {
 	struct eu_introduce_chain *c;
-	const struct eu_metadata *md = *d->metadata;
+	const struct eu_metadata *md
+		= __atomic_load_n(d->metadata, __ATOMIC_ACQUIRE);
 
 	if (md)
 		return md;
 
-	/* Check whether we are already processing this descriptor
-	   somewhere up the stack. */
-	for (c = chain; c != NULL; c = c->next)
+	/* Check whether we have already built metadata for this
+	   descriptor (possibly still in progress further up the
+	   stack). */
+	for (c = *chain; c != NULL; c = c->next)
 		if (d == c->descriptor)
 			return c->metadata;
 
 	switch (d->kind) {
 	case EU_TDESC_STRUCT_V1:
+	case EU_TDESC_STRUCT_V2:
+	case EU_TDESC_STRUCT_V3:
 		return eu_introduce_struct(d, chain);
 
 	case EU_TDESC_STRUCT_PTR_V1:
+	case EU_TDESC_STRUCT_PTR_V2:
+	case EU_TDESC_STRUCT_PTR_V3:
 		return eu_introduce_struct_ptr(d, chain);
 
 	case EU_TDESC_ARRAY_V1:
+	case EU_TDESC_ARRAY_V2:
+	case EU_TDESC_CHUNKED_ARRAY_V1:
 		return eu_introduce_array(d, chain);
 
 	default:
@@ -156,7 +285,8 @@ void *eu_value_extract(struct eu_value val, enum eu_json_type type)
 
 	if (t == EU_JSON_VARIANT) {
 		struct eu_variant *var = val.value;
-		if (var->metadata->json_type == type)
+		if (var->metadata->json_type == type
+		    && eu_variant_materialize(var))
 			return &var->u;
 	}
 
@@ -47,8 +47,10 @@ struct eu_metadata {
 	enum eu_result (*generate)(const struct eu_metadata *metadata,
 				   struct eu_generate *eg, void *value);
 
-	/* Release any resources associated with the value.*/
-	void (*fini)(const struct eu_metadata *metadata, void *value);
+	/* Release any resources associated with the value, which was
+	   allocated with the given allocator. */
+	void (*fini)(const struct eu_metadata *metadata, void *value,
+		     const struct eu_allocator *allocator);
 
 	/* Get a member of an object or array. */
 	struct eu_value (*get)(struct eu_value val, struct eu_string_ref name);
@@ -62,35 +64,74 @@ struct eu_metadata {
 	struct eu_maybe_integer (*to_integer)(struct eu_value val);
 };
 
+/* The metadata built during an eu_introduce call.  None of it is
+   published via the descriptors' metadata pointers until it is all
+   built, so other threads never see incomplete metadata, and it can
+   all be released if another thread gets there first. */
 struct eu_introduce_chain {
 	const struct eu_type_descriptor *descriptor;
 	struct eu_metadata *metadata;
+
+	/* Release the metadata, if it is not published */
+	void (*release)(struct eu_metadata *metadata);
+
 	struct eu_introduce_chain *next;
 };
 
+int eu_introduce_chain_add(struct eu_introduce_chain **chain,
+			   const struct eu_type_descriptor *d,
+			   struct eu_metadata *md,
+			   void (*release)(struct eu_metadata *md));
+
 const struct eu_metadata *eu_introduce_aux(const struct eu_type_descriptor *d,
-					 struct eu_introduce_chain *chain_next);
+					 struct eu_introduce_chain **chain);
 const struct eu_metadata *eu_introduce_struct(const struct eu_type_descriptor *d,
-					      struct eu_introduce_chain *c);
+					      struct eu_introduce_chain **c);
 const struct eu_metadata *eu_introduce_struct_ptr(
 					      const struct eu_type_descriptor *d,
-					      struct eu_introduce_chain *c);
+					      struct eu_introduce_chain **c);
 const struct eu_metadata *eu_introduce_array(const struct eu_type_descriptor *gd,
-					     struct eu_introduce_chain *chain);
+					     struct eu_introduce_chain **chain);
 
 struct eu_object_iter_priv {
 	int (*next)(struct eu_object_iter *iter);
 };
 
-/* Parse/Generation stack management */
+/* Parse/Generation stack management (see stack.c) */
+
+struct eu_stack_chunk;
+
+/* The header of a segment of the stack, recording the state of the
+   segment below it. */
+struct eu_stack_segment {
+	struct eu_stack_segment *prev;
+	char *prev_bottom;
+	char *prev_top;
+};
 
 struct eu_stack {
-	char *stack;
+	const struct eu_allocator *allocator;
+
+	/* Scratch space, e.g. for tokens split between inputs */
+	char *scratch;
 	size_t scratch_size;
-	size_t new_stack_bottom;
-	size_t new_stack_top;
-	size_t old_stack_bottom;
-	size_t stack_area_size;
+	size_t scratch_capacity;
+
+	/* The current segment.  Its frames from bottom to top are
+	   yet to be run. */
+	struct eu_stack_segment *segment;
+	char *bottom;
+	char *top;
+
+	/* Whether the next frame pushed starts a new segment */
+	int segment_pending;
+
+	/* The chunk holding the current segment */
+	struct eu_stack_chunk *chunk;
+	char *chunk_end;
+
+	/* A released chunk, kept for reuse */
+	struct eu_stack_chunk *spare;
 };
 
 /* Result codes for parsing a generation */
@@ -106,12 +147,15 @@ struct eu_stack_frame {
 	size_t size;
 	enum eu_result (*resume)(struct eu_stack_frame *frame,
 				 void *context);
-	void (*destroy)(struct eu_stack_frame *frame);
+	void (*destroy)(struct eu_stack_frame *frame, void *context);
 };
 
 
-void *eu_stack_init(struct eu_stack *st, size_t alloc_size);
-void eu_stack_fini(struct eu_stack *st);
+void *eu_stack_init(struct eu_stack *st, size_t alloc_size,
+		    const struct eu_allocator *allocator);
+void eu_stack_fini(struct eu_stack *st, void *context);
+void eu_stack_discard(struct eu_stack *st);
+void *eu_stack_reset(struct eu_stack *st, size_t alloc_size, void *context);
 void eu_stack_begin_pause(struct eu_stack *st);
 void *eu_stack_alloc(struct eu_stack *st, size_t size);
 
@@ -125,8 +169,7 @@ enum eu_result eu_stack_run(struct eu_stack *st, void *context);
 
 static __inline__ int eu_stack_empty(struct eu_stack *st)
 {
-	return st->new_stack_bottom == st->new_stack_top
-		&& st->old_stack_bottom == st->stack_area_size;
+	return st->bottom == st->top && !st->segment->prev;
 }
 
 int eu_stack_reserve_scratch(struct eu_stack *st, size_t s);
@@ -145,22 +188,22 @@ static __inline__ void eu_stack_reset_scratch(struct eu_stack *st)
 static __inline__ void eu_stack_set_scratch_end(struct eu_stack *st,
 						char *end)
 {
-	st->scratch_size = end - st->stack;
+	st->scratch_size = end - st->scratch;
 }
 
 static __inline__ char *eu_stack_scratch(struct eu_stack *st)
 {
-	return st->stack;
+	return st->scratch;
 }
 
 static __inline__ char *eu_stack_scratch_end(struct eu_stack *st)
 {
-	return st->stack + st->scratch_size;
+	return st->scratch + st->scratch_size;
 }
 
 static __inline__ struct eu_string_ref eu_stack_scratch_ref(struct eu_stack *st)
 {
-	return eu_string_ref(st->stack, st->scratch_size);
+	return eu_string_ref(st->scratch, st->scratch_size);
 }
 
 int eu_stack_set_scratch(struct eu_stack *st, const char *start,
@@ -170,7 +213,7 @@ int eu_stack_append_scratch(struct eu_stack *st, const char *start,
 int eu_stack_append_scratch_with_nul(struct eu_stack *st, const char *start,
 				     const char *end);
 
-void eu_stack_frame_noop_destroy(struct eu_stack_frame *frame);
+void eu_stack_frame_noop_destroy(struct eu_stack_frame *frame, void *context);
 
 /* Locale ugliness */
 
@@ -215,6 +258,109 @@ static __inline__ void eu_locale_restore(struct eu_locale *el)
 	}
 }
 
+/* Memory allocation */
+
+static __inline__ void *eu_allocator_alloc(const struct eu_allocator *a,
+					   size_t size)
+{
+	return a->alloc(a->user, size);
+}
+
+static __inline__ void *eu_allocator_realloc(const struct eu_allocator *a,
+					     void *ptr, size_t size)
+{
+	return a->realloc(a->user, ptr, size);
+}
+
+static __inline__ void eu_allocator_free(const struct eu_allocator *a,
+					 void *ptr)
+{
+	a->free(a->user, ptr);
+}
+
+/* Arenas */
+
+/* Arena allocations are aligned suitably for any of these */
+union eu_arena_align {
+	void *p;
+	double d;
+	long l;
+};
+
+#define EU_ARENA_ROUND_UP(n) \
+	(((n) + sizeof(union eu_arena_align) - 1) \
+	 & -sizeof(union eu_arena_align))
+
+struct eu_arena {
+	const struct eu_allocator *allocator;
+
+	/* The free space in the current chunk */
+	char *next;
+	char *end;
+
+	/* The most recent allocation from the current chunk, which
+	   can be resized in place. */
+	char *last;
+
+	struct eu_arena_chunk *chunks;
+	size_t chunk_size;
+};
+
+void *eu_arena_alloc_slow(struct eu_arena *arena, size_t size);
+void *eu_arena_realloc(struct eu_arena *arena, void *ptr, size_t old_size,
+		       size_t size);
+
+static __inline__ void *eu_arena_alloc(struct eu_arena *arena, size_t size)
+{
+	size_t rounded;
+
+	/* Like malloc, distinct allocations get distinct pointers */
+	if (unlikely(!size))
+		size = 1;
+
+	rounded = EU_ARENA_ROUND_UP(size);
+	if (likely(rounded <= (size_t)(arena->end - arena->next))) {
+		arena->last = arena->next;
+		arena->next += rounded;
+		return arena->last;
+	}
+
+	return eu_arena_alloc_slow(arena, size);
+}
+
+/* Where parse results get allocated from: The arena, if there is
+   one, otherwise the allocator.  Arena memory is not freed
+   individually, so eu_free is a no-op for arenas. */
+struct eu_heap {
+	const struct eu_allocator *allocator;
+	struct eu_arena *arena;
+};
+
+extern const struct eu_heap eu_default_heap;
+
+static __inline__ void *eu_alloc(const struct eu_heap *heap, size_t size)
+{
+	if (heap->arena)
+		return eu_arena_alloc(heap->arena, size);
+	else
+		return eu_allocator_alloc(heap->allocator, size);
+}
+
+static __inline__ void *eu_realloc(const struct eu_heap *heap, void *ptr,
+				   size_t old_size, size_t size)
+{
+	if (heap->arena)
+		return eu_arena_realloc(heap->arena, ptr, old_size, size);
+	else
+		return eu_allocator_realloc(heap->allocator, ptr, size);
+}
+
+static __inline__ void eu_free(const struct eu_heap *heap, void *ptr)
+{
+	if (!heap->arena)
+		eu_allocator_free(heap->allocator, ptr);
+}
+
 /* JSON parsing */
 
 struct eu_parse {
@@ -226,10 +372,83 @@ struct eu_parse {
 	const char *input_end;
 
 	struct eu_locale locale;
+	unsigned int options;
 	int error;
+
+	/* Where the result is allocated from */
+	struct eu_heap heap;
+
+	struct eu_parse_stats stats;
+
+	/* For multi-document parsing, or NULL */
+	eu_parse_document_cb_t document_cb;
+	void *document_data;
+
+	/* The interned names of extra members (struct.c), or NULL */
+	struct eu_name_table *names;
+
+	/* How the value that stopped a specialized parse function
+	   failed: EU_PAUSED if the input ran out within it, leaving its
+	   frames on the stack, or EU_ERROR.  EU_OK if no value did. */
+	enum eu_result value_stop;
+
+	/* The bitmaps of seen members of the objects being parsed, for
+	   detecting repeated members (struct.c) */
+	uint64_t *seen;
+	size_t seen_len;
+	size_t seen_capacity;
 };
 
-void eu_noop_fini(const struct eu_metadata *metadata, void *value);
+void eu_parse_release_names(struct eu_parse *ep);
+
+/* Materialize val if it is a lazy value, or a variant holding one.
+   The parse used is *ep, which is created if it is NULL, and kept for
+   the next call otherwise, so that a series of values can share it.
+   The caller destroys *ep.  Returns 0 if the value could not be
+   parsed. */
+int eu_value_materialize(struct eu_value val, struct eu_parse **ep);
+
+/* Skipping values checks that the brackets outside strings nest and
+   match, so that strings are terminated too.  The kinds of the open
+   brackets are kept as a stack of bits, set for '['.  Brackets nested
+   more than EU_SKIP_KINDS_DEPTH deep are only counted. */
+#define EU_SKIP_KINDS_DEPTH 1024
+
+struct eu_skip_kinds {
+	uint64_t bits[EU_SKIP_KINDS_DEPTH / 64];
+};
+
+/* Record the opening bracket c at depth (counting from 0) */
+static __inline__ void eu_skip_open(struct eu_skip_kinds *kinds,
+				    size_t depth, char c)
+{
+	uint64_t bit = (uint64_t)1 << (depth % 64);
+
+	if (depth < EU_SKIP_KINDS_DEPTH) {
+		if (c == '[')
+			kinds->bits[depth / 64] |= bit;
+		else
+			kinds->bits[depth / 64] &= ~bit;
+	}
+}
+
+/* Whether the closing bracket c matches the one opened at depth */
+static __inline__ int eu_skip_close_ok(const struct eu_skip_kinds *kinds,
+				       size_t depth, char c)
+{
+	return depth >= EU_SKIP_KINDS_DEPTH
+		|| (int)(kinds->bits[depth / 64] >> (depth % 64) & 1)
+							== (c == ']');
+}
+
+/* Skip the object or array starting at p, returning a pointer just
+   past its closing bracket, or NULL if it doesn't end before end or
+   its brackets don't match.  The rest of the syntax might still be
+   invalid. */
+const char *eu_skip_container(const char *p, const char *end);
+
+void eu_noop_fini(const struct eu_metadata *metadata, void *value,
+		  const struct eu_allocator *allocator);
 struct eu_value eu_get_fail(struct eu_value val, struct eu_string_ref name);
 int eu_object_iter_init_fail(struct eu_value val, struct eu_object_iter *iter);
 size_t eu_object_size_fail(struct eu_value val);
@@ -259,23 +478,54 @@ enum eu_result eu_variant_bool(const void *misc, struct eu_parse *ep,
 enum eu_result eu_variant_n(const void *null_metadata, struct eu_parse *ep,
 			    struct eu_variant *result);
 
+/* 128-bit approximations of the powers of five from 5^-342 to
+   5^308, most significant word first.  See powers_of_5.c */
+#define EU_POWERS_OF_5_MIN -342
+#define EU_POWERS_OF_5_MAX 308
+extern const uint64_t eu_powers_of_5[][2];
+
+/* 128-bit approximations of the powers of ten from 10^-292 to
+   10^324, most significant word first.  See powers_of_10.c */
+#define EU_POWERS_OF_10_MIN -292
+#define EU_POWERS_OF_10_MAX 324
+extern const uint64_t eu_powers_of_10[][2];
+
+/* Find the first '"', '\\' or control character in [p, end), or
+   return end if there are none.  This is vectorized, and selects
+   the implementation for the CPU on first use. */
+extern const char *(*eu_scan_string)(const char *p, const char *end);
+
+/* Find the first character that is not JSON whitespace, or return
+   end.  Like eu_scan_string, this is vectorized. */
+extern const char *(*eu_scan_whitespace)(const char *p, const char *end);
+
 /* The JSON spec only allows ASCII whitespace chars */
 #define WHITESPACE_CASES ' ': case '\t': case '\n': case '\r'
 
-static __inline__ const char *skip_whitespace(const char *p, const char *end)
+static __inline__ int is_json_whitespace(char c)
 {
-	for (; p != end; p++) {
-		switch (*p) {
-		case WHITESPACE_CASES:
-			break;
+	switch (c) {
+	case WHITESPACE_CASES:
+		return 1;
 
-		default:
-			goto out;
-		}
+	default:
+		return 0;
 	}
+}
+
+static __inline__ const char *skip_whitespace(const char *p, const char *end)
+{
+	/* Compact JSON has no whitespace, and pretty-printed JSON
+	   often has a single space, so handle those cases inline
+	   before resorting to the vectorized scan for longer runs. */
+	if (p == end || !is_json_whitespace(*p))
+		return p;
+
+	p++;
+	if (p == end || !is_json_whitespace(*p))
+		return p;
 
- out:
-	return p;
+	return eu_scan_whitespace(p + 1, end);
 }
 
 enum eu_result eu_consume_whitespace_pause(const struct eu_metadata *metadata,
@@ -315,6 +565,10 @@ static __inline__ enum eu_result eu_consume_whitespace_until(
 	return EU_OK;
 }
 
+/* Convert the result of a parse function into the return value of a
+   eu_parse_*_value function, recording a failure in ep->value_stop. */
+const char *eu_parse_value_result(struct eu_parse *ep, enum eu_result res);
+
 enum eu_result eu_parse_expect_slow(struct eu_parse *ep, const char *expect,
 				    unsigned int expect_len);
 
@@ -326,8 +580,10 @@ struct eu_generate {
 	char *output;
 	char *output_end;
 
-	struct eu_locale locale;
 	eu_bool_t error;
+
+	/* For materializing lazy values (variant.c), or NULL */
+	struct eu_parse *materialize;
 };
 
 enum eu_result eu_fixed_gen_slow(struct eu_generate *eg, const char *str,
@@ -21,13 +21,19 @@ static enum eu_result initial_gen_resume(struct eu_stack_frame *gframe,
 
 struct eu_generate *eu_generate_create(struct eu_value value)
 {
-	struct eu_generate *eg = malloc(sizeof *eg);
+	return eu_generate_create_with_allocator(value, &eu_default_allocator);
+}
+
+struct eu_generate *eu_generate_create_with_allocator(struct eu_value value,
+					const struct eu_allocator *allocator)
+{
+	struct eu_generate *eg = eu_allocator_alloc(allocator, sizeof *eg);
 	struct initial_gen_frame *frame;
 
 	if (!eg)
 		goto error;
 
-	frame = eu_stack_init(&eg->stack, sizeof *frame);
+	frame = eu_stack_init(&eg->stack, sizeof *frame, allocator);
 	if (!frame)
 		goto free_eg;
 
@@ -35,21 +41,37 @@ struct eu_generate *eu_generate_create(struct eu_value value)
 	frame->base.destroy = eu_stack_frame_noop_destroy;
 	frame->value = value;
 
-	eu_locale_init(&eg->locale);
 	eg->error = 0;
+	eg->materialize = NULL;
 	return eg;
 
  free_eg:
-	free(eg);
+	eu_allocator_free(allocator, eg);
  error:
 	return NULL;
 }
 
 void eu_generate_destroy(struct eu_generate *eg)
 {
-	eu_stack_fini(&eg->stack);
-	eu_locale_fini(&eg->locale);
-	free(eg);
+	const struct eu_allocator *allocator = eg->stack.allocator;
+
+	eu_stack_fini(&eg->stack, eg);
+	if (eg->materialize)
+		eu_parse_destroy(eg->materialize);
+
+	eu_allocator_free(allocator, eg);
+}
+
+void eu_generate_reset(struct eu_generate *eg, struct eu_value value)
+{
+	struct initial_gen_frame *frame
+		= eu_stack_reset(&eg->stack, sizeof *frame, eg);
+
+	frame->base.resume = initial_gen_resume;
+	frame->base.destroy = eu_stack_frame_noop_destroy;
+	frame->value = value;
+
+	eg->error = 0;
 }
 
 size_t eu_generate(struct eu_generate *eg, char *output, size_t len)
@@ -63,7 +85,6 @@ size_t eu_generate(struct eu_generate *eg, char *output, size_t len)
 	eg->output_end = output + len;
 
 	res = eu_stack_run(&eg->stack, eg);
-	eu_locale_restore(&eg->locale);
 
 	if (res == EU_ERROR)
 		eg->error = 1;
@@ -0,0 +1,283 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <euphemus.h>
+#include "euphemus_int.h"
+
+/* Parallel parsing of newline-delimited JSON.
+
+   The buffer is divided into batches of whole lines, which are
+   claimed in turn by the workers.  Only the batch boundaries are
+   found up front; each worker finds the lines within its batch with
+   memchr (which glibc implements with SIMD), and parses them with a
+   single eu_parse that is reset for each record.
+
+   In ordered mode, a worker keeps the results of its batch until all
+   earlier batches have been delivered.  So the reorder buffer holds
+   at most one batch per worker, and a worker that gets ahead waits
+   for the others. */
+
+#define BATCH_SIZE (256 * 1024)
+
+struct ndjson {
+	const struct eu_metadata *metadata;
+	const char *buf;
+	size_t len;
+	unsigned int options;
+	eu_ndjson_record_cb_t cb;
+	void *data;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+
+	/* The start of the next batch to be claimed, and its sequence
+	   number */
+	size_t next_offset;
+	size_t next_batch;
+
+	/* The sequence number of the next batch to be delivered, in
+	   ordered mode */
+	size_t deliver_batch;
+
+	int failed;
+};
+
+/* A worker's results for the current batch, in ordered mode */
+struct ndjson_results {
+	char *values;
+	size_t *offsets;
+	size_t count;
+	size_t capacity;
+};
+
+static int claim_batch(struct ndjson *nd, size_t *start, size_t *end,
+		       size_t *batch)
+{
+	const char *nl;
+	int ok;
+
+	pthread_mutex_lock(&nd->lock);
+	ok = !nd->failed && nd->next_offset < nd->len;
+	if (ok) {
+		*start = nd->next_offset;
+		*end = *start + BATCH_SIZE;
+		if (*end >= nd->len) {
+			*end = nd->len;
+		}
+		else {
+			nl = memchr(nd->buf + *end, '\n', nd->len - *end);
+			*end = nl ? (size_t)(nl + 1 - nd->buf) : nd->len;
+		}
+
+		*batch = nd->next_batch++;
+		nd->next_offset = *end;
+	}
+	pthread_mutex_unlock(&nd->lock);
+
+	return ok;
+}
+
+static void fail(struct ndjson *nd)
+{
+	pthread_mutex_lock(&nd->lock);
+	nd->failed = 1;
+	pthread_cond_broadcast(&nd->cond);
+	pthread_mutex_unlock(&nd->lock);
+}
+
+/* Get the place for the next result in ordered mode */
+static void *add_result(struct ndjson *nd, struct ndjson_results *res,
+			size_t offset)
+{
+	size_t size = nd->metadata->size;
+
+	if (res->count == res->capacity) {
+		size_t capacity = res->capacity ? res->capacity * 2 : 64;
+		char *values = realloc(res->values, capacity * size);
+		size_t *offsets;
+
+		if (!values)
+			return NULL;
+
+		res->values = values;
+		offsets = realloc(res->offsets, capacity * sizeof *offsets);
+		if (!offsets)
+			return NULL;
+
+		res->offsets = offsets;
+		res->capacity = capacity;
+	}
+
+	res->offsets[res->count] = offset;
+	return res->values + size * res->count++;
+}
+
+static void fini_results(struct ndjson *nd, struct ndjson_results *res,
+			 size_t from)
+{
+	size_t size = nd->metadata->size;
+	size_t i;
+
+	for (i = from; i < res->count; i++)
+		nd->metadata->fini(nd->metadata, res->values + size * i,
+				   &eu_default_allocator);
+
+	res->count = 0;
+}
+
+/* Deliver the results of a batch once the earlier batches have been
+   delivered. */
+static int deliver_results(struct ndjson *nd, struct ndjson_results *res,
+			   size_t batch)
+{
+	size_t size = nd->metadata->size;
+	size_t i;
+	int ok;
+
+	pthread_mutex_lock(&nd->lock);
+	while (nd->deliver_batch != batch && !nd->failed)
+		pthread_cond_wait(&nd->cond, &nd->lock);
+
+	ok = !nd->failed;
+	pthread_mutex_unlock(&nd->lock);
+
+	for (i = 0; ok && i < res->count; i++)
+		ok = nd->cb(eu_value(res->values + size * i, nd->metadata),
+			    res->offsets[i], nd->data);
+
+	fini_results(nd, res, i);
+	if (!ok)
+		return 0;
+
+	pthread_mutex_lock(&nd->lock);
+	nd->deliver_batch++;
+	pthread_cond_broadcast(&nd->cond);
+	pthread_mutex_unlock(&nd->lock);
+	return 1;
+}
+
+static void *worker(void *v_nd)
+{
+	struct ndjson *nd = v_nd;
+	const struct eu_metadata *md = nd->metadata;
+	int ordered = nd->options & EU_NDJSON_ORDERED;
+	struct ndjson_results res = { NULL, NULL, 0, 0 };
+	size_t start, end, batch;
+	const char *line, *line_end, *batch_end, *nl;
+	struct eu_parse *ep;
+	void *single, *value;
+
+	/* The parse is reset for each record.  Outside ordered mode,
+	   the results all go in one place. */
+	value = single = malloc(md->size);
+	if (!single)
+		goto error;
+
+	ep = eu_parse_create(eu_value(single, md));
+	if (!ep)
+		goto free_single;
+
+	eu_parse_set_options(ep, nd->options & ~EU_NDJSON_ORDERED);
+
+	while (claim_batch(nd, &start, &end, &batch)) {
+		batch_end = nd->buf + end;
+
+		for (line = nd->buf + start; line != batch_end;
+		     line = line_end) {
+			nl = memchr(line, '\n', batch_end - line);
+			line_end = nl ? nl + 1 : batch_end;
+
+			/* Skip blank lines */
+			if (skip_whitespace(line, line_end) == line_end)
+				continue;
+
+			if (ordered) {
+				value = add_result(nd, &res, line - nd->buf);
+				if (!value)
+					goto fail;
+			}
+
+			eu_parse_reset(ep, eu_value(value, md));
+			if (!eu_parse(ep, line, line_end - line)
+			    || !eu_parse_finish(ep)) {
+				if (ordered)
+					res.count--;
+
+				goto fail;
+			}
+
+			if (!ordered && !nd->cb(eu_value(value, md),
+						line - nd->buf, nd->data))
+				goto fail;
+		}
+
+		if (ordered && !deliver_results(nd, &res, batch))
+			goto fail_delivered;
+	}
+
+	goto done;
+
+ fail:
+	fini_results(nd, &res, 0);
+ fail_delivered:
+	fail(nd);
+ done:
+	eu_parse_destroy(ep);
+	free(res.values);
+	free(res.offsets);
+	free(single);
+	return NULL;
+
+ free_single:
+	free(single);
+ error:
+	fail(nd);
+	return NULL;
+}
+
+int eu_parse_ndjson(const struct eu_metadata *metadata,
+		    const char *buf, size_t len, unsigned int threads,
+		    unsigned int options, eu_ndjson_record_cb_t cb,
+		    void *data)
+{
+	struct ndjson nd;
+	pthread_t *tids;
+	unsigned int i, started;
+
+	if (!threads) {
+		long n = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = n > 0 ? n : 1;
+	}
+
+	nd.metadata = metadata;
+	nd.buf = buf;
+	nd.len = len;
+	nd.options = options;
+	nd.cb = cb;
+	nd.data = data;
+	nd.next_offset = nd.next_batch = nd.deliver_batch = 0;
+	nd.failed = 0;
+	pthread_mutex_init(&nd.lock, NULL);
+	pthread_cond_init(&nd.cond, NULL);
+
+	/* The calling thread is one of the workers.  If threads can't
+	   be started, we make do with fewer. */
+	started = 0;
+	tids = malloc((threads - 1) * sizeof *tids);
+	if (tids)
+		for (i = 0; i < threads - 1; i++, started++)
+			if (pthread_create(&tids[i], NULL, worker, &nd))
+				break;
+
+	worker(&nd);
+
+	for (i = 0; i < started; i++)
+		pthread_join(tids[i], NULL);
+
+	free(tids);
+	pthread_cond_destroy(&nd.cond);
+	pthread_mutex_destroy(&nd.lock);
+	return !nd.failed;
+}
@@ -11,6 +11,57 @@
 
 #define ZERO_TO_9 '0': case ONE_TO_9
 
+/* SWAR (SIMD-within-a-register) digit conversion.  This relies on
+   little-endian byte order, so that the first character loaded is in
+   the low byte of the word. */
+#if !defined(EU_NO_SIMD) && defined(__GNUC__) && defined(__BYTE_ORDER__) \
+	&& __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define SWAR_DIGITS
+
+#define SWAR_ONES ((uint64_t)-1 / 0xff)
+
+static const uint32_t swar_powers_of_10[9] = {
+	1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000
+};
+
+/* Convert the run of up to 8 decimal digits at the start of the 8
+   bytes at p.  Returns the number of digits, and stores their value
+   in *value. */
+static __inline__ unsigned int swar_digits(const char *p, uint64_t *value)
+{
+	uint64_t x, nondigit;
+	unsigned int n;
+
+	memcpy(&x, p, sizeof x);
+
+	/* Flag the lanes outside '0'..'9'.  Carries and borrows can
+	   only spread upwards from a flagged lane, so the lowest flag
+	   is accurate. */
+	nondigit = ((x + SWAR_ONES * (0x80 - ':')) | (x - SWAR_ONES * '0'))
+		& SWAR_ONES * 0x80;
+	n = nondigit ? (unsigned int)__builtin_ctzll(nondigit) >> 3 : 8;
+	if (!n) {
+		*value = 0;
+		return 0;
+	}
+
+	/* Convert lanes to digit values, and shift out the lanes
+	   following the digits, so that the vacated low lanes act as
+	   leading zeros. */
+	x = (x - SWAR_ONES * '0') << (64 - 8 * n);
+
+	/* Combine adjacent lanes: pairs, then quads, then the lot */
+	x = x * 10 + (x >> 8);
+	x = (((x & ((uint64_t)0xff << 32 | 0xff))
+	      * (100 + ((uint64_t)1000000 << 32)))
+	     + (((x >> 16) & ((uint64_t)0xff << 32 | 0xff))
+		* (1 + ((uint64_t)10000 << 32)))) >> 32;
+
+	*value = x;
+	return n;
+}
+#endif
+
 enum number_parse_state {
 	NUMBER_PARSE_START,
 	NUMBER_PARSE_LEADING_MINUS,
@@ -125,12 +176,218 @@ static enum eu_result int_parse_resume(struct eu_stack_frame *gframe,
 	}
 }
 
+/* Decimal to double conversion, using the Eisel-Lemire algorithm
+   (as in the fast_float library).  This works from the decimal
+   significand w and exponent q, as 128-bit products of w with
+   approximations to 5^q.  It is correctly rounded whenever it
+   succeeds, but gives up on the rare cases where the approximation
+   is not good enough to decide the rounding, and on significands of
+   more than 19 digits. */
+
+struct u128 {
+	uint64_t hi;
+	uint64_t lo;
+};
+
+static __inline__ struct u128 mul_64x64(uint64_t a, uint64_t b)
+{
+	struct u128 res;
+#ifdef __SIZEOF_INT128__
+	__extension__ unsigned __int128 p = (unsigned __int128)a * b;
+
+	res.hi = p >> 64;
+	res.lo = p;
+#else
+	uint64_t a_lo = (uint32_t)a, a_hi = a >> 32;
+	uint64_t b_lo = (uint32_t)b, b_hi = b >> 32;
+	uint64_t lo_lo = a_lo * b_lo;
+	uint64_t hi_lo = a_hi * b_lo;
+	uint64_t lo_hi = a_lo * b_hi;
+	uint64_t cross = (lo_lo >> 32) + (uint32_t)hi_lo + lo_hi;
+
+	res.hi = a_hi * b_hi + (hi_lo >> 32) + (cross >> 32);
+	res.lo = cross << 32 | (uint32_t)lo_lo;
+#endif
+	return res;
+}
+
+static __inline__ int leading_zeros_64(uint64_t x)
+{
+#ifdef __GNUC__
+	return __builtin_clzll(x);
+#else
+	int n = 0;
+
+	while (!(x & (uint64_t)1 << 63)) {
+		x <<= 1;
+		n++;
+	}
+
+	return n;
+#endif
+}
+
+#define DOUBLE_MANTISSA_BITS 52
+#define DOUBLE_EXPONENT_BIAS 1023
+#define DOUBLE_INFINITE_POWER 0x7ff
+
+/* Returns 0 if the fast conversion can't be used */
+static int eisel_lemire(uint64_t w, int q, int negative, double *result)
+{
+	const uint64_t *pow5;
+	struct u128 product;
+	uint64_t mantissa, bits;
+	int lz, upperbit, shift, power2;
+
+	if (!w || q < EU_POWERS_OF_5_MIN) {
+		mantissa = 0;
+		power2 = 0;
+		goto out;
+	}
+
+	if (q > EU_POWERS_OF_5_MAX)
+		/* Overflow */
+		return 0;
+
+	lz = leading_zeros_64(w);
+	w <<= lz;
+
+	/* We need the top 55 bits of the product to be exact.  If
+	   they might be affected by the lower bits of 5^q, include
+	   the second word. */
+	pow5 = eu_powers_of_5[q - EU_POWERS_OF_5_MIN];
+	product = mul_64x64(w, pow5[0]);
+	if ((product.hi & 0x1ff) == 0x1ff) {
+		struct u128 second = mul_64x64(w, pow5[1]);
+
+		product.lo += second.hi;
+		if (second.hi > product.lo)
+			product.hi++;
+
+		/* Still ambiguous: leave it to the slow path */
+		if (product.lo == (uint64_t)-1 && (q < -27 || q > 55))
+			return 0;
+	}
+
+	upperbit = product.hi >> 63;
+	shift = upperbit + 64 - DOUBLE_MANTISSA_BITS - 3;
+	mantissa = product.hi >> shift;
+
+	/* floor(log2(10^q)) + 63, computed as in fast_float */
+	power2 = (((152170 + 65536) * q) >> 16) + 63 + upperbit - lz
+		+ DOUBLE_EXPONENT_BIAS;
+
+	if (power2 <= 0) {
+		/* Subnormal */
+		if (-power2 + 1 >= 64) {
+			mantissa = 0;
+			power2 = 0;
+			goto out;
+		}
+
+		mantissa >>= -power2 + 1;
+		mantissa += mantissa & 1;
+		mantissa >>= 1;
+		power2 = mantissa < (uint64_t)1 << DOUBLE_MANTISSA_BITS ? 0 : 1;
+		goto out;
+	}
+
+	/* If we are exactly halfway between two doubles, round to
+	   even.  Only small exponents can yield exact products. */
+	if (product.lo <= 1 && q >= -4 && q <= 23 && (mantissa & 3) == 1
+	    && (mantissa << shift) == product.hi)
+		mantissa &= ~(uint64_t)1;
+
+	mantissa += mantissa & 1;
+	mantissa >>= 1;
+	if (mantissa >= (uint64_t)2 << DOUBLE_MANTISSA_BITS) {
+		mantissa = (uint64_t)1 << DOUBLE_MANTISSA_BITS;
+		power2++;
+	}
+
+	mantissa &= ~((uint64_t)1 << DOUBLE_MANTISSA_BITS);
+	if (power2 >= DOUBLE_INFINITE_POWER)
+		/* Overflow */
+		return 0;
+
+ out:
+	bits = mantissa | (uint64_t)power2 << DOUBLE_MANTISSA_BITS
+		| (uint64_t)negative << 63;
+	memcpy(result, &bits, sizeof *result);
+	return 1;
+}
+
+#define MAX_SIGNIFICANT_DIGITS 19
+
+/* Convert a number, the syntax of which has already been checked. */
+static int fast_convert(const char *p, const char *end, double *result)
+{
+	uint64_t w = 0;
+	int digits = 0;
+	int negative = 0;
+	long q = 0;
+
+	if (*p == '-') {
+		negative = 1;
+		p++;
+	}
+
+	for (; p != end && *p >= '0' && *p <= '9'; p++) {
+		if (w || *p != '0') {
+			if (digits == MAX_SIGNIFICANT_DIGITS)
+				return 0;
+
+			w = w * 10 + (*p - '0');
+			digits++;
+		}
+	}
+
+	if (p != end && *p == '.') {
+		for (p++; p != end && *p >= '0' && *p <= '9'; p++) {
+			if (w || *p != '0') {
+				if (digits == MAX_SIGNIFICANT_DIGITS)
+					return 0;
+
+				w = w * 10 + (*p - '0');
+				digits++;
+			}
+
+			q--;
+		}
+	}
+
+	if (p != end) {
+		/* An exponent */
+		int exp_negative = 0;
+		long e = 0;
+
+		p++;
+		if (*p == '-' || *p == '+')
+			exp_negative = (*p++ == '-');
+
+		for (; p != end; p++)
+			if (e < 100000)
+				e = e * 10 + (*p - '0');
+
+		q += exp_negative ? -e : e;
+	}
+
+	if (q < -100000 || q > 100000)
+		return 0;
+
+	return eisel_lemire(w, q, negative, result);
+}
+
 static int convert(struct eu_parse *ep, const char *start,
 		   const char *end, double *result)
 {
 	char *strtod_end;
 	double val;
 
+	if (likely(fast_convert(start, end, result)))
+		return 1;
+
+	/* The slow path */
 	if (!eu_locale_c(&ep->locale))
 		return 0;
 
@@ -236,6 +493,28 @@ static enum eu_result nonint_parse_resume(struct eu_stack_frame *gframe,
 	abort();
 }
 
+const char *eu_parse_integer_value(struct eu_parse *ep, const char *p,
+				   const char *end, eu_integer_t *result)
+{
+	if (p == end)
+		return NULL;
+
+	ep->input = p;
+	return eu_parse_value_result(ep, int_parse(&eu_integer_metadata, ep,
+						   result));
+}
+
+const char *eu_parse_double_value(struct eu_parse *ep, const char *p,
+				  const char *end, double *result)
+{
+	if (p == end)
+		return NULL;
+
+	ep->input = p;
+	return eu_parse_value_result(ep, nonint_parse(&eu_double_metadata, ep,
+						      result));
+}
+
 static enum eu_result variant_number_resume(struct eu_stack_frame *gframe,
 					    void *v_ep);
 
@@ -328,8 +607,8 @@ struct number_gen_frame {
 static enum eu_result number_gen_resume(struct eu_stack_frame *gframe,
 					void *eg);
 
-/* 30 characters ought to be safe for an IEEE754 double, including the
-   trailing 0 byte. */
+/* Output formatted characters from the scratch space, pausing if
+   they don't fit. */
 static enum eu_result output_scratch(struct eu_generate *eg, char *p,
 				     size_t len)
 {
@@ -355,93 +634,277 @@ static enum eu_result output_scratch(struct eu_generate *eg, char *p,
 	return EU_PAUSED;
 }
 
-static enum eu_result integer_generate(const struct eu_metadata *metadata,
-				       struct eu_generate *eg, void *value)
+static const char digit_pairs[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+static int decimal_digits(uint64_t v)
 {
-	int64_t ivalue = *(eu_integer_t *)value;
-	uint64_t uvalue;
-	char *p;
-	size_t len;
+	int n = 1;
 
-	(void)metadata;
+	for (; v >= 100; v /= 100)
+		n += 2;
 
-	if (ivalue == 0) {
-		*eg->output++ = '0';
-		return EU_OK;
+	return n + (v >= 10);
+}
+
+/* Write the decimal digits of v so that they end just before end */
+static void write_digits(char *end, uint64_t v)
+{
+	for (; v >= 100; v /= 100) {
+		end -= 2;
+		memcpy(end, digit_pairs + 2 * (v % 100), 2);
 	}
 
-	if (ivalue > 0) {
-		uvalue = ivalue;
+	if (v >= 10)
+		memcpy(end - 2, digit_pairs + 2 * v, 2);
+	else
+		end[-1] = '0' + v;
+}
+
+/* A sign and 19 digits */
+#define MAX_INTEGER_CHARS 20
+
+static char *format_integer(char *p, int64_t ivalue)
+{
+	uint64_t uvalue = ivalue;
+
+	if (ivalue < 0) {
+		*p++ = '-';
+		uvalue = -uvalue;
+	}
+
+	p += decimal_digits(uvalue);
+	write_digits(p, uvalue);
+	return p;
+}
+
+/* Find the shortest decimal that rounds to the given finite, non-zero
+   double (closest to it, if there are several), using Raffaello
+   Giulietti's Schubfach algorithm.  The result is digits * 10^*exp10,
+   and digits has at most 17 digits. */
+
+static __inline__ uint64_t round_to_odd(const uint64_t *g, uint64_t cp)
+{
+	struct u128 x = mul_64x64(g[1], cp);
+	struct u128 y = mul_64x64(g[0], cp);
+	uint64_t z = y.lo + x.hi;
+
+	/* The error in g contributes less than one to z, so an exact
+	   product shows up as z <= 1. */
+	return (y.hi + (z < y.lo)) | (z > 1);
+}
+
+static uint64_t shortest_decimal(uint64_t bits, int *exp10)
+{
+	uint64_t fraction = bits & (((uint64_t)1 << DOUBLE_MANTISSA_BITS) - 1);
+	int biased_exp = (bits >> DOUBLE_MANTISSA_BITS) & DOUBLE_INFINITE_POWER;
+	uint64_t c, cbl, cb, cbr, vbl, vb, vbr, lower, upper, s;
+	const uint64_t *g;
+	int q, k, h, closer_lower, even;
+
+	if (biased_exp) {
+		c = fraction | (uint64_t)1 << DOUBLE_MANTISSA_BITS;
+		q = biased_exp - DOUBLE_EXPONENT_BIAS - DOUBLE_MANTISSA_BITS;
+
+		/* Small integers */
+		if (q <= 0 && q > -DOUBLE_MANTISSA_BITS - 1
+		    && !(c & (((uint64_t)1 << -q) - 1))) {
+			*exp10 = 0;
+			return c >> -q;
+		}
 	}
 	else {
-		*eg->output++ = '-';
-		uvalue = -(uint64_t)ivalue;
+		c = fraction;
+		q = 1 - DOUBLE_EXPONENT_BIAS - DOUBLE_MANTISSA_BITS;
 	}
 
-	/* A 63-bit integer needs at most 19 digits */
-	if (!eu_stack_reserve_scratch(&eg->stack, 19))
-		goto error;
+	even = !(c & 1);
+	closer_lower = (!fraction && biased_exp > 1);
+
+	/* The value and the boundaries of its rounding interval,
+	   scaled by 4 * 2^q */
+	cbl = 4 * c - 2 + closer_lower;
+	cb = 4 * c;
+	cbr = 4 * c + 2;
+
+	/* k = floor(log10(2^q)), or floor(log10(3/4 * 2^q)) if the
+	   lower boundary is closer.  h = q + floor(log2(10^-k)) + 1 */
+	k = (q * 1262611 - (closer_lower ? 524031 : 0)) >> 22;
+	h = q + ((-k * 1741647) >> 19) + 1;
+
+	g = eu_powers_of_10[-k - EU_POWERS_OF_10_MIN];
+	vbl = round_to_odd(g, cbl << h);
+	vb = round_to_odd(g, cb << h);
+	vbr = round_to_odd(g, cbr << h);
+	lower = vbl + !even;
+	upper = vbr - !even;
+
+	/* Is there a single candidate with one digit fewer? */
+	s = vb / 4;
+	if (s >= 10) {
+		uint64_t sp = s / 10;
+		int up_inside = lower <= 40 * sp;
+		int wp_inside = 40 * sp + 40 <= upper;
+
+		if (up_inside != wp_inside) {
+			*exp10 = k + 1;
+			return sp + wp_inside;
+		}
+	}
+
+	{
+		int u_inside = lower <= 4 * s;
+		int w_inside = 4 * s + 4 <= upper;
+		uint64_t mid;
+
+		*exp10 = k;
+		if (u_inside != w_inside)
+			return s + w_inside;
+
+		/* Both are inside: pick the closer, or the even one */
+		mid = 4 * s + 2;
+		return s + (vb > mid || (vb == mid && (s & 1)));
+	}
+}
+
+/* The longest output is a sign, "0.", six leading zeros and 17
+   digits, e.g. -0.00000010000000000000001 for the double just above
+   1e-7.  The longest exponential output,
+   e.g. -1.2345678901234567e-308, is two characters shorter. */
+#define MAX_DOUBLE_CHARS 26
 
-	for (p = eu_stack_scratch(&eg->stack) + 19, len = 1;; len++) {
-		*--p = '0' + uvalue % 10;
-		uvalue /= 10;
+static char *format_double(char *p, double dvalue)
+{
+	uint64_t bits, digits;
+	int exp10, n, e;
+
+	memcpy(&bits, &dvalue, sizeof bits);
+	if (bits >> 63)
+		*p++ = '-';
+
+	digits = shortest_decimal(bits, &exp10);
+	for (; digits % 10 == 0; digits /= 10)
+		exp10++;
+
+	n = decimal_digits(digits);
+
+	/* The decimal exponent of the leading digit */
+	e = n + exp10 - 1;
+
+	/* Use fixed notation from 1e-7 to 1e21.  This is one decade
+	   further than javascript, which switches to exponential
+	   notation below 1e-6. */
+	if (e >= -7 && e < 21) {
+		if (e < 0) {
+			/* 0.000ddd */
+			memset(p, '0', 1 - e);
+			p[1] = '.';
+			p += 1 - e + n;
+			write_digits(p, digits);
+		}
+		else if (n <= e + 1) {
+			/* ddd000 */
+			write_digits(p + n, digits);
+			memset(p + n, '0', e + 1 - n);
+			p += e + 1;
+		}
+		else {
+			/* ddd.ddd */
+			write_digits(p + n + 1, digits);
+			memmove(p, p + 1, e + 1);
+			p[e + 1] = '.';
+			p += n + 1;
+		}
 
-		if (!uvalue)
-			break;
+		return p;
 	}
 
-	return output_scratch(eg, p, len);
+	/* d.ddde+xx */
+	write_digits(p + n + 1, digits);
+	p[0] = p[1];
+	if (n > 1) {
+		p[1] = '.';
+		p += n + 1;
+	}
+	else {
+		p++;
+	}
 
- error:
-	return EU_ERROR;
+	*p++ = 'e';
+	if (e < 0) {
+		*p++ = '-';
+		e = -e;
+	}
+	else {
+		*p++ = '+';
+	}
+
+	p += decimal_digits(e);
+	write_digits(p, e);
+	return p;
 }
 
-#define MAX_DOUBLE_CHARS 30
+static enum eu_result integer_generate(const struct eu_metadata *metadata,
+				       struct eu_generate *eg, void *value)
+{
+	int64_t ivalue = *(eu_integer_t *)value;
+	char *p;
+
+	(void)metadata;
+
+	if ((size_t)(eg->output_end - eg->output) >= MAX_INTEGER_CHARS) {
+		/* Format directly into the output buffer */
+		eg->output = format_integer(eg->output, ivalue);
+		return EU_OK;
+	}
+
+	/* Format into the scratch space */
+	if (!eu_stack_reserve_scratch(&eg->stack, MAX_INTEGER_CHARS))
+		return EU_ERROR;
+
+	p = eu_stack_scratch(&eg->stack);
+	return output_scratch(eg, p, format_integer(p, ivalue) - p);
+}
 
 static enum eu_result number_generate(const struct eu_metadata *metadata,
 				      struct eu_generate *eg, void *value)
 {
 	double dvalue = *(double *)value;
-	int64_t ivalue = (int64_t)dvalue;
-	int len;
-	size_t space;
+	int64_t ivalue;
+	char *p;
 
-	if ((double)ivalue == dvalue)
-		return integer_generate(metadata, eg, &ivalue);
+	/* Integral values within the range of int64_t are output as
+	   integers.  2^63 is exactly representable as a double. */
+	if (dvalue > -9223372036854775808.0 && dvalue < 9223372036854775808.0) {
+		ivalue = (int64_t)dvalue;
+		if ((double)ivalue == dvalue)
+			return integer_generate(metadata, eg, &ivalue);
+	}
 
 	if (!isfinite(dvalue))
-		goto error;
-
-	if (!eu_locale_c(&eg->locale))
-		goto error;
-
-	space = eg->output_end - eg->output;
-	if (space >= MAX_DOUBLE_CHARS) {
-		/* Print into the output buffer */
-		len = snprintf(eg->output, MAX_DOUBLE_CHARS, "%.16g", dvalue);
-		if (len < 0 || len >= MAX_DOUBLE_CHARS)
-			goto error;
+		return EU_ERROR;
 
-		eg->output += len;
+	if ((size_t)(eg->output_end - eg->output) >= MAX_DOUBLE_CHARS) {
+		/* Format directly into the output buffer */
+		eg->output = format_double(eg->output, dvalue);
 		return EU_OK;
 	}
-	else {
-		char *p;
 
-		/* Print into the scratch space */
-		if (!eu_stack_reserve_scratch(&eg->stack, MAX_DOUBLE_CHARS))
-			goto error;
-
-		p = eu_stack_scratch(&eg->stack);
-		len = snprintf(p, MAX_DOUBLE_CHARS, "%.16g", dvalue);
-		if (len < 0 || len >= MAX_DOUBLE_CHARS)
-			goto error;
-
-		return output_scratch(eg, p, len);
-	}
+	/* Format into the scratch space */
+	if (!eu_stack_reserve_scratch(&eg->stack, MAX_DOUBLE_CHARS))
+		return EU_ERROR;
 
- error:
-	return EU_ERROR;
+	p = eu_stack_scratch(&eg->stack);
+	return output_scratch(eg, p, format_double(p, dvalue) - p);
 }
 
 static enum eu_result number_gen_resume(struct eu_stack_frame *gframe,
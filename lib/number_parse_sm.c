@@ -86,6 +86,26 @@ RESUME_ONLY(case NUMBER_PARSE_LEADING_ZERO:)
 	   process 18 digits without checking for overflow. The resume
 	   case is excluded from this fast path - it's probably not
 	   worth it.  We have read one digit already, so 17 left. */
+#ifdef SWAR_DIGITS
+	/* Convert up to 16 digits, 8 at a time. */
+	if (end - p >= 8) {
+		uint64_t digits;
+		unsigned int n = swar_digits(p, &digits);
+
+		int_value = int_value * swar_powers_of_10[n] + digits;
+		p += n;
+		if (n < 8)
+			goto done_int_digits;
+
+		if (end - p >= 8) {
+			n = swar_digits(p, &digits);
+			int_value = int_value * swar_powers_of_10[n] + digits;
+			p += n;
+			if (n < 8)
+				goto done_int_digits;
+		}
+	}
+#else
 	if (end - p >= 17) {
 		int i;
 
@@ -96,6 +116,7 @@ RESUME_ONLY(case NUMBER_PARSE_LEADING_ZERO:)
 			int_value = int_value * 10 + (*p++ - '0');
 		}
 	}
+#endif
 
 RESUME_ONLY(case NUMBER_PARSE_INT_DIGITS:)
 	for (;;) {
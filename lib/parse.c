@@ -14,15 +14,20 @@ static enum eu_result initial_parse_resume(struct eu_stack_frame *frame,
 	struct eu_parse *ep = v_ep;
 	(void)frame;
 
+	if (ep->document_cb)
+		ep->input = skip_whitespace(ep->input, ep->input_end);
+
 	if (ep->input != ep->input_end)
 		return ep->metadata->parse(ep->metadata, ep, ep->result);
 	else
 		return EU_REINSTATE_PAUSED;
 }
 
-static void initial_parse_destroy(struct eu_stack_frame *gframe)
+static void initial_parse_destroy(struct eu_stack_frame *gframe,
+				  void *context)
 {
 	struct initial_parse_frame *frame = (struct initial_parse_frame *)gframe;
+	(void)context;
 
 	/* No parsing occured, so don't finalize the result. */
 	frame->ep->result = NULL;
@@ -30,7 +35,13 @@ static void initial_parse_destroy(struct eu_stack_frame *gframe)
 
 struct eu_parse *eu_parse_create(struct eu_value result)
 {
-	struct eu_parse *ep = malloc(sizeof *ep);
+	return eu_parse_create_with_allocator(result, &eu_default_allocator);
+}
+
+struct eu_parse *eu_parse_create_with_allocator(struct eu_value result,
+					const struct eu_allocator *allocator)
+{
+	struct eu_parse *ep = eu_allocator_alloc(allocator, sizeof *ep);
 	struct initial_parse_frame *frame;
 
 	if (!ep)
@@ -39,7 +50,7 @@ struct eu_parse *eu_parse_create(struct eu_value result)
 	/* Make the stack area just big enough for the
 	   initial_parse_resume frame. Having some slack doesn't seem
 	   to save much work. */
-	frame = eu_stack_init(&ep->stack, sizeof *frame);
+	frame = eu_stack_init(&ep->stack, sizeof *frame, allocator);
 	if (!frame)
 		goto free_ep;
 
@@ -49,29 +60,130 @@ struct eu_parse *eu_parse_create(struct eu_value result)
 
 	ep->metadata = result.metadata;
 	ep->result = result.value;
+	ep->options = 0;
 	ep->error = 0;
+	ep->heap.allocator = allocator;
+	ep->heap.arena = NULL;
+	ep->stats.member_predict_hits = 0;
+	ep->stats.member_predict_misses = 0;
+	ep->document_cb = NULL;
+	ep->document_data = NULL;
+	ep->names = NULL;
+	ep->seen = NULL;
+	ep->seen_len = ep->seen_capacity = 0;
 	eu_locale_init(&ep->locale);
 
 	memset(ep->result, 0, ep->metadata->size);
 	return ep;
 
  free_ep:
-	free(ep);
+	eu_allocator_free(allocator, ep);
  error:
 	return NULL;
 }
 
+void eu_parse_set_options(struct eu_parse *ep, unsigned int options)
+{
+	ep->options = options;
+}
+
+void eu_parse_set_arena(struct eu_parse *ep, struct eu_arena *arena)
+{
+	ep->heap.arena = arena;
+}
+
+void eu_parse_set_document_callback(struct eu_parse *ep,
+				    eu_parse_document_cb_t cb, void *data)
+{
+	ep->document_cb = cb;
+	ep->document_data = data;
+}
+
+void eu_parse_get_stats(struct eu_parse *ep, struct eu_parse_stats *stats)
+{
+	*stats = ep->stats;
+}
+
 void eu_parse_destroy(struct eu_parse *ep)
 {
-	eu_stack_fini(&ep->stack);
+	const struct eu_allocator *allocator = ep->heap.allocator;
 
-	/* Clean up the result, if it wasn't claimed via
-	   eu_parse_finish. */
-	if (ep->result)
-		ep->metadata->fini(ep->metadata, ep->result);
+	if (ep->heap.arena) {
+		/* Everything belonging to the result is in the arena,
+		   so there is nothing else to clean up. */
+		eu_stack_discard(&ep->stack);
+	}
+	else {
+		eu_stack_fini(&ep->stack, ep);
+
+		/* Clean up the result, if it wasn't claimed via
+		   eu_parse_finish. */
+		if (ep->result)
+			ep->metadata->fini(ep->metadata, ep->result,
+					   allocator);
+	}
 
+	eu_parse_release_names(ep);
+	if (ep->seen)
+		eu_allocator_free(allocator, ep->seen);
 	eu_locale_fini(&ep->locale);
-	free(ep);
+	eu_allocator_free(allocator, ep);
+}
+
+void eu_parse_reset(struct eu_parse *ep, struct eu_value result)
+{
+	struct initial_parse_frame *frame;
+
+	/* Clean up as eu_parse_destroy does, but keep the memory of
+	   the stack. */
+	frame = eu_stack_reset(&ep->stack, sizeof *frame,
+			       ep->heap.arena ? NULL : ep);
+	if (!ep->heap.arena && ep->result)
+		ep->metadata->fini(ep->metadata, ep->result,
+				   ep->heap.allocator);
+
+	frame->base.resume = initial_parse_resume;
+	frame->base.destroy = initial_parse_destroy;
+	frame->ep = ep;
+
+	ep->metadata = result.metadata;
+	ep->result = result.value;
+	ep->error = 0;
+	ep->seen_len = 0;
+	ep->stats.member_predict_hits = 0;
+	ep->stats.member_predict_misses = 0;
+
+	memset(ep->result, 0, ep->metadata->size);
+}
+
+/* Hand a completed document to the document callback, and set up
+   the stack to parse the next one. */
+static int next_document(struct eu_parse *ep)
+{
+	struct initial_parse_frame *frame;
+	int ok = ep->document_cb(eu_value(ep->result, ep->metadata),
+				 ep->document_data);
+
+	/* The stack is empty, so there are no frames to destroy */
+	frame = eu_stack_reset(&ep->stack, sizeof *frame, NULL);
+	frame->base.resume = initial_parse_resume;
+	frame->base.destroy = initial_parse_destroy;
+	frame->ep = ep;
+
+	memset(ep->result, 0, ep->metadata->size);
+	return ok;
+}
+
+/* In multi-document mode, whether the stack holds only the initial
+   frame for a document that has not begun. */
+static int between_documents(struct eu_parse *ep)
+{
+	struct eu_stack *st = &ep->stack;
+	struct eu_stack_frame *f = (struct eu_stack_frame *)st->bottom;
+
+	return !st->segment->prev && st->bottom != st->top
+		&& st->bottom + f->size == st->top
+		&& f->resume == initial_parse_resume;
 }
 
 int eu_parse(struct eu_parse *ep, const char *input, size_t len)
@@ -84,24 +196,35 @@ int eu_parse(struct eu_parse *ep, const char *input, size_t len)
 	ep->input = input;
 	ep->input_end = input + len;
 
-	res = eu_stack_run(&ep->stack, ep);
-	eu_locale_restore(&ep->locale);
-	switch (res) {
-	case EU_PAUSED:
-		return 1;
-
-	case EU_OK:
-		/* Done parsing.  Check for trailing input. */
-		ep->input = skip_whitespace(ep->input, ep->input_end);
-		if (ep->input == ep->input_end)
+	for (;;) {
+		res = eu_stack_run(&ep->stack, ep);
+		eu_locale_restore(&ep->locale);
+		switch (res) {
+		case EU_PAUSED:
 			return 1;
 
-		/* fall through */
-	default:
-		ep->error = 1;
-		return 0;
+		case EU_OK:
+			if (ep->document_cb) {
+				if (!next_document(ep))
+					goto error;
+
+				continue;
+			}
+
+			/* Done parsing.  Check for trailing input. */
+			ep->input = skip_whitespace(ep->input, ep->input_end);
+			if (ep->input == ep->input_end)
+				return 1;
+
+			/* fall through */
+		default:
+			goto error;
+		}
 	}
 
+ error:
+	ep->error = 1;
+	return 0;
 }
 
 int eu_parse_finish(struct eu_parse *ep)
@@ -109,6 +232,17 @@ int eu_parse_finish(struct eu_parse *ep)
 	if (ep->error)
 		return 0;
 
+	if (ep->document_cb) {
+		/* A number at the end of the stream needs to be
+		   terminated, as below. */
+		if (!between_documents(ep)
+		    && (!eu_parse(ep, " ", 1) || !between_documents(ep)))
+			return 0;
+
+		ep->result = NULL;
+		return 1;
+	}
+
 	if (unlikely(!eu_stack_empty(&ep->stack))) {
 		/* The clean way to handle this case would be to
 		   resume the stack frames, telling them that we are
@@ -127,6 +261,49 @@ int eu_parse_finish(struct eu_parse *ep)
 	return 1;
 }
 
+const char *eu_parse_value_result(struct eu_parse *ep, enum eu_result res)
+{
+	if (likely(res == EU_OK))
+		return ep->input;
+
+	/* If the value is incomplete, its frames stay on the stack,
+	   and the struct parse will push its own frame on top. */
+	ep->value_stop = res;
+	return NULL;
+}
+
+const char *eu_parse_value(struct eu_parse *ep, const char *p,
+			   const char *end, const struct eu_type_descriptor *d,
+			   void *result)
+{
+	const struct eu_metadata *md = eu_introduce(d);
+
+	if (p == end)
+		return NULL;
+
+	ep->input = p;
+	return eu_parse_value_result(ep, md->parse(md, ep, result));
+}
+
+void *eu_parse_alloc(struct eu_parse *ep, size_t size)
+{
+	void *res = eu_alloc(&ep->heap, size);
+
+	if (res)
+		memset(res, 0, size);
+
+	return res;
+}
+
+const char *eu_scan_member_name(const char *p, const char *end)
+{
+	p = eu_scan_string(p, end);
+	if (p != end && *p == '\"')
+		return p;
+
+	return NULL;
+}
+
 struct consume_ws_frame {
 	struct eu_stack_frame base;
 	const struct eu_metadata *metadata;
@@ -5,6 +5,7 @@
 struct eu_value eu_get_path(struct eu_value val, struct eu_string_ref path)
 {
 	const char *end, *p = path.chars;
+	struct eu_parse *ep = NULL;
 
 	if (path.len == 0)
 		/* An empty path means the whole document */
@@ -15,20 +16,26 @@ struct eu_value eu_get_path(struct eu_value val, struct eu_string_ref path)
 		return eu_value_none;
 
 	end = path.chars + path.len;
-	for (path.chars = ++p; p != end;) {
-		if (*p != '/') {
-			p++;
+	for (path.chars = ++p;; p++) {
+		if (p != end && *p != '/')
 			continue;
-		}
 
+		/* Lazy values along the path share one parse */
 		path.len = p - path.chars;
+		if (!eu_value_materialize(val, &ep)) {
+			val = eu_value_none;
+			break;
+		}
+
 		val = val.metadata->get(val, path);
-		if (!eu_value_ok(val))
-			return val;
+		if (p == end || !eu_value_ok(val))
+			break;
 
-		path.chars = ++p;
+		path.chars = p + 1;
 	}
 
-	path.len = p - path.chars;
-	return val.metadata->get(val, path);
+	if (ep)
+		eu_parse_destroy(ep);
+
+	return val;
 }
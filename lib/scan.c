@@ -0,0 +1,300 @@
+/* Scanning primitives for hot parsing loops.
+
+   These find the next "interesting" byte in a run of input many
+   bytes at a time.  There are three implementations: a portable SWAR
+   (SIMD-within-a-register) one that works on 64-bit words, an SSE2
+   one, and an AVX2 one.  Which of the latter two to use is decided
+   at runtime, on the first call. */
+
+#include <euphemus.h>
+#include "euphemus_int.h"
+
+#if !defined(EU_NO_SIMD) && defined(__GNUC__) && defined(__SSE2__) \
+	&& (defined(__i386__) || defined(__x86_64__))
+#define SCAN_SSE2
+#include <emmintrin.h>
+
+#if defined(__x86_64__) && (defined(__clang__) || __GNUC__ > 4 \
+			    || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define SCAN_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
+/* SWAR helpers.  Each byte of a word is treated as a lane.  These
+   give exact answers to "does any lane match?", but lanes above the
+   first match may be spuriously flagged, so they can't be used to
+   locate the match. */
+
+#define SWAR_ONES ((uint64_t)-1 / 0xff)
+#define SWAR_HIGHS (SWAR_ONES * 0x80)
+#define SWAR_REPEAT(c) (SWAR_ONES * (unsigned char)(c))
+
+static __inline__ uint64_t swar_load(const char *p)
+{
+	uint64_t x;
+	memcpy(&x, p, sizeof x);
+	return x;
+}
+
+/* Flags lanes with a value less than n, for n <= 128 */
+static __inline__ uint64_t swar_less(uint64_t x, unsigned char n)
+{
+	return (x - SWAR_REPEAT(n)) & ~x & SWAR_HIGHS;
+}
+
+static __inline__ uint64_t swar_eq(uint64_t x, char c)
+{
+	return swar_less(x ^ SWAR_REPEAT(c), 1);
+}
+
+/* Flags exactly the lanes that are non-zero */
+static __inline__ uint64_t swar_nonzero(uint64_t x)
+{
+	return (((x & ~SWAR_HIGHS) + ~SWAR_HIGHS) | x) & SWAR_HIGHS;
+}
+
+/* Strings: We look for the characters that end a run of plain string
+   characters: '"', '\\', and the control characters, which must be
+   escaped within JSON strings. */
+
+static __inline__ int string_special(unsigned char c)
+{
+	return c < 32 || c == '\"' || c == '\\';
+}
+
+static const char *scan_string_swar(const char *p, const char *end)
+{
+	while (end - p >= 8) {
+		uint64_t x = swar_load(p);
+		if (swar_eq(x, '\"') | swar_eq(x, '\\') | swar_less(x, 32))
+			break;
+
+		p += 8;
+	}
+
+	for (; p != end; p++)
+		if (string_special(*p))
+			break;
+
+	return p;
+}
+
+#ifdef SCAN_SSE2
+
+static const char *scan_string_sse2(const char *p, const char *end)
+{
+	const __m128i dquotes = _mm_set1_epi8('\"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+	const __m128i control_max = _mm_set1_epi8(31);
+
+	while (end - p >= 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)p);
+		__m128i special
+			= _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, dquotes),
+						    _mm_cmpeq_epi8(v, backslash)),
+				       _mm_cmpeq_epi8(_mm_min_epu8(v, control_max),
+						      v));
+		int mask = _mm_movemask_epi8(special);
+
+		if (mask)
+			return p + __builtin_ctz(mask);
+
+		p += 16;
+	}
+
+	return scan_string_swar(p, end);
+}
+
+#endif
+
+#ifdef SCAN_AVX2
+
+__attribute__ ((target ("avx2")))
+static const char *scan_string_avx2(const char *p, const char *end)
+{
+	const __m256i dquotes = _mm256_set1_epi8('\"');
+	const __m256i backslash = _mm256_set1_epi8('\\');
+	const __m256i control_max = _mm256_set1_epi8(31);
+
+	while (end - p >= 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)p);
+		__m256i special
+			= _mm256_or_si256(
+				_mm256_or_si256(_mm256_cmpeq_epi8(v, dquotes),
+						_mm256_cmpeq_epi8(v, backslash)),
+				_mm256_cmpeq_epi8(_mm256_min_epu8(v, control_max),
+						  v));
+		unsigned int mask = _mm256_movemask_epi8(special);
+
+		if (mask)
+			return p + __builtin_ctz(mask);
+
+		p += 32;
+	}
+
+	return scan_string_sse2(p, end);
+}
+
+#endif
+
+/* Whitespace: We look for the first character that is not one of the
+   four JSON whitespace characters. */
+
+static __inline__ int is_whitespace(char c)
+{
+	return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+static const char *scan_whitespace_swar(const char *p, const char *end)
+{
+	while (end - p >= 8) {
+		uint64_t x = swar_load(p);
+		if (swar_nonzero(x ^ SWAR_REPEAT(' '))
+		    & swar_nonzero(x ^ SWAR_REPEAT('\n'))
+		    & swar_nonzero(x ^ SWAR_REPEAT('\r'))
+		    & swar_nonzero(x ^ SWAR_REPEAT('\t')))
+			break;
+
+		p += 8;
+	}
+
+	for (; p != end; p++)
+		if (!is_whitespace(*p))
+			break;
+
+	return p;
+}
+
+#ifdef SCAN_SSE2
+
+static const char *scan_whitespace_sse2(const char *p, const char *end)
+{
+	const __m128i space = _mm_set1_epi8(' ');
+	const __m128i nl = _mm_set1_epi8('\n');
+	const __m128i cr = _mm_set1_epi8('\r');
+	const __m128i tab = _mm_set1_epi8('\t');
+
+	while (end - p >= 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)p);
+		__m128i ws
+			= _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, space),
+						    _mm_cmpeq_epi8(v, nl)),
+				       _mm_or_si128(_mm_cmpeq_epi8(v, cr),
+						    _mm_cmpeq_epi8(v, tab)));
+		int mask = _mm_movemask_epi8(ws) ^ 0xffff;
+
+		if (mask)
+			return p + __builtin_ctz(mask);
+
+		p += 16;
+	}
+
+	return scan_whitespace_swar(p, end);
+}
+
+#endif
+
+#ifdef SCAN_AVX2
+
+__attribute__ ((target ("avx2")))
+static const char *scan_whitespace_avx2(const char *p, const char *end)
+{
+	const __m256i space = _mm256_set1_epi8(' ');
+	const __m256i nl = _mm256_set1_epi8('\n');
+	const __m256i cr = _mm256_set1_epi8('\r');
+	const __m256i tab = _mm256_set1_epi8('\t');
+
+	while (end - p >= 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)p);
+		__m256i ws
+			= _mm256_or_si256(
+				_mm256_or_si256(_mm256_cmpeq_epi8(v, space),
+						_mm256_cmpeq_epi8(v, nl)),
+				_mm256_or_si256(_mm256_cmpeq_epi8(v, cr),
+						_mm256_cmpeq_epi8(v, tab)));
+		unsigned int mask = ~(unsigned int)_mm256_movemask_epi8(ws);
+
+		if (mask)
+			return p + __builtin_ctz(mask);
+
+		p += 32;
+	}
+
+	return scan_whitespace_sse2(p, end);
+}
+
+#endif
+
+/* Runtime dispatch.  The function pointers initially point to
+   resolver functions, which replace them with the best available
+   implementation.  Racing resolvers store the same value, so no
+   synchronization is needed. */
+
+enum scan_impl {
+	SCAN_IMPL_SWAR,
+	SCAN_IMPL_SSE2,
+	SCAN_IMPL_AVX2
+};
+
+static enum scan_impl scan_impl(void)
+{
+#ifdef SCAN_AVX2
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return SCAN_IMPL_AVX2;
+#endif
+#ifdef SCAN_SSE2
+	return SCAN_IMPL_SSE2;
+#else
+	return SCAN_IMPL_SWAR;
+#endif
+}
+
+static const char *scan_string_resolve(const char *p, const char *end)
+{
+	switch (scan_impl()) {
+#ifdef SCAN_AVX2
+	case SCAN_IMPL_AVX2:
+		eu_scan_string = scan_string_avx2;
+		break;
+#endif
+#ifdef SCAN_SSE2
+	case SCAN_IMPL_SSE2:
+		eu_scan_string = scan_string_sse2;
+		break;
+#endif
+	default:
+		eu_scan_string = scan_string_swar;
+		break;
+	}
+
+	return eu_scan_string(p, end);
+}
+
+const char *(*eu_scan_string)(const char *p, const char *end)
+	= scan_string_resolve;
+
+static const char *scan_whitespace_resolve(const char *p, const char *end)
+{
+	switch (scan_impl()) {
+#ifdef SCAN_AVX2
+	case SCAN_IMPL_AVX2:
+		eu_scan_whitespace = scan_whitespace_avx2;
+		break;
+#endif
+#ifdef SCAN_SSE2
+	case SCAN_IMPL_SSE2:
+		eu_scan_whitespace = scan_whitespace_sse2;
+		break;
+#endif
+	default:
+		eu_scan_whitespace = scan_whitespace_swar;
+		break;
+	}
+
+	return eu_scan_whitespace(p, end);
+}
+
+const char *(*eu_scan_whitespace)(const char *p, const char *end)
+	= scan_whitespace_resolve;
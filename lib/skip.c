@@ -0,0 +1,266 @@
+/* Skipping over containers without parsing them, for EU_PARSE_LAZY
+   and for the unknown members of closed structs.
+
+   The input is classified 64 bytes at a time, in the manner of
+   simdjson, finding the quotes, backslashes and brackets in each
+   block as bitmasks.  From those we work out which characters lie
+   within strings, and so which brackets count. */
+
+#include <euphemus.h>
+#include "euphemus_int.h"
+
+#if !defined(EU_NO_SIMD) && defined(__GNUC__) && defined(__SSE2__) \
+	&& (defined(__i386__) || defined(__x86_64__))
+#define SKIP_SSE2
+#include <emmintrin.h>
+
+#if defined(__x86_64__) && (defined(__clang__) || __GNUC__ > 4 \
+			    || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define SKIP_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
+#define BLOCK_SIZE 64
+
+/* Bitmasks of the interesting characters in a 64-byte block.  Bit i
+   corresponds to byte i. */
+struct block_masks {
+	uint64_t quote;
+	uint64_t backslash;
+	uint64_t bracket;
+};
+
+/* Setting bit 5 maps '[' to '{' and ']' to '}', and nothing else to
+   either of them, so brackets take two comparisons. */
+#define BRACKET_FOLD 0x20
+
+#ifdef SKIP_SSE2
+
+static __inline__ uint64_t block_mask(const __m128i v[4])
+{
+	return (uint64_t)(uint16_t)_mm_movemask_epi8(v[0])
+		| (uint64_t)(uint16_t)_mm_movemask_epi8(v[1]) << 16
+		| (uint64_t)(uint16_t)_mm_movemask_epi8(v[2]) << 32
+		| (uint64_t)(uint16_t)_mm_movemask_epi8(v[3]) << 48;
+}
+
+static void classify_block(const char *p, struct block_masks *m)
+{
+	__m128i quote[4], backslash[4], bracket[4];
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(p + 16 * i));
+		__m128i folded = _mm_or_si128(v, _mm_set1_epi8(BRACKET_FOLD));
+
+		quote[i] = _mm_cmpeq_epi8(v, _mm_set1_epi8('\"'));
+		backslash[i] = _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'));
+		bracket[i] = _mm_or_si128(
+			_mm_cmpeq_epi8(folded, _mm_set1_epi8('{')),
+			_mm_cmpeq_epi8(folded, _mm_set1_epi8('}')));
+	}
+
+	m->quote = block_mask(quote);
+	m->backslash = block_mask(backslash);
+	m->bracket = block_mask(bracket);
+}
+
+#endif
+
+#ifdef SKIP_AVX2
+
+__attribute__ ((target ("avx2")))
+static void classify_block_avx2(const char *p, struct block_masks *m)
+{
+	uint64_t masks[3][2];
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(p + 32 * i));
+		__m256i folded = _mm256_or_si256(v,
+					_mm256_set1_epi8(BRACKET_FOLD));
+
+		masks[0][i] = (uint32_t)_mm256_movemask_epi8(
+				_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\"')));
+		masks[1][i] = (uint32_t)_mm256_movemask_epi8(
+				_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')));
+		masks[2][i] = (uint32_t)_mm256_movemask_epi8(
+				_mm256_or_si256(
+				    _mm256_cmpeq_epi8(folded,
+						      _mm256_set1_epi8('{')),
+				    _mm256_cmpeq_epi8(folded,
+						      _mm256_set1_epi8('}'))));
+	}
+
+	m->quote = masks[0][0] | masks[0][1] << 32;
+	m->backslash = masks[1][0] | masks[1][1] << 32;
+	m->bracket = masks[2][0] | masks[2][1] << 32;
+}
+
+#endif
+
+#ifndef SKIP_SSE2
+
+enum {
+	CLASS_QUOTE = 1,
+	CLASS_BACKSLASH = 2,
+	CLASS_BRACKET = 4
+};
+
+static const unsigned char char_classes[256] = {
+	['\"'] = CLASS_QUOTE,
+	['\\'] = CLASS_BACKSLASH,
+	['{'] = CLASS_BRACKET,
+	['}'] = CLASS_BRACKET,
+	['['] = CLASS_BRACKET,
+	[']'] = CLASS_BRACKET,
+};
+
+static void classify_block(const char *p, struct block_masks *m)
+{
+	int i;
+
+	m->quote = m->backslash = m->bracket = 0;
+	for (i = 0; i < BLOCK_SIZE; i++) {
+		unsigned char c = char_classes[(unsigned char)p[i]];
+		uint64_t bit = (uint64_t)1 << i;
+
+		if (c) {
+			if (c & CLASS_QUOTE)
+				m->quote |= bit;
+			if (c & CLASS_BACKSLASH)
+				m->backslash |= bit;
+			if (c & CLASS_BRACKET)
+				m->bracket |= bit;
+		}
+	}
+}
+
+#endif
+
+static __inline__ int lowest_bit(uint64_t x)
+{
+#ifdef __GNUC__
+	return __builtin_ctzll(x);
+#else
+	int n = 0;
+
+	while (!(x & 1)) {
+		x >>= 1;
+		n++;
+	}
+
+	return n;
+#endif
+}
+
+/* Find the characters escaped by backslashes.  Backslashes are rare,
+   so we simply visit each of them.  *carry says whether the first
+   character of the block is escaped. */
+static __inline__ uint64_t escaped_chars(uint64_t backslash, uint64_t *carry)
+{
+	uint64_t escaped = *carry;
+
+	*carry = 0;
+	while (backslash) {
+		int i = lowest_bit(backslash);
+
+		backslash &= backslash - 1;
+		if (escaped >> i & 1)
+			/* An escaped backslash */
+			continue;
+
+		if (i == BLOCK_SIZE - 1)
+			*carry = 1;
+		else
+			escaped |= (uint64_t)2 << i;
+	}
+
+	return escaped;
+}
+
+/* Each bit becomes the XOR of itself and all the bits below it.  So
+   given the quotes, this yields the bits within strings (including
+   the opening quote, but not the closing quote). */
+static __inline__ uint64_t prefix_xor(uint64_t x)
+{
+	x ^= x << 1;
+	x ^= x << 2;
+	x ^= x << 4;
+	x ^= x << 8;
+	x ^= x << 16;
+	x ^= x << 32;
+	return x;
+}
+
+static void classify_resolve(const char *p, struct block_masks *m);
+
+/* The block classifier, chosen on first use as in scan.c */
+static void (*classify)(const char *p, struct block_masks *m)
+	= classify_resolve;
+
+static void classify_resolve(const char *p, struct block_masks *m)
+{
+	classify = classify_block;
+#ifdef SKIP_AVX2
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		classify = classify_block_avx2;
+#endif
+	classify(p, m);
+}
+
+/* Only the brackets outside strings matter here.  A string left
+   open hides the brackets after it, so the container never ends. */
+const char *eu_skip_container(const char *p, const char *end)
+{
+	uint64_t escape_carry = 0, in_string_carry = 0;
+	size_t depth = 0;
+	struct eu_skip_kinds kinds;
+	char last_block[BLOCK_SIZE];
+
+	for (; p < end; p += BLOCK_SIZE) {
+		const char *block = p;
+		struct block_masks m;
+		uint64_t quotes, in_string, brackets;
+
+		if (end - p < BLOCK_SIZE) {
+			/* Pad the final block with whitespace */
+			memset(last_block, ' ', BLOCK_SIZE);
+			memcpy(last_block, p, end - p);
+			block = last_block;
+		}
+
+		classify(block, &m);
+
+		quotes = m.quote & ~escaped_chars(m.backslash, &escape_carry);
+		in_string = prefix_xor(quotes) ^ in_string_carry;
+		in_string_carry = -(in_string >> 63);
+
+		for (brackets = m.bracket & ~in_string; brackets;
+		     brackets &= brackets - 1) {
+			int i = lowest_bit(brackets);
+
+			switch (block[i]) {
+			case '{':
+			case '[':
+				eu_skip_open(&kinds, depth++, block[i]);
+				break;
+
+			case '}':
+			case ']':
+				if (!eu_skip_close_ok(&kinds, --depth,
+						      block[i]))
+					return NULL;
+
+				if (depth == 0)
+					return p + i + 1;
+
+				break;
+			}
+		}
+	}
+
+	return NULL;
+}
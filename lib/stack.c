@@ -9,76 +9,222 @@ STATIC_ASSERT((sizeof(void *) & (sizeof(void *) - 1)) == 0);
  * sufficient to suitably align all stack frames. */
 #define ROUND_UP(n) ((((n) - 1) & -sizeof(void *)) + sizeof(void *))
 
-void *eu_stack_init(struct eu_stack *st, size_t alloc_size)
+/* The frames pushed during a pause are resumed in the order in which
+   they were pushed (innermost first), and before any frames left from
+   earlier pauses.  So each pause starts a new segment of the stack,
+   above the earlier segments in memory.  The frames of the current
+   segment are run from the bottom up, and the segment is popped once
+   they have all been run.  What remains of a partly run segment stays
+   in place beneath the new one, so frames don't get moved around on
+   each pause.
+
+   Segments are allocated from a chain of chunks, so growing the stack
+   doesn't move existing frames either.  Only a segment that is still
+   being pushed gets moved, if it outgrows its chunk.
+
+   A frame's memory may be reused as soon as its resume function is
+   called (unless it returns EU_REINSTATE_PAUSED), so resume functions
+   take what they need from the frame before doing anything else. */
+
+/* The header of a chunk, followed by its data */
+struct eu_stack_chunk {
+	struct eu_stack_chunk *prev;
+	size_t size;
+};
+
+#define CHUNK_HEADER_SIZE ROUND_UP(sizeof(struct eu_stack_chunk))
+#define SEGMENT_HEADER_SIZE ROUND_UP(sizeof(struct eu_stack_segment))
+
+static __inline__ char *chunk_data(struct eu_stack_chunk *chunk)
 {
-	void *stack = malloc(alloc_size);
+	return (char *)chunk + CHUNK_HEADER_SIZE;
+}
 
-	if (stack) {
-		st->stack = stack;
-		st->stack_area_size = alloc_size;
-		st->scratch_size = st->new_stack_top = st->new_stack_bottom
-			= st->old_stack_bottom = 0;
+static __inline__ char *segment_frames(struct eu_stack_segment *seg)
+{
+	return (char *)seg + SEGMENT_HEADER_SIZE;
+}
 
-		((struct eu_stack_frame *)stack)->size = alloc_size;
+/* Make a new chunk of at least min_size bytes the current chunk.
+   Chunks double in size, so there are not many of them. */
+static int push_chunk(struct eu_stack *st, size_t min_size)
+{
+	struct eu_stack_chunk *chunk = st->spare;
+	size_t size = st->chunk ? st->chunk->size * 2 : 0;
+
+	if (size < min_size)
+		size = min_size;
+
+	if (chunk && chunk->size >= size) {
+		st->spare = NULL;
+	}
+	else {
+		chunk = eu_allocator_alloc(st->allocator,
+					   CHUNK_HEADER_SIZE + size);
+		if (!chunk)
+			return 0;
 
-		return stack;
+		chunk->size = size;
 	}
 
-	return NULL;
+	chunk->prev = st->chunk;
+	st->chunk = chunk;
+	st->chunk_end = chunk_data(chunk) + chunk->size;
+	return 1;
 }
 
-void eu_stack_begin_pause(struct eu_stack *st)
+/* Release an empty chunk.  We hang on to the biggest one, so that a
+   stack that keeps crossing a chunk boundary doesn't keep
+   allocating. */
+static void release_chunk(struct eu_stack *st, struct eu_stack_chunk *chunk)
+{
+	if (st->spare && st->spare->size >= chunk->size) {
+		eu_allocator_free(st->allocator, chunk);
+		return;
+	}
+
+	if (st->spare)
+		eu_allocator_free(st->allocator, st->spare);
+
+	st->spare = chunk;
+}
+
+static void pop_chunk(struct eu_stack *st)
+{
+	struct eu_stack_chunk *chunk = st->chunk;
+
+	st->chunk = chunk->prev;
+	st->chunk_end = chunk_data(st->chunk) + st->chunk->size;
+	release_chunk(st, chunk);
+}
+
+static void pop_segment(struct eu_stack *st)
+{
+	struct eu_stack_segment *seg = st->segment;
+
+	st->segment = seg->prev;
+	st->bottom = seg->prev_bottom;
+	st->top = seg->prev_top;
+
+	if ((char *)seg == chunk_data(st->chunk))
+		pop_chunk(st);
+}
+
+static int start_segment(struct eu_stack *st)
+{
+	struct eu_stack_segment *seg = (struct eu_stack_segment *)st->top;
+
+	if (unlikely((size_t)(st->chunk_end - st->top) < SEGMENT_HEADER_SIZE)) {
+		if (!push_chunk(st, SEGMENT_HEADER_SIZE))
+			return 0;
+
+		seg = (struct eu_stack_segment *)chunk_data(st->chunk);
+	}
+
+	seg->prev = st->segment;
+	seg->prev_bottom = st->bottom;
+	seg->prev_top = st->top;
+
+	st->segment = seg;
+	st->bottom = st->top = segment_frames(seg);
+	st->segment_pending = 0;
+	return 1;
+}
+
+/* Move the current segment, which is being pushed, to a new chunk
+   with room for another size bytes. */
+static int grow(struct eu_stack *st, size_t size)
 {
-	if (st->new_stack_top != st->new_stack_bottom) {
-		/* There is a new stack from a previous pause.
-		   Consolidate it with the old stack. */
-		size_t new_stack_size
-			= st->new_stack_top - st->new_stack_bottom;
-		st->old_stack_bottom -= new_stack_size;
-		memmove(st->stack + st->old_stack_bottom,
-			st->stack + st->new_stack_bottom,
-			new_stack_size);
+	struct eu_stack_segment *seg = st->segment;
+	struct eu_stack_chunk *old_chunk = st->chunk;
+	size_t used = st->top - (char *)seg;
+	size_t bottom = st->bottom - (char *)seg;
+
+	if (!push_chunk(st, used + size))
+		return 0;
+
+	memcpy(chunk_data(st->chunk), seg, used);
+	st->segment = (struct eu_stack_segment *)chunk_data(st->chunk);
+	st->bottom = (char *)st->segment + bottom;
+	st->top = (char *)st->segment + used;
+
+	if ((char *)seg == chunk_data(old_chunk)) {
+		/* The segment was all that the old chunk held */
+		st->chunk->prev = old_chunk->prev;
+		release_chunk(st, old_chunk);
 	}
 
-	st->new_stack_bottom = st->new_stack_top = ROUND_UP(st->scratch_size);
+	return 1;
+}
+
+/* Put the first segment, holding just the initial frame, at the
+   start of the current chunk. */
+static void *place_initial_frame(struct eu_stack *st, size_t alloc_size)
+{
+	struct eu_stack_frame *f;
+
+	st->segment = (struct eu_stack_segment *)chunk_data(st->chunk);
+	st->segment->prev = NULL;
+	st->segment_pending = 0;
+
+	f = (struct eu_stack_frame *)segment_frames(st->segment);
+	f->size = alloc_size;
+	st->bottom = (char *)f;
+	st->top = st->bottom + alloc_size;
+	return f;
+}
+
+void *eu_stack_init(struct eu_stack *st, size_t alloc_size,
+		    const struct eu_allocator *allocator)
+{
+	alloc_size = ROUND_UP(alloc_size);
+
+	st->allocator = allocator;
+	st->scratch = NULL;
+	st->scratch_size = st->scratch_capacity = 0;
+	st->chunk = st->spare = NULL;
+
+	/* Make the first chunk just big enough for the initial frame */
+	if (!push_chunk(st, SEGMENT_HEADER_SIZE + alloc_size))
+		return NULL;
+
+	return place_initial_frame(st, alloc_size);
+}
+
+void eu_stack_begin_pause(struct eu_stack *st)
+{
+	/* Pop the segments that have been run.  The frame currently
+	   being resumed might be in one of them, but it is no longer
+	   needed. */
+	while (st->bottom == st->top && st->segment->prev)
+		pop_segment(st);
+
+	if (st->bottom == st->top) {
+		/* The stack is empty, so reuse the first segment */
+		st->bottom = st->top = segment_frames(st->segment);
+		st->segment_pending = 0;
+	}
+	else {
+		st->segment_pending = 1;
+	}
 }
 
 void *eu_stack_alloc(struct eu_stack *st, size_t size)
 {
-	size_t new_stack_top;
 	struct eu_stack_frame *f;
 
 	size = ROUND_UP(size);
-	new_stack_top = st->new_stack_top + size;
-
-	/* Do we have space for the new stack frame */
-	if (unlikely(new_stack_top > st->old_stack_bottom)) {
-		/* Need to expand the stack area, creating a bigger
-		   gap between the new and old stack regions. */
-		size_t old_stack_size
-			= st->stack_area_size - st->old_stack_bottom;
-		char *stack;
-
-		do {
-			st->stack_area_size *= 2;
-		} while (st->stack_area_size < new_stack_top + old_stack_size);
-
-		stack = malloc(st->stack_area_size);
-		if (stack == NULL)
-			return NULL;
-
-		memcpy(stack, st->stack, st->new_stack_top);
-		memcpy(stack + st->stack_area_size - old_stack_size,
-		       st->stack + st->old_stack_bottom, old_stack_size);
-		free(st->stack);
-
-		st->stack = stack;
-		st->old_stack_bottom = st->stack_area_size - old_stack_size;
-	}
 
-	f = (struct eu_stack_frame *)(st->stack + st->new_stack_top);
+	if (unlikely(st->segment_pending) && !start_segment(st))
+		return NULL;
+
+	if (unlikely((size_t)(st->chunk_end - st->top) < size)
+	    && !grow(st, size))
+		return NULL;
+
+	f = (struct eu_stack_frame *)st->top;
 	f->size = size;
-	st->new_stack_top = new_stack_top;
+	st->top += size;
 	return f;
 }
 
@@ -86,38 +232,23 @@ enum eu_result eu_stack_run(struct eu_stack *st, void *context)
 {
 	struct eu_stack_frame *f;
 
-	/* Process frames from the new stack */
-	while (st->new_stack_bottom != st->new_stack_top) {
-		f = (struct eu_stack_frame *)(st->stack + st->new_stack_bottom);
-		st->new_stack_bottom += f->size;
-
-		switch (f->resume(f, context)) {
-		case EU_OK:
-			break;
-
-		case EU_REINSTATE_PAUSED:
-			st->new_stack_bottom -= f->size;
-			/* fall through */
-
-		case EU_PAUSED:
-			return EU_PAUSED;
+	for (;;) {
+		while (st->bottom == st->top) {
+			if (!st->segment->prev)
+				return EU_OK;
 
-		case EU_ERROR:
-			return EU_ERROR;
+			pop_segment(st);
 		}
-	}
 
-	/* Process frames from the old stack */
-	while (st->old_stack_bottom != st->stack_area_size) {
-		f = (struct eu_stack_frame *)(st->stack + st->old_stack_bottom);
-		st->old_stack_bottom += f->size;
+		f = (struct eu_stack_frame *)st->bottom;
+		st->bottom += f->size;
 
 		switch (f->resume(f, context)) {
 		case EU_OK:
 			break;
 
 		case EU_REINSTATE_PAUSED:
-			st->old_stack_bottom -= f->size;
+			st->bottom -= f->size;
 			/* fall through */
 
 		case EU_PAUSED:
@@ -127,61 +258,32 @@ enum eu_result eu_stack_run(struct eu_stack *st, void *context)
 			return EU_ERROR;
 		}
 	}
-
-	return EU_OK;
 }
 
 int eu_stack_reserve_scratch(struct eu_stack *st, size_t s)
 {
-	size_t new_stack_size, old_stack_size, min_size;
-	char *stack;
-
-	if (st->new_stack_bottom != st->new_stack_top) {
-		/* There is a new stack region */
-		if (s <= st->new_stack_bottom)
-			return 1;
-
-		/* Can we make space by consolidating the new stack
-		   with the old_stack? */
-		new_stack_size = st->new_stack_top - st->new_stack_bottom;
-		if (s <= st->old_stack_bottom - new_stack_size) {
-			eu_stack_begin_pause(st);
-			return 1;
-		}
-	}
-	else {
-		if (s <= st->old_stack_bottom)
-			return 1;
-
-		new_stack_size = 0;
-	}
+	size_t capacity = st->scratch_capacity;
+	char *scratch;
 
-	/* Need to grow the stack area */
-	old_stack_size = st->stack_area_size - st->old_stack_bottom;
-	min_size = ROUND_UP(s) + new_stack_size + old_stack_size;
+	/* Even an empty scratch area should be a valid pointer */
+	if (s <= capacity && st->scratch)
+		return 1;
 
-	do {
-		st->stack_area_size *= 2;
-	} while (st->stack_area_size < min_size);
+	do
+		capacity = capacity ? capacity * 2 : 64;
+	while (capacity < s);
 
-	stack = malloc(st->stack_area_size);
-	if (stack == NULL)
+	scratch = eu_allocator_alloc(st->allocator, capacity);
+	if (scratch == NULL)
 		return 0;
 
-	memcpy(stack, st->stack, st->scratch_size);
-
-	memcpy(stack + st->stack_area_size - old_stack_size,
-	       st->stack + st->old_stack_bottom,
-	       old_stack_size);
-	st->old_stack_bottom = st->stack_area_size - old_stack_size;
-
-	memcpy(stack + st->old_stack_bottom - new_stack_size,
-	       st->stack + st->new_stack_bottom, new_stack_size);
-	st->new_stack_top = st->old_stack_bottom;
-	st->new_stack_bottom = st->new_stack_top - new_stack_size;
+	if (st->scratch) {
+		memcpy(scratch, st->scratch, st->scratch_size);
+		eu_allocator_free(st->allocator, st->scratch);
+	}
 
-	free(st->stack);
-	st->stack = stack;
+	st->scratch = scratch;
+	st->scratch_capacity = capacity;
 	return 1;
 }
 
@@ -190,7 +292,7 @@ int eu_stack_set_scratch(struct eu_stack *st, const char *start, const char *end
 	size_t len = end - start;
 
 	if (eu_stack_reserve_scratch(st, len)) {
-		memcpy(st->stack, start, len);
+		memcpy(st->scratch, start, len);
 		st->scratch_size = len;
 		return 1;
 	}
@@ -205,7 +307,7 @@ int eu_stack_append_scratch(struct eu_stack *st, const char *start,
 	size_t len = end - start;
 
 	if (eu_stack_reserve_scratch(st, st->scratch_size + len)) {
-		memcpy(st->stack + st->scratch_size, start, len);
+		memcpy(st->scratch + st->scratch_size, start, len);
 		st->scratch_size += len;
 		return 1;
 	}
@@ -220,9 +322,9 @@ int eu_stack_append_scratch_with_nul(struct eu_stack *st, const char *start,
 	size_t len = end - start;
 
 	if (eu_stack_reserve_scratch(st, st->scratch_size + len + 1)) {
-		memcpy(st->stack + st->scratch_size, start, len);
+		memcpy(st->scratch + st->scratch_size, start, len);
 		st->scratch_size += len;
-		st->stack[st->scratch_size++] = 0;
+		st->scratch[st->scratch_size++] = 0;
 		return 1;
 	}
 	else {
@@ -230,28 +332,98 @@ int eu_stack_append_scratch_with_nul(struct eu_stack *st, const char *start,
 	}
 }
 
-void eu_stack_fini(struct eu_stack *st)
+static void free_chunks(struct eu_stack *st)
+{
+	struct eu_stack_chunk *chunk, *prev;
+
+	for (chunk = st->chunk; chunk; chunk = prev) {
+		prev = chunk->prev;
+		eu_allocator_free(st->allocator, chunk);
+	}
+
+	if (st->spare)
+		eu_allocator_free(st->allocator, st->spare);
+
+	if (st->scratch)
+		eu_allocator_free(st->allocator, st->scratch);
+}
+
+static void destroy_frames(char *bottom, char *top, void *context)
 {
 	struct eu_stack_frame *f;
 
+	while (bottom != top) {
+		f = (struct eu_stack_frame *)bottom;
+		bottom += f->size;
+		f->destroy(f, context);
+	}
+}
+
+static void destroy_all_frames(struct eu_stack *st, void *context)
+{
+	struct eu_stack_segment *seg = st->segment;
+
+	destroy_frames(st->bottom, st->top, context);
+	for (; seg->prev; seg = seg->prev)
+		destroy_frames(seg->prev_bottom, seg->prev_top, context);
+}
+
+void eu_stack_fini(struct eu_stack *st, void *context)
+{
 	/* If the parse was unfinished, there might be stack frames to
 	   clean up. */
-	while (st->new_stack_bottom != st->new_stack_top) {
-		f = (struct eu_stack_frame *)(st->stack + st->new_stack_bottom);
-		st->new_stack_bottom += f->size;
-		f->destroy(f);
-	}
+	destroy_all_frames(st, context);
+	free_chunks(st);
+}
+
+/* Return the stack to the state left by eu_stack_init, with a new
+   initial frame of the same alloc_size.  Remaining frames are
+   destroyed if context is non-NULL (and simply dropped otherwise, as
+   with eu_stack_discard).  Only the biggest chunk is kept, and it
+   becomes the first chunk, so a reset stack that is used for similar
+   work again doesn't need to allocate.  The scratch buffer is kept
+   too. */
+void *eu_stack_reset(struct eu_stack *st, size_t alloc_size, void *context)
+{
+	struct eu_stack_chunk *chunk, *prev, *keep = st->spare;
+
+	if (context)
+		destroy_all_frames(st, context);
 
-	while (st->old_stack_bottom != st->stack_area_size) {
-		f = (struct eu_stack_frame *)(st->stack + st->old_stack_bottom);
-		st->old_stack_bottom += f->size;
-		f->destroy(f);
+	for (chunk = st->chunk; chunk; chunk = chunk->prev)
+		if (!keep || chunk->size > keep->size)
+			keep = chunk;
+
+	for (chunk = st->chunk; chunk; chunk = prev) {
+		prev = chunk->prev;
+		if (chunk != keep)
+			eu_allocator_free(st->allocator, chunk);
 	}
 
-	free(st->stack);
+	if (st->spare && st->spare != keep)
+		eu_allocator_free(st->allocator, st->spare);
+
+	/* Every chunk is at least as big as the first one, so the
+	   initial frame fits. */
+	keep->prev = NULL;
+	st->chunk = keep;
+	st->chunk_end = chunk_data(keep) + keep->size;
+	st->spare = NULL;
+	st->scratch_size = 0;
+
+	return place_initial_frame(st, ROUND_UP(alloc_size));
+}
+
+/* Release the stack without destroying any remaining frames.  This is
+   for when the frames only refer to memory that gets released by
+   other means. */
+void eu_stack_discard(struct eu_stack *st)
+{
+	free_chunks(st);
 }
 
-void eu_stack_frame_noop_destroy(struct eu_stack_frame *cont)
+void eu_stack_frame_noop_destroy(struct eu_stack_frame *cont, void *context)
 {
 	(void)cont;
+	(void)context;
 }
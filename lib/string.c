@@ -3,11 +3,11 @@
 #include "euphemus_int.h"
 #include "unescape.h"
 
-static eu_bool_t assign_trimming(struct eu_string *result, char *buf,
-				 size_t len, size_t capacity)
+static eu_bool_t assign_trimming(struct eu_parse *ep, struct eu_string *result,
+				 char *buf, size_t len, size_t capacity)
 {
 	if (capacity - len > capacity / 4) {
-		buf = realloc(buf, len);
+		buf = eu_realloc(&ep->heap, buf, capacity, len);
 		if (unlikely(!buf))
 			return 0;
 	}
@@ -28,7 +28,8 @@ struct string_parse_frame {
 
 static enum eu_result string_parse_resume(struct eu_stack_frame *gframe,
 					  void *v_ep);
-static void string_parse_frame_destroy(struct eu_stack_frame *gframe);
+static void string_parse_frame_destroy(struct eu_stack_frame *gframe,
+				       void *v_ep);
 
 static struct string_parse_frame *alloc_frame(struct eu_parse *ep, const char *p,
 					    struct eu_string *result)
@@ -43,7 +44,7 @@ static struct string_parse_frame *alloc_frame(struct eu_parse *ep, const char *p
 		frame->len = p - ep->input;
 		frame->capacity = frame->len * 2;
 		frame->unescape = 0;
-		frame->buf = malloc(frame->capacity);
+		frame->buf = eu_alloc(&ep->heap, frame->capacity);
 		if (frame->buf)
 			return frame;
 	}
@@ -65,15 +66,14 @@ static enum eu_result string_parse_common(const struct eu_metadata *metadata,
 
 	ep->input = ++p;
 
-	for (;; p++) {
-		if (p == end)
-			goto pause;
+	p = eu_scan_string(p, end);
+	if (p == end)
+		goto pause;
 
-		switch (*p) {
-		case '\"': goto done;
-		case '\\': goto unescape;
-		default: break;
-		}
+	switch (*p) {
+	case '\"': goto done;
+	case '\\': goto unescape;
+	default: goto error;
 	}
 
  done:
@@ -81,7 +81,15 @@ static enum eu_result string_parse_common(const struct eu_metadata *metadata,
 	if (!len)
 		goto empty;
 
-	buf = malloc(len);
+	if (ep->options & EU_PARSE_BORROW_STRINGS) {
+		result->chars = (char *)ep->input;
+		result->len = len;
+		result->priv.borrowed = 1;
+		ep->input = p + 1;
+		return EU_OK;
+	}
+
+	buf = eu_alloc(&ep->heap, len);
 	if (!buf)
 		goto alloc_error;
 
@@ -109,15 +117,15 @@ static enum eu_result string_parse_common(const struct eu_metadata *metadata,
 	return EU_PAUSED;
 
  unescape:
-	/* Skip the backslash, and scan forward to find the end of the
-	   string */
-	do {
-		if (++p == end)
-			goto pause_unescape;
-	} while (*p != '\"' || quotes_escaped(p));
+	/* Scan forward to find the end of the string */
+	if (!scan_escaped_string(&p, end))
+		goto error;
+
+	if (p == end)
+		goto pause_unescape;
 
 	len = p - ep->input;
-	buf = malloc(len);
+	buf = eu_alloc(&ep->heap, len);
 	if (!buf)
 		goto alloc_error;
 
@@ -128,7 +136,7 @@ static enum eu_result string_parse_common(const struct eu_metadata *metadata,
 			goto error_free_buf;
 	}
 
-	if (unlikely(!assign_trimming(result, buf, end - buf, len)))
+	if (unlikely(!assign_trimming(ep, result, buf, end - buf, len)))
 		goto error_free_buf;
 
 	/* skip the final '"' */
@@ -152,7 +160,7 @@ static enum eu_result string_parse_common(const struct eu_metadata *metadata,
 	return EU_ERROR;
 
  error_free_buf:
-	free(buf);
+	eu_free(&ep->heap, buf);
  error:
 	return EU_ERROR;
 }
@@ -181,15 +189,14 @@ static enum eu_result string_parse_resume(struct eu_stack_frame *gframe,
 	p = ep->input;
 	end = ep->input_end;
 
-	for (;; p++) {
-		if (p == end)
-			goto pause;
+	p = eu_scan_string(p, end);
+	if (p == end)
+		goto pause;
 
-		switch (*p) {
-		case '\"': goto done;
-		case '\\': goto unescape;
-		default: break;
-		}
+	switch (*p) {
+	case '\"': goto done;
+	case '\\': goto unescape;
+	default: goto error;
 	}
 
  done:
@@ -200,7 +207,7 @@ static enum eu_result string_parse_resume(struct eu_stack_frame *gframe,
 		goto empty;
 
 	if (total_len > frame->capacity) {
-		buf = realloc(buf, total_len);
+		buf = eu_realloc(&ep->heap, buf, frame->capacity, total_len);
 		if (!buf)
 			goto alloc_error;
 
@@ -215,7 +222,7 @@ static enum eu_result string_parse_resume(struct eu_stack_frame *gframe,
 
 	memcpy(buf + frame->len, ep->input, len);
 
-	if (unlikely(!assign_trimming(frame->result, buf, total_len,
+	if (unlikely(!assign_trimming(ep, frame->result, buf, total_len,
 				      frame->capacity)))
 		goto alloc_error;
 
@@ -224,7 +231,7 @@ static enum eu_result string_parse_resume(struct eu_stack_frame *gframe,
 	return EU_OK;
 
  empty:
-	free(buf);
+	eu_free(&ep->heap, buf);
 	frame->result->chars = EU_ZERO_LENGTH_PTR;
 	ep->input = p + 1;
 	return EU_OK;
@@ -236,7 +243,8 @@ static enum eu_result string_parse_resume(struct eu_stack_frame *gframe,
 	buf = frame->buf;
 	if (total_len > frame->capacity) {
 		size_t new_capacity = total_len * 2;
-		buf = realloc(buf, new_capacity);
+		buf = eu_realloc(&ep->heap, buf, frame->capacity,
+				 new_capacity);
 		if (!buf)
 			goto alloc_error;
 
@@ -255,24 +263,24 @@ static enum eu_result string_parse_resume(struct eu_stack_frame *gframe,
 	return EU_REINSTATE_PAUSED;
 
  unescape:
-	/* Skip the backslash, and scan forward to find the end of the
-	   string */
-	do {
-		if (++p == end)
-			goto pause_unescape;
-	} while (*p != '\"' || quotes_escaped_bounded(p, ep->input));
+	/* Scan forward to find the end of the string */
+	if (!scan_escaped_string(&p, end))
+		goto error;
+
+	if (p == end)
+		goto pause_unescape;
 
 	len = p - ep->input;
 	total_len = frame->len + len + unescaped_char_len;
 
 	buf = frame->buf;
 	if (total_len > frame->capacity) {
-		frame->capacity = total_len;
-		buf = realloc(buf, total_len);
+		buf = eu_realloc(&ep->heap, buf, frame->capacity, total_len);
 		if (!buf)
 			goto alloc_error;
 
 		frame->buf = buf;
+		frame->capacity = total_len;
 	}
 
 	if (unlikely(unescaped_char_len)) {
@@ -287,7 +295,7 @@ static enum eu_result string_parse_resume(struct eu_stack_frame *gframe,
 			goto error;
 	}
 
-	if (unlikely(!assign_trimming(frame->result, buf, end - buf,
+	if (unlikely(!assign_trimming(ep, frame->result, buf, end - buf,
 				      frame->capacity)))
 		goto alloc_error;
 
@@ -301,7 +309,8 @@ static enum eu_result string_parse_resume(struct eu_stack_frame *gframe,
 	buf = frame->buf;
 	if (total_len > frame->capacity) {
 		size_t new_capacity = total_len * 2;
-		buf = realloc(buf, new_capacity);
+		buf = eu_realloc(&ep->heap, buf, frame->capacity,
+				 new_capacity);
 		if (!buf)
 			goto alloc_error;
 
@@ -315,20 +324,25 @@ static enum eu_result string_parse_resume(struct eu_stack_frame *gframe,
 	}
 
 	end = eu_unescape(ep, p, buf + frame->len, &frame->unescape);
+	if (!end)
+		goto error;
+
 	frame->len = end - buf;
 	ep->input = p;
 	return EU_REINSTATE_PAUSED;
 
  alloc_error:
  error:
-	free(frame->buf);
+	eu_free(&ep->heap, frame->buf);
 	return EU_ERROR;
 }
 
-static void string_parse_frame_destroy(struct eu_stack_frame *gframe)
+static void string_parse_frame_destroy(struct eu_stack_frame *gframe,
+				       void *v_ep)
 {
 	struct string_parse_frame *frame = (struct string_parse_frame *)gframe;
-	free(frame->buf);
+	struct eu_parse *ep = v_ep;
+	eu_free(&ep->heap, frame->buf);
 }
 
 enum eu_result eu_variant_string(const void *string_metadata,
@@ -350,6 +364,17 @@ static enum eu_result string_parse(const struct eu_metadata *metadata,
 		return res;
 }
 
+const char *eu_parse_string_value(struct eu_parse *ep, const char *p,
+				  const char *end, struct eu_string *result)
+{
+	if (p == end)
+		return NULL;
+
+	ep->input = p;
+	return eu_parse_value_result(ep, string_parse(&eu_string_metadata, ep,
+						      result));
+}
+
 static enum eu_result string_generate(const struct eu_metadata *metadata,
 				      struct eu_generate *eg, void *value)
 {
@@ -361,12 +386,14 @@ static enum eu_result string_generate(const struct eu_metadata *metadata,
 	return eu_escape(eg, eu_string_to_ref(str));
 }
 
-static void string_fini(const struct eu_metadata *metadata, void *value)
+static void string_fini(const struct eu_metadata *metadata, void *value,
+			const struct eu_allocator *allocator)
 {
 	struct eu_string *str = value;
 	(void)metadata;
 
-	eu_string_fini(str);
+	if (str->len && !str->priv.borrowed)
+		eu_allocator_free(allocator, str->chars);
 
 	/* To avoid fini functions being called multiple times. */
 	str->chars = NULL;
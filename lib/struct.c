@@ -11,6 +11,15 @@ struct eu_struct_member {
 	const struct eu_metadata *metadata;
 };
 
+static __inline__ int struct_member_present(const struct eu_struct_member *m,
+					    const unsigned char *p)
+{
+	if (m->presence_offset >= 0)
+		return !!(p[m->presence_offset] & m->presence_bit);
+	else
+		return !!*(void **)(p + m->offset);
+}
+
 struct eu_struct_metadata {
 	struct eu_metadata base;
 	unsigned int struct_size;
@@ -20,8 +29,164 @@ struct eu_struct_metadata {
 	size_t n_members;
 	const struct eu_struct_member *members;
 	const struct eu_metadata *extra_value_metadata;
+
+	/* The member name recognizer from a V2 descriptor, or NULL */
+	int (*recognize_member)(const char *name, size_t len);
+
+	/* Otherwise, for structs with more than LINEAR_LOOKUP_MAX
+	   members, an open-addressing hash table of member indices plus one (zero
+	   marks an empty slot).  The size is member_index_mask + 1. */
+	const unsigned int *member_index;
+	size_t member_index_mask;
+
+	/* Member order prediction: member_successor[0] is the index of
+	   the member expected first, and member_successor[i + 1] is
+	   the index of the member expected after member i.  NULL for
+	   structs without members. */
+	unsigned int *member_successor;
+
+	/* The number of words in the bitmap of seen members kept while
+	   parsing under EU_PARSE_DUPLICATES_FIRST or _ERROR, or zero if
+	   every member has a presence bit.  See seen_push. */
+	unsigned int seen_words;
+
+	/* The schema-specialized parse function, or NULL */
+	const char *(*specialized_parse)(struct eu_parse *ep, const char *p,
+					 const char *end, void *result,
+					 struct eu_struct_parse_point *point);
 };
 
+/* Member lookup.  A recognizer generated by schemac is used if we have
+   one.  Otherwise, scanning the members linearly is quickest for small
+   structs, and beyond that we use the hash table. */
+#define LINEAR_LOOKUP_MAX 8
+
+/* FNV-1a */
+#define MEMBER_HASH_INIT 2166136261U
+
+static __inline__ uint32_t member_hash(uint32_t h, const char *s, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		h = (h ^ (unsigned char)s[i]) * 16777619U;
+
+	return h;
+}
+
+static const struct eu_struct_member *lookup_member(
+					const struct eu_struct_metadata *md,
+					const char *name, size_t name_len)
+{
+	const struct eu_struct_member *m;
+	size_t i;
+
+	if (md->recognize_member) {
+		int index = md->recognize_member(name, name_len);
+		return index >= 0 ? &md->members[index] : NULL;
+	}
+
+	if (!md->member_index) {
+		for (i = 0; i < md->n_members; i++) {
+			m = &md->members[i];
+			if (m->name_len == name_len
+			    && !memcmp(m->name, name, name_len))
+				return m;
+		}
+
+		return NULL;
+	}
+
+	i = member_hash(MEMBER_HASH_INIT, name, name_len);
+	for (;; i++) {
+		unsigned int index = md->member_index[i & md->member_index_mask];
+		if (!index)
+			return NULL;
+
+		m = &md->members[index - 1];
+		if (m->name_len == name_len
+		    && !memcmp(m->name, name, name_len))
+			return m;
+	}
+}
+
+/* Look up a member name that is split into two pieces.  This only
+   happens when a name straddles input buffers.  A recognizer needs
+   the name in one piece, so in that case we fall back to a linear
+   scan. */
+static const struct eu_struct_member *lookup_member_2(
+					const struct eu_struct_metadata *md,
+					struct eu_string_ref buf,
+					const char *more, size_t more_len)
+{
+	const struct eu_struct_member *m;
+	size_t name_len = buf.len + more_len;
+	size_t i;
+
+	if (!md->member_index) {
+		for (i = 0; i < md->n_members; i++) {
+			m = &md->members[i];
+			if (m->name_len == name_len
+			    && !memcmp(m->name, buf.chars, buf.len)
+			    && !memcmp(m->name + buf.len, more, more_len))
+				return m;
+		}
+
+		return NULL;
+	}
+
+	i = member_hash(member_hash(MEMBER_HASH_INIT, buf.chars, buf.len),
+			more, more_len);
+	for (;; i++) {
+		unsigned int index = md->member_index[i & md->member_index_mask];
+		if (!index)
+			return NULL;
+
+		m = &md->members[index - 1];
+		if (m->name_len == name_len
+		    && !memcmp(m->name, buf.chars, buf.len)
+		    && !memcmp(m->name + buf.len, more, more_len))
+			return m;
+	}
+}
+
+/* Build the member_index hash table for a struct with many members.
+   Returns 0 on allocation failure. */
+static int build_member_index(struct eu_struct_metadata *md)
+{
+	size_t size = 1;
+	size_t i, j;
+	unsigned int *index;
+
+	md->member_index = NULL;
+	md->member_index_mask = 0;
+	if (md->recognize_member || md->n_members <= LINEAR_LOOKUP_MAX)
+		return 1;
+
+	/* Keep the load factor at most 1/2 */
+	while (size < md->n_members * 2)
+		size *= 2;
+
+	index = malloc(size * sizeof *index);
+	if (!index)
+		return 0;
+
+	memset(index, 0, size * sizeof *index);
+	for (i = 0; i < md->n_members; i++) {
+		const struct eu_struct_member *m = &md->members[i];
+
+		for (j = member_hash(MEMBER_HASH_INIT, m->name, m->name_len);
+		     index[j & (size - 1)];
+		     j++);
+
+		index[j & (size - 1)] = i + 1;
+	}
+
+	md->member_index = index;
+	md->member_index_mask = size - 1;
+	return 1;
+}
+
 struct eu_generic_members {
 	void *members;
 	size_t len;
@@ -31,51 +196,425 @@ struct eu_generic_members {
 	} priv;
 };
 
+/* The names of extra members are reference counted, with the count
+   just before the characters.  So a parse can share one copy of a
+   name between all the objects containing it, by keeping a table of
+   the names it has seen (which holds a reference to each).  The
+   table lives until the parse is destroyed, so eu_parse_reset keeps
+   the names from earlier documents.  With an arena, names cannot be
+   freed individually, so we don't bother sharing them. */
+
+typedef unsigned int member_name_refs_t;
+#define MEMBER_NAME_HEADER sizeof(member_name_refs_t)
+
+/* Beyond this many names, new names are no longer interned, so that
+   documents with unbounded sets of names don't grow the table
+   without limit. */
+#define NAME_TABLE_MAX 4096
+
+struct name_table_entry {
+	const char *chars;
+	size_t len;
+	uint32_t hash;
+};
+
+struct eu_name_table {
+	size_t count;
+	size_t mask;
+	struct name_table_entry *entries;
+};
+
+static __inline__ member_name_refs_t *member_name_refs(const char *chars)
+{
+	return (member_name_refs_t *)(chars - MEMBER_NAME_HEADER);
+}
+
+/* Allocate a name, made of two pieces, with one reference */
+static char *new_member_name(const struct eu_heap *heap,
+			     const char *a, size_t a_len,
+			     const char *b, size_t b_len)
+{
+	char *name = eu_alloc(heap, MEMBER_NAME_HEADER + a_len + b_len);
+
+	if (!name)
+		return NULL;
+
+	*(member_name_refs_t *)name = 1;
+	name += MEMBER_NAME_HEADER;
+	memcpy(name, a, a_len);
+	if (b_len)
+		memcpy(name + a_len, b, b_len);
+
+	return name;
+}
+
+static void release_member_name(const struct eu_allocator *allocator,
+				const char *name)
+{
+	member_name_refs_t *refs = member_name_refs(name);
+
+	if (!__atomic_sub_fetch(refs, 1, __ATOMIC_ACQ_REL))
+		eu_allocator_free(allocator, refs);
+}
+
+static __inline__ int member_name_equal(struct eu_string_ref a,
+					struct eu_string_ref b)
+{
+	return a.len == b.len
+		&& (a.chars == b.chars || !memcmp(a.chars, b.chars, a.len));
+}
+
+static int name_table_grow(const struct eu_allocator *allocator,
+			   struct eu_name_table *t)
+{
+	size_t size = t->entries ? (t->mask + 1) * 2 : 64;
+	struct name_table_entry *entries
+		= eu_allocator_alloc(allocator, size * sizeof *entries);
+	size_t i, j;
+
+	if (!entries)
+		return 0;
+
+	memset(entries, 0, size * sizeof *entries);
+	if (t->entries) {
+		for (i = 0; i <= t->mask; i++) {
+			struct name_table_entry *e = &t->entries[i];
+
+			if (!e->chars)
+				continue;
+
+			for (j = e->hash; entries[j & (size - 1)].chars; j++);
+			entries[j & (size - 1)] = *e;
+		}
+
+		eu_allocator_free(allocator, t->entries);
+	}
+
+	t->entries = entries;
+	t->mask = size - 1;
+	return 1;
+}
+
+/* Get a reference to the name made of two pieces, interning it if
+   possible. */
+static char *intern_member_name(struct eu_parse *ep,
+				const char *a, size_t a_len,
+				const char *b, size_t b_len)
+{
+	const struct eu_allocator *allocator = ep->heap.allocator;
+	struct eu_name_table *t = ep->names;
+	struct name_table_entry *e;
+	size_t len = a_len + b_len;
+	uint32_t hash;
+	size_t i;
+	char *name;
+
+	if (ep->heap.arena)
+		return new_member_name(&ep->heap, a, a_len, b, b_len);
+
+	if (!t) {
+		t = eu_allocator_alloc(allocator, sizeof *t);
+		if (!t)
+			return NULL;
+
+		t->count = 0;
+		t->entries = NULL;
+		if (!name_table_grow(allocator, t)) {
+			eu_allocator_free(allocator, t);
+			return NULL;
+		}
+
+		ep->names = t;
+	}
+
+	hash = member_hash(member_hash(MEMBER_HASH_INIT, a, a_len), b, b_len);
+	for (i = hash;; i++) {
+		e = &t->entries[i & t->mask];
+		if (!e->chars)
+			break;
+
+		if (e->hash == hash && e->len == len
+		    && !memcmp(e->chars, a, a_len)
+		    && (!b_len || !memcmp(e->chars + a_len, b, b_len))) {
+			__atomic_add_fetch(member_name_refs(e->chars), 1,
+					   __ATOMIC_RELAXED);
+			return (char *)e->chars;
+		}
+	}
+
+	name = new_member_name(&ep->heap, a, a_len, b, b_len);
+	if (!name || t->count >= NAME_TABLE_MAX)
+		return name;
+
+	/* Keep the load factor at most 1/2 */
+	if ((t->count + 1) * 2 > t->mask + 1) {
+		if (!name_table_grow(allocator, t))
+			return name;
+
+		for (i = hash; t->entries[i & t->mask].chars; i++);
+		e = &t->entries[i & t->mask];
+	}
+
+	/* The table's reference */
+	*member_name_refs(name) = 2;
+	e->chars = name;
+	e->len = len;
+	e->hash = hash;
+	t->count++;
+	return name;
+}
+
+void eu_parse_release_names(struct eu_parse *ep)
+{
+	const struct eu_allocator *allocator = ep->heap.allocator;
+	struct eu_name_table *t = ep->names;
+	size_t i;
+
+	if (!t)
+		return;
+
+	for (i = 0; i <= t->mask; i++)
+		if (t->entries[i].chars)
+			release_member_name(allocator, t->entries[i].chars);
+
+	eu_allocator_free(allocator, t->entries);
+	eu_allocator_free(allocator, t);
+	ep->names = NULL;
+}
+
+/* Objects can have many extra members, so once there are enough of
+   them, lookups use a hash index.  It is built on the first lookup,
+   and then kept up to date as members are added.  The index (along
+   with the allocator it came from) is kept in a header before the
+   members array, so the layout of the members structs is unchanged.
+
+   Building the index on lookup must be safe with concurrent lookups,
+   so it is published with a compare-and-swap.  Adding members
+   requires exclusive access anyway.  With an arena, the index can
+   only be built during parsing, when checking for repeated members.
+   Otherwise we stay with linear search. */
+
+#define EXTRAS_INDEX_MIN 16
+
+struct extras_index {
+	size_t mask;
+
+	/* Member indices plus one; zero marks an empty slot */
+	unsigned int slots[1];
+};
+
+union extras_header {
+	struct {
+		struct extras_index *index;
+
+		/* The allocator of the members array, or NULL for an
+		   arena */
+		const struct eu_allocator *allocator;
+	} h;
+
+	/* For the alignment of the members that follow */
+	double d;
+	eu_integer_t i;
+};
+
+static __inline__ union extras_header *extras_header(
+				const struct eu_generic_members *extras)
+{
+	return (union extras_header *)extras->members - 1;
+}
+
+static __inline__ struct eu_string_ref extra_name(
+				const struct eu_struct_metadata *md,
+				const struct eu_generic_members *extras,
+				size_t i)
+{
+	/* The name is always the first field in the member struct */
+	return *(struct eu_string_ref *)((char *)extras->members
+					 + i * md->extra_member_size);
+}
+
+static void extras_index_insert(const struct eu_struct_metadata *md,
+				const struct eu_generic_members *extras,
+				struct extras_index *index, size_t i)
+{
+	struct eu_string_ref name = extra_name(md, extras, i);
+	size_t j;
+
+	for (j = member_hash(MEMBER_HASH_INIT, name.chars, name.len);
+	     index->slots[j & index->mask];
+	     j++);
+
+	index->slots[j & index->mask] = i + 1;
+}
+
+/* Build an index for the members, with room for up to capacity
+   members. */
+static struct extras_index *build_extras_index(
+				const struct eu_struct_metadata *md,
+				const struct eu_generic_members *extras,
+				const struct eu_heap *heap, size_t capacity)
+{
+	struct extras_index *index;
+	size_t size = 1, bytes, i;
+
+	/* Keep the load factor at most 1/2 */
+	while (size < capacity * 2)
+		size *= 2;
+
+	bytes = offsetof(struct extras_index, slots)
+		+ size * sizeof index->slots[0];
+	index = eu_alloc(heap, bytes);
+	if (!index)
+		return NULL;
+
+	memset(index, 0, bytes);
+	index->mask = size - 1;
+	for (i = 0; i < extras->len; i++)
+		extras_index_insert(md, extras, index, i);
+
+	return index;
+}
+
+/* Get the index, building it if necessary.  During parsing, heap is
+   where the members came from, so that an index can be built in an
+   arena.  Otherwise it is NULL. */
+static struct extras_index *get_extras_index(
+				const struct eu_struct_metadata *md,
+				const struct eu_generic_members *extras,
+				const struct eu_heap *heap)
+{
+	union extras_header *header = extras_header(extras);
+	struct extras_index *index
+		= __atomic_load_n(&header->h.index, __ATOMIC_ACQUIRE);
+	struct extras_index *expected = NULL;
+	struct eu_heap allocator_heap;
+
+	if (index)
+		return index;
+
+	if (!heap) {
+		if (!header->h.allocator)
+			return NULL;
+
+		allocator_heap.allocator = header->h.allocator;
+		allocator_heap.arena = NULL;
+		heap = &allocator_heap;
+	}
+
+	index = build_extras_index(md, extras, heap, extras->priv.capacity);
+	if (!index)
+		return NULL;
+
+	if (!__atomic_compare_exchange_n(&header->h.index, &expected, index,
+					 0, __ATOMIC_ACQ_REL,
+					 __ATOMIC_ACQUIRE)) {
+		/* Another thread beat us to it */
+		eu_free(heap, index);
+		index = expected;
+	}
+
+	return index;
+}
+
+/* Find the first extra member with the given name, returning its
+   index, or extras->len if there is none. */
+static size_t lookup_extra(const struct eu_struct_metadata *md,
+			   const struct eu_generic_members *extras,
+			   struct eu_string_ref name, const struct eu_heap *heap)
+{
+	struct extras_index *index;
+	size_t i;
+
+	if (extras->len >= EXTRAS_INDEX_MIN
+	    && (index = get_extras_index(md, extras, heap))) {
+		for (i = member_hash(MEMBER_HASH_INIT, name.chars, name.len);;
+		     i++) {
+			unsigned int slot = index->slots[i & index->mask];
+			if (!slot)
+				return extras->len;
+
+			if (member_name_equal(extra_name(md, extras, slot - 1),
+					      name))
+				return slot - 1;
+		}
+	}
+
+	for (i = 0; i < extras->len; i++)
+		if (member_name_equal(extra_name(md, extras, i), name))
+			break;
+
+	return i;
+}
+
 static void *add_extra(const struct eu_struct_metadata *md,
-		       char *s, char *name, size_t name_len)
+		       const struct eu_heap *heap, char *s, char *name,
+		       size_t name_len)
 {
 	struct eu_generic_members *extras = (void *)(s + md->extras_offset);
 	size_t capacity = extras->priv.capacity;
-	char *members, *member;
+	union extras_header *header;
+	struct extras_index *index;
+	char *member;
 
-	if (extras->len < capacity) {
-		members = extras->members;
-	}
-	else {
+	if (extras->len == capacity) {
 		if (!capacity) {
 			size_t sz;
 
 			capacity = 8;
-			sz = capacity * md->extra_member_size;
-			members	= malloc(sz);
-			if (!members)
+			sz = sizeof *header + capacity * md->extra_member_size;
+			header = eu_alloc(heap, sz);
+			if (!header)
 				goto err;
 
-			memset(members, 0, sz);
+			memset(header, 0, sz);
+			header->h.allocator
+				= heap->arena ? NULL : heap->allocator;
 		}
 		else {
 			size_t sz = capacity * md->extra_member_size;
 
 			capacity *= 2;
-			members = realloc(extras->members, 2 * sz);
-			if (!members)
+			header = eu_realloc(heap, extras_header(extras),
+					    sizeof *header + sz,
+					    sizeof *header + 2 * sz);
+			if (!header)
 				goto err;
 
-			memset(members + sz, 0, sz);
+			memset((char *)(header + 1) + sz, 0, sz);
 		}
 
-		extras->members = members;
+		extras->members = header + 1;
 		extras->priv.capacity = capacity;
 	}
 
-	member = members + extras->len++ * md->extra_member_size;
+	member = (char *)extras->members
+		+ extras->len++ * md->extra_member_size;
 
 	/* The name is always the first field in the member struct */
 	*(struct eu_string_ref *)member = eu_string_ref(name, name_len);
+
+	/* Keep the index up to date, if there is one */
+	header = extras_header(extras);
+	index = header->h.index;
+	if (index) {
+		if (extras->len * 2 > index->mask + 1) {
+			/* If we can't grow the index, drop it */
+			header->h.index = build_extras_index(md, extras, heap,
+							     capacity);
+			eu_free(heap, index);
+		}
+		else {
+			extras_index_insert(md, extras, index,
+					    extras->len - 1);
+		}
+	}
+
 	return member + md->extra_member_value_offset;
 
  err:
-	free(name);
+	if (!heap->arena)
+		release_member_name(heap->allocator, name);
+
 	return NULL;
 }
 
@@ -83,106 +622,479 @@ static void *get_extra(const struct eu_struct_metadata *md,
 		       char *s, struct eu_string_ref name)
 {
 	struct eu_generic_members *extras = (void *)(s + md->extras_offset);
-	char *member;
+	const struct eu_heap *heap = &eu_default_heap;
+	struct eu_heap allocator_heap;
 	char *name_copy;
 	size_t i;
 
-	for (i = 0, member = extras->members;
-	     i < extras->len;
-	     i++, member += md->extra_member_size)
-		/* The name is always the first field in the member struct */
-		if (eu_string_ref_equal(*(struct eu_string_ref *)member,
-					name))
-			return member + md->extra_member_value_offset;
-
-	name_copy = malloc(name.len);
-	if (name_copy) {
-		memcpy(name_copy, name.chars, name.len);
-		return add_extra(md, s, name_copy, name.len);
+	i = lookup_extra(md, extras, name, NULL);
+	if (i < extras->len)
+		return (char *)extras->members + i * md->extra_member_size
+			+ md->extra_member_value_offset;
+
+	/* Add to the extras with the allocator they came from.  We
+	   don't know the arena of extras that came from one, so we
+	   can't add to them.  A fresh object uses the default
+	   allocator. */
+	if (extras->priv.capacity) {
+		allocator_heap.allocator = extras_header(extras)->h.allocator;
+		if (!allocator_heap.allocator)
+			return NULL;
+
+		allocator_heap.arena = NULL;
+		heap = &allocator_heap;
 	}
 
+	name_copy = new_member_name(heap, name.chars, name.len, NULL, 0);
+	if (name_copy)
+		return add_extra(md, heap, s, name_copy, name.len);
+
 	return NULL;
 }
 
-static const struct eu_metadata *add_member(
+/* Producers of JSON usually emit members in a consistent order.  So
+   we remember which member followed each member last time, and try
+   that before doing a general lookup.  *slot tracks the position
+   within the object being parsed, as an index into member_successor.
+
+   The member_successor table is shared by all parses using the
+   metadata, possibly on different threads, so it is accessed with
+   relaxed atomics.  Racing updates are harmless, as any member index
+   is a valid prediction. */
+
+static __inline__ void update_member_successor(
 					const struct eu_struct_metadata *md,
-					char *s, const char *name,
-					const char *name_end, void **value_out)
+					unsigned int *slot,
+					const struct eu_struct_member *m)
 {
-	size_t name_len = name_end - name;
-	size_t i;
-	char *name_copy;
-	void *value;
+	unsigned int index = m - md->members;
 
-	for (i = 0; i < md->n_members; i++) {
-		const struct eu_struct_member *m = &md->members[i];
-		if (m->name_len != name_len)
-			continue;
+	if (__atomic_load_n(&md->member_successor[*slot], __ATOMIC_RELAXED)
+	    != index)
+		__atomic_store_n(&md->member_successor[*slot], index,
+				 __ATOMIC_RELAXED);
+
+	*slot = index + 1;
+}
+
+/* Closed structs skip over the values of members that are not among
+   the declared members, rather than adding them to the extras.  As
+   for EU_PARSE_LAZY, the skipping only checks that brackets nest and
+   match, and that strings are terminated.  So no values are built,
+   and the member names are not copied. */
 
-		if (!memcmp(m->name, name, name_len)) {
-			if (m->presence_offset >= 0)
-				s[m->presence_offset] |= m->presence_bit;
+static const struct eu_metadata skip_metadata;
 
-			*value_out = s + m->offset;
-			return m->metadata;
+static __inline__ int struct_closed(const struct eu_struct_metadata *md)
+{
+	return md->extra_value_metadata == &skip_metadata;
+}
+
+static __inline__ int scalar_char(char c)
+{
+	return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z')
+		|| c == '-' || c == '+' || c == '.' || c == 'E';
+}
+
+/* The resumable skipper.  depth counts the open brackets, and kinds
+   records what they are. */
+enum skip_state {
+	SKIP_STRUCTURE,
+	SKIP_STRING,
+	SKIP_ESCAPE,
+	SKIP_SCALAR
+};
+
+struct skip_frame {
+	struct eu_stack_frame base;
+	size_t depth;
+	enum skip_state state;
+	struct eu_skip_kinds kinds;
+};
+
+static enum eu_result skip_resume(struct eu_stack_frame *gframe, void *v_ep);
+
+static enum eu_result skip_scan(struct eu_parse *ep, const char *p,
+				size_t depth, enum skip_state state,
+				struct eu_skip_kinds *kinds)
+{
+	const char *end = ep->input_end;
+	struct skip_frame *frame;
+
+	for (; p != end; p++) {
+		switch (state) {
+		case SKIP_STRUCTURE:
+			switch (*p) {
+			case '\"':
+				state = SKIP_STRING;
+				break;
+
+			case '{':
+			case '[':
+				eu_skip_open(kinds, depth++, *p);
+				break;
+
+			case '}':
+			case ']':
+				if (!depth || !eu_skip_close_ok(kinds, --depth, *p))
+					return EU_ERROR;
+
+				if (depth == 0)
+					goto done;
+
+				break;
+			}
+
+			break;
+
+		case SKIP_STRING:
+			p = eu_scan_string(p, end);
+			if (p == end)
+				goto pause;
+
+			if (*p == '\\') {
+				state = SKIP_ESCAPE;
+			}
+			else if (*p == '\"') {
+				if (!depth)
+					goto done;
+
+				state = SKIP_STRUCTURE;
+			}
+			else {
+				return EU_ERROR;
+			}
+
+			break;
+
+		case SKIP_ESCAPE:
+			state = SKIP_STRING;
+			break;
+
+		case SKIP_SCALAR:
+			if (!scalar_char(*p)) {
+				ep->input = p;
+				return EU_OK;
+			}
+
+			break;
 		}
 	}
 
-	name_copy = malloc(name_len);
-	if (!name_copy)
+ pause:
+	ep->input = end;
+	frame = eu_stack_alloc_first(&ep->stack, sizeof *frame);
+	if (!frame)
+		return EU_ERROR;
+
+	frame->base.resume = skip_resume;
+	frame->base.destroy = eu_stack_frame_noop_destroy;
+	frame->depth = depth;
+	frame->state = state;
+	frame->kinds = *kinds;
+	return EU_PAUSED;
+
+ done:
+	ep->input = p + 1;
+	return EU_OK;
+}
+
+static enum eu_result skip_resume(struct eu_stack_frame *gframe, void *v_ep)
+{
+	struct skip_frame *frame = (struct skip_frame *)gframe;
+	struct eu_parse *ep = v_ep;
+	struct eu_skip_kinds kinds = frame->kinds;
+
+	/* A new frame might reuse the memory of this one */
+	return skip_scan(ep, ep->input, frame->depth, frame->state, &kinds);
+}
+
+static enum eu_result skip_parse(const struct eu_metadata *metadata,
+				 struct eu_parse *ep, void *result)
+{
+	struct eu_skip_kinds kinds;
+	const char *p;
+
+	for (;;) {
+		p = ep->input;
+		switch (*p) {
+		case WHITESPACE_CASES: {
+			enum eu_result res
+				= eu_consume_whitespace(metadata, ep, result);
+			if (res != EU_OK)
+				return res;
+
+			break;
+		}
+
+		case '{':
+		case '[':
+			p = eu_skip_container(p, ep->input_end);
+			if (p) {
+				ep->input = p;
+				return EU_OK;
+			}
+
+			return skip_scan(ep, ep->input, 0, SKIP_STRUCTURE,
+					 &kinds);
+
+		case '\"':
+			return skip_scan(ep, p + 1, 0, SKIP_STRING, &kinds);
+
+		default:
+			if (!scalar_char(*p))
+				return EU_ERROR;
+
+			return skip_scan(ep, p + 1, 0, SKIP_SCALAR, &kinds);
+		}
+	}
+}
+
+static const struct eu_metadata skip_metadata = {
+	EU_JSON_INVALID,
+	0,
+	skip_parse,
+	eu_generate_fail,
+	eu_noop_fini,
+	eu_get_fail,
+	eu_object_iter_init_fail,
+	eu_object_size_fail,
+	eu_to_double_fail,
+	eu_to_integer_fail,
+};
+
+/* Handle a repeated member according to the EU_PARSE_DUPLICATES_*
+   option.  value holds the earlier value, with metadata value_md.
+   Returns the metadata to parse the new value with, or NULL if the
+   repetition is an error. */
+static const struct eu_metadata *repeated_member(struct eu_parse *ep,
+					const struct eu_metadata *value_md,
+					void *value, void **value_out)
+{
+	switch (ep->options & EU_PARSE_DUPLICATES_MASK) {
+	case EU_PARSE_DUPLICATES_FIRST:
+		*value_out = NULL;
+		return &skip_metadata;
+
+	case EU_PARSE_DUPLICATES_ERROR:
 		return NULL;
 
-	memcpy(name_copy, name, name_len);
-	value = add_extra(md, s, name_copy, name_len);
-	if (value) {
+	default:
+		/* Replace the earlier value */
+		if (!ep->heap.arena)
+			value_md->fini(value_md, value, ep->heap.allocator);
+
+		memset(value, 0, value_md->size);
 		*value_out = value;
-		return md->extra_value_metadata;
+		return value_md;
 	}
+}
 
-	return NULL;
+/* A declared member without a presence bit counts as present if its
+   first field is a non-NULL pointer.  That holds once parsed for the
+   types that schemac gives no presence bits (empty strings and arrays
+   get EU_ZERO_LENGTH_PTR), but a descriptor can declare other types
+   that way, such as numbers, whose values may be all zero bits.
+   A missed repeat of such a member simply replaces the earlier
+   value, but under EU_PARSE_DUPLICATES_FIRST and _ERROR, it would go
+   unnoticed.  So under those, each object being parsed gets
+   a bitmap of the members seen so far in ep->seen, starting at word
+   seen_base.  The bitmaps form a stack, following the nesting of the
+   objects. */
+#define SEEN_NONE ((size_t)-1)
+
+static int seen_push(struct eu_parse *ep,
+		     const struct eu_struct_metadata *md, size_t *seen_base)
+{
+	size_t len, capacity;
+	uint64_t *seen;
+
+	switch (ep->options & EU_PARSE_DUPLICATES_MASK) {
+	case EU_PARSE_DUPLICATES_FIRST:
+	case EU_PARSE_DUPLICATES_ERROR:
+		if (md->seen_words)
+			break;
+
+		/* fall through */
+	default:
+		*seen_base = SEEN_NONE;
+		return 1;
+	}
+
+	len = ep->seen_len + md->seen_words;
+	if (len > ep->seen_capacity) {
+		capacity = ep->seen_capacity * 2;
+		if (capacity < len)
+			capacity = len;
+
+		seen = eu_allocator_realloc(ep->heap.allocator, ep->seen,
+					    capacity * sizeof *seen);
+		if (!seen)
+			return 0;
+
+		ep->seen = seen;
+		ep->seen_capacity = capacity;
+	}
+
+	memset(ep->seen + ep->seen_len, 0, md->seen_words * sizeof *ep->seen);
+	*seen_base = ep->seen_len;
+	ep->seen_len = len;
+	return 1;
 }
 
-static const struct eu_metadata *add_member_2(
-				const struct eu_struct_metadata *md, char *s,
-				struct eu_string_ref buf,
-				const char *more, const char *more_end,
-				void **value_out)
+static __inline__ void seen_pop(struct eu_parse *ep, size_t seen_base)
+{
+	if (seen_base != SEEN_NONE)
+		ep->seen_len = seen_base;
+}
+
+static __inline__ const struct eu_metadata *declared_member(
+					const struct eu_struct_metadata *md,
+					struct eu_parse *ep, char *s,
+					size_t seen_base,
+					const struct eu_struct_member *m,
+					void **value_out)
 {
-	size_t more_len = more_end - more;
-	size_t name_len = buf.len + more_len;
 	size_t i;
-	char *name_copy;
+	uint64_t *word, bit;
+
+	if (unlikely(struct_member_present(m, (unsigned char *)s)))
+		goto repeated;
+
+	if (m->presence_offset >= 0) {
+		s[m->presence_offset] |= m->presence_bit;
+	}
+	else if (unlikely(seen_base != SEEN_NONE)) {
+		i = m - md->members;
+		word = &ep->seen[seen_base + i / 64];
+		bit = (uint64_t)1 << (i % 64);
+		if (*word & bit)
+			goto repeated;
+
+		*word |= bit;
+	}
+
+	*value_out = s + m->offset;
+	return m->metadata;
+
+ repeated:
+	return repeated_member(ep, m->metadata, s + m->offset, value_out);
+}
+
+/* Add an extra member, taking ownership of the name.  Repeated extra
+   members are only looked for if the option asks for it; otherwise
+   they are all kept. */
+static const struct eu_metadata *extra_member(
+					const struct eu_struct_metadata *md,
+					struct eu_parse *ep, char *s,
+					char *name, size_t name_len,
+					void **value_out)
+{
+	struct eu_generic_members *extras = (void *)(s + md->extras_offset);
 	void *value;
+	size_t i;
 
-	for (i = 0; i < md->n_members; i++) {
-		const struct eu_struct_member *m = &md->members[i];
-		if (m->name_len != name_len)
-			continue;
+	if (ep->options & EU_PARSE_DUPLICATES_MASK) {
+		i = lookup_extra(md, extras, eu_string_ref(name, name_len),
+				 &ep->heap);
+		if (i < extras->len) {
+			if (!ep->heap.arena)
+				release_member_name(ep->heap.allocator, name);
+
+			return repeated_member(ep, md->extra_value_metadata,
+					       (char *)extras->members
+					       + i * md->extra_member_size
+					       + md->extra_member_value_offset,
+					       value_out);
+		}
+	}
 
-		if (!memcmp(m->name, buf.chars, buf.len)
-		    && !memcmp(m->name + buf.len, more, more_len)) {
-			if (m->presence_offset >= 0)
-				s[m->presence_offset] |= m->presence_bit;
+	value = add_extra(md, &ep->heap, s, name, name_len);
+	if (!value)
+		return NULL;
+
+	*value_out = value;
+	return md->extra_value_metadata;
+}
 
-			*value_out = s + m->offset;
-			return m->metadata;
+static const struct eu_metadata *add_member(
+					const struct eu_struct_metadata *md,
+					struct eu_parse *ep, char *s,
+					unsigned int *slot, size_t seen_base,
+					const char *name, const char *name_end,
+					void **value_out)
+{
+	size_t name_len = name_end - name;
+	const struct eu_struct_member *m;
+	char *name_copy;
+
+	if (md->member_successor) {
+		unsigned int predicted
+			= __atomic_load_n(&md->member_successor[*slot],
+					  __ATOMIC_RELAXED);
+
+		if (likely(predicted < md->n_members)) {
+			m = &md->members[predicted];
+			if (m->name_len == name_len
+			    && !memcmp(m->name, name, name_len)) {
+				ep->stats.member_predict_hits++;
+				*slot = predicted + 1;
+				goto found;
+			}
 		}
+
+		ep->stats.member_predict_misses++;
+	}
+
+	m = lookup_member(md, name, name_len);
+	if (m) {
+		update_member_successor(md, slot, m);
+	found:
+		return declared_member(md, ep, s, seen_base, m,
+				       value_out);
+	}
+
+	if (struct_closed(md)) {
+		*value_out = NULL;
+		return &skip_metadata;
 	}
 
-	name_copy = malloc(name_len);
+	name_copy = intern_member_name(ep, name, name_len, NULL, 0);
 	if (!name_copy)
 		return NULL;
 
-	memcpy(name_copy, buf.chars, buf.len);
-	memcpy(name_copy + buf.len, more, more_len);
+	return extra_member(md, ep, s, name_copy, name_len, value_out);
+}
 
-	value = add_extra(md, s, name_copy, name_len);
-	if (value) {
-		*value_out = value;
-		return md->extra_value_metadata;
+static const struct eu_metadata *add_member_2(
+				const struct eu_struct_metadata *md,
+				struct eu_parse *ep, char *s,
+				unsigned int *slot, size_t seen_base,
+				struct eu_string_ref buf, const char *more,
+				const char *more_end, void **value_out)
+{
+	size_t more_len = more_end - more;
+	size_t name_len = buf.len + more_len;
+	const struct eu_struct_member *m;
+	char *name_copy;
+
+	m = lookup_member_2(md, buf, more, more_len);
+	if (m) {
+		update_member_successor(md, slot, m);
+		return declared_member(md, ep, s, seen_base, m,
+				       value_out);
 	}
 
-	return NULL;
+	if (struct_closed(md)) {
+		*value_out = NULL;
+		return &skip_metadata;
+	}
+
+	name_copy = intern_member_name(ep, buf.chars, buf.len, more, more_len);
+	if (!name_copy)
+		return NULL;
+
+	return extra_member(md, ep, s, name_copy, name_len, value_out);
 }
 
 /* A state name refers to the input token that triggers it, except for
@@ -204,12 +1116,19 @@ struct struct_parse_frame {
 	void **result_ptr;
 	const struct eu_metadata *member_metadata;
 	void *member_value;
+	unsigned int member_slot;
+	size_t seen_base;
 	eu_unescape_state_t unescape;
 };
 
 static enum eu_result struct_parse_resume(struct eu_stack_frame *gframe,
 					  void *v_ep);
-static void struct_parse_frame_destroy(struct eu_stack_frame *gframe);
+static void struct_parse_frame_destroy(struct eu_stack_frame *gframe,
+				       void *v_ep);
+static enum eu_result struct_parse_continue(struct eu_parse *ep,
+					const struct struct_parse_frame *from);
+static void inline_struct_fini(const struct eu_metadata *gmetadata, void *s,
+			       const struct eu_allocator *allocator);
 static enum eu_result struct_parse(const struct eu_metadata *gmetadata,
 				   struct eu_parse *ep, void *result,
 				   void **result_ptr);
@@ -226,7 +1145,7 @@ static enum eu_result struct_ptr_parse(const struct eu_metadata *gmetadata,
 	if (unlikely(res != EU_OK))
 		return res;
 
-	s = malloc(metadata->struct_size);
+	s = eu_alloc(&ep->heap, metadata->struct_size);
 	if (s) {
 		*(void **)result = s;
 		memset(s, 0, metadata->struct_size);
@@ -260,52 +1179,242 @@ static enum eu_result struct_parse(const struct eu_metadata *gmetadata,
 	enum struct_parse_state state = STRUCT_PARSE_OPEN;
 	const struct eu_metadata *member_metadata = NULL;
 	void *member_value = NULL;
+	unsigned int member_slot = 0;
+	size_t seen_base;
 	eu_unescape_state_t unescape = 0;
 	const char *p = ep->input + 1;
 	const char *end = ep->input_end;
 
+	if (!seen_push(ep, metadata, &seen_base))
+		goto alloc_error;
+
 #define RESUME_ONLY(x)
 #include "struct_parse_sm.c"
 }
 
+/* Parsing with a schema-specialized parse function.  If it stops
+   short, the resumable parser takes over from the point it reached,
+   so no part of the object gets parsed twice. */
+
+static enum eu_result specialized_parse_common(
+				const struct eu_struct_metadata *metadata,
+				struct eu_parse *ep, void *result,
+				void **result_ptr)
+{
+	struct eu_struct_parse_point point;
+	struct struct_parse_frame from;
+	struct struct_parse_frame *frame;
+	const char *start = ep->input;
+	const char *p;
+	size_t seen_base;
+
+	point.p = NULL;
+	point.member = -1;
+	ep->value_stop = EU_OK;
+	p = metadata->specialized_parse(ep, start, ep->input_end, result,
+					&point);
+	if (likely(p != NULL)) {
+		ep->input = p;
+		return EU_OK;
+	}
+
+	/* Specialized parse functions keep no bitmap of seen members.
+	   They only exist for schemac's types, whose members without
+	   presence bits are never left with a NULL pointer once
+	   parsed, so an empty bitmap is right from here on. */
+	if (ep->value_stop != EU_ERROR
+	    && !seen_push(ep, metadata, &seen_base))
+		goto error;
+
+	switch (ep->value_stop) {
+	case EU_OK:
+		/* The resumable parser can pick up from just after the
+		   last member value, or the opening brace. */
+		from.metadata = metadata;
+		from.result = result;
+		from.result_ptr = result_ptr;
+		from.member_metadata = NULL;
+		from.member_value = NULL;
+		from.member_slot = point.member + 1;
+		from.seen_base = seen_base;
+		from.unescape = 0;
+		if (point.p) {
+			from.state = STRUCT_PARSE_MEMBER_VALUE;
+			ep->input = point.p;
+		}
+		else {
+			from.state = STRUCT_PARSE_OPEN;
+			ep->input = start + 1;
+		}
+
+		return struct_parse_continue(ep, &from);
+
+	case EU_PAUSED:
+		/* The input ran out within a member value, which has
+		   pushed its own frames, so we push ours on top, as
+		   struct_parse would have. */
+		frame = eu_stack_alloc(&ep->stack, sizeof *frame);
+		if (!frame)
+			break;
+
+		frame->base.resume = struct_parse_resume;
+		frame->base.destroy = struct_parse_frame_destroy;
+		frame->state = STRUCT_PARSE_MEMBER_VALUE;
+		frame->metadata = metadata;
+		frame->result = result;
+		frame->result_ptr = result_ptr;
+		frame->member_metadata = NULL;
+		frame->member_value = NULL;
+		frame->member_slot = point.member + 1;
+		frame->seen_base = seen_base;
+		frame->unescape = 0;
+		return EU_PAUSED;
+
+	default:
+		break;
+	}
+
+ error:
+	if (result_ptr) {
+		if (!ep->heap.arena)
+			inline_struct_fini(&metadata->base, result,
+					   ep->heap.allocator);
+
+		eu_free(&ep->heap, result);
+		*result_ptr = NULL;
+	}
+
+	return EU_ERROR;
+}
+
+static enum eu_result specialized_struct_parse(
+					const struct eu_metadata *gmetadata,
+					struct eu_parse *ep, void *result)
+{
+	enum eu_result res
+		= eu_consume_whitespace_until(gmetadata, ep, result, '{');
+
+	if (unlikely(res != EU_OK))
+		return res;
+
+	return specialized_parse_common(
+			(const struct eu_struct_metadata *)gmetadata, ep,
+			result, NULL);
+}
+
+static enum eu_result specialized_struct_ptr_parse(
+					const struct eu_metadata *gmetadata,
+					struct eu_parse *ep, void *result)
+{
+	const struct eu_struct_metadata *metadata
+		= (const struct eu_struct_metadata *)gmetadata;
+	void *s;
+	enum eu_result res
+		= eu_consume_whitespace_until(gmetadata, ep, result, '{');
+
+	if (unlikely(res != EU_OK))
+		return res;
+
+	s = eu_alloc(&ep->heap, metadata->struct_size);
+	*(void **)result = s;
+	if (!s)
+		return EU_ERROR;
+
+	memset(s, 0, metadata->struct_size);
+	return specialized_parse_common(metadata, ep, s, (void **)result);
+}
+
+const char *eu_parse_extra_member(struct eu_parse *ep, const char *p,
+				  const char *end,
+				  const struct eu_metadata *struct_metadata,
+				  void *s, const char *name,
+				  const char *name_end)
+{
+	const struct eu_struct_metadata *md
+		= (const struct eu_struct_metadata *)struct_metadata;
+	const struct eu_metadata *value_md = md->extra_value_metadata;
+	struct eu_generic_members *extras
+		= (void *)((char *)s + md->extras_offset);
+	size_t name_len = name_end - name;
+	char *name_copy;
+	void *value;
+
+	if (p == end)
+		return NULL;
+
+	if (struct_closed(md)) {
+		ep->input = p;
+		return eu_parse_value_result(ep, skip_parse(&skip_metadata, ep,
+							    NULL));
+	}
+
+	name_copy = intern_member_name(ep, name, name_len, NULL, 0);
+	if (!name_copy)
+		return NULL;
+
+	/* Leave repeated members to the generic parser */
+	if ((ep->options & EU_PARSE_DUPLICATES_MASK)
+	    && lookup_extra(md, extras, eu_string_ref(name_copy, name_len),
+			    &ep->heap) < extras->len) {
+		if (!ep->heap.arena)
+			release_member_name(ep->heap.allocator, name_copy);
+
+		return NULL;
+	}
+
+	value = add_extra(md, &ep->heap, s, name_copy, name_len);
+	if (!value)
+		return NULL;
+
+	ep->input = p;
+	return eu_parse_value_result(ep, value_md->parse(value_md, ep, value));
+}
+
 static enum eu_result struct_parse_resume(struct eu_stack_frame *gframe,
 					  void *v_ep)
 {
 	struct struct_parse_frame *frame = (struct struct_parse_frame *)gframe;
 	struct eu_parse *ep = v_ep;
-	enum struct_parse_state state = frame->state;
-	const struct eu_struct_metadata *metadata = frame->metadata;
-	void *result = frame->result;
-	void **result_ptr = frame->result_ptr;
-	const struct eu_metadata *member_metadata = frame->member_metadata;
-	void *member_value = frame->member_value;
-	eu_unescape_state_t unescape = frame->unescape;
-	const char *p, *end;
-
-	if (unlikely(unescape)) {
+
+	if (unlikely(frame->unescape)) {
 		eu_unicode_char_t uc;
 
 		if (!eu_stack_reserve_more_scratch(&ep->stack, UTF8_LONGEST))
 			return EU_ERROR;
 
-		if (!eu_finish_unescape(ep, &unescape, &uc))
+		if (!eu_finish_unescape(ep, &frame->unescape, &uc))
 			return EU_ERROR;
 
-		p = ep->input;
-		if (unescape)
-			/* We can't simply return
-			   EU_REINSTATE_PAUSED here because
-			   reserve_scratch may have fiddled with the
-			   stack. */
-			goto pause_input_set;
+		/* The scratch space is separate from the frames, so
+		   this frame is still intact */
+		if (frame->unescape)
+			return EU_REINSTATE_PAUSED;
 
 		eu_stack_set_scratch_end(&ep->stack,
 					 eu_unicode_to_utf8(uc,
 					      eu_stack_scratch_end(&ep->stack)));
 	}
 
-	p = ep->input;
-	end = ep->input_end;
+	return struct_parse_continue(ep, frame);
+}
+
+/* Carry on parsing an object from the state in from, with the input
+   at ep->input.  from need not be on the stack. */
+static enum eu_result struct_parse_continue(struct eu_parse *ep,
+					const struct struct_parse_frame *from)
+{
+	struct struct_parse_frame *frame;
+	enum struct_parse_state state = from->state;
+	const struct eu_struct_metadata *metadata = from->metadata;
+	void *result = from->result;
+	void **result_ptr = from->result_ptr;
+	const struct eu_metadata *member_metadata = from->member_metadata;
+	void *member_value = from->member_value;
+	unsigned int member_slot = from->member_slot;
+	size_t seen_base = from->seen_base;
+	eu_unescape_state_t unescape = from->unescape;
+	const char *p = ep->input;
+	const char *end = ep->input_end;
 
 #define RESUME_ONLY(x) x
 	switch (state) {
@@ -315,37 +1424,35 @@ static enum eu_result struct_parse_resume(struct eu_stack_frame *gframe,
 		/* The member name was split, so we need to accumulate
 		   the complete member name rather than simply
 		   picking up where we left off. */
-		for (;; p++) {
-			if (p != end) {
-				switch (*p) {
-				case '\"': goto resume_member_name_done;
-				case '\\': goto resume_unescape_member_name;
-				default: break;
-				}
-			}
-			else {
-				if (!eu_stack_append_scratch(&ep->stack,
-							     ep->input, p))
-					goto alloc_error;
+		p = eu_scan_string(p, end);
+		if (p == end) {
+			if (!eu_stack_append_scratch(&ep->stack, ep->input, p))
+				goto alloc_error;
 
-				goto pause;
-			}
+			goto pause;
+		}
+
+		switch (*p) {
+		case '\"': goto resume_member_name_done;
+		case '\\': goto resume_unescape_member_name;
+		default: goto error;
 		}
 
 	resume_member_name_done:
-		member_metadata = add_member_2(metadata, result,
+		member_metadata = add_member_2(metadata, ep, result,
+					       &member_slot, seen_base,
 					       eu_stack_scratch_ref(&ep->stack),
 					       ep->input, p, &member_value);
 		eu_stack_reset_scratch(&ep->stack);
 		goto looked_up_member;
 
 	resume_unescape_member_name:
-		/* Skip the backslash, and scan forward to find the end of the
-		   member name */
-		do {
-			if (++p == end)
-				goto pause_resume_unescape_member_name;
-		} while (*p != '\"' || quotes_escaped_bounded(p, ep->input));
+		/* Scan forward to find the end of the member name */
+		if (!scan_escaped_string(&p, end))
+			goto error;
+
+		if (p == end)
+			goto pause_resume_unescape_member_name;
 
 		if (!eu_stack_reserve_more_scratch(&ep->stack, p - ep->input))
 			goto error_input_set;
@@ -358,7 +1465,8 @@ static enum eu_result struct_parse_resume(struct eu_stack_frame *gframe,
 			if (!unescaped_end || unescape)
 				goto error_input_set;
 
-			member_metadata = add_member(metadata, result,
+			member_metadata = add_member(metadata, ep, result,
+						  &member_slot, seen_base,
 						  eu_stack_scratch(&ep->stack),
 						  unescaped_end, &member_value);
 			eu_stack_reset_scratch(&ep->stack);
@@ -389,7 +1497,8 @@ static enum eu_result struct_parse_resume(struct eu_stack_frame *gframe,
 }
 
 static void struct_extras_fini(const struct eu_struct_metadata *md,
-			       void *v_extras)
+			       void *v_extras,
+			       const struct eu_allocator *allocator)
 {
 	struct eu_generic_members *extras = v_extras;
 	const struct eu_metadata *evmd = md->extra_value_metadata;
@@ -397,15 +1506,24 @@ static void struct_extras_fini(const struct eu_struct_metadata *md,
 	size_t i;
 
 	for (i = 0; i < extras->len; i++) {
-		free((void *)((struct eu_string_ref *)m)->chars);
-		evmd->fini(evmd, m + md->extra_member_value_offset);
+		release_member_name(allocator,
+				    ((struct eu_string_ref *)m)->chars);
+		evmd->fini(evmd, m + md->extra_member_value_offset, allocator);
 		m += md->extra_member_size;
 	}
 
-	free(extras->members);
+	if (extras->members) {
+		union extras_header *header = extras_header(extras);
+
+		if (header->h.index)
+			eu_allocator_free(allocator, header->h.index);
+
+		eu_allocator_free(allocator, header);
+	}
 }
 
-static void inline_struct_fini(const struct eu_metadata *gmetadata, void *s)
+static void inline_struct_fini(const struct eu_metadata *gmetadata, void *s,
+			       const struct eu_allocator *allocator)
 {
 	const struct eu_struct_metadata *metadata
 		= (const struct eu_struct_metadata *)gmetadata;
@@ -414,19 +1532,21 @@ static void inline_struct_fini(const struct eu_metadata *gmetadata, void *s)
 	for (i = 0; i < metadata->n_members; i++) {
 		const struct eu_struct_member *member = &metadata->members[i];
 		member->metadata->fini(member->metadata,
-				       (char *)s + member->offset);
+				       (char *)s + member->offset, allocator);
 	}
 
-	struct_extras_fini(metadata, (char *)s + metadata->extras_offset);
+	struct_extras_fini(metadata, (char *)s + metadata->extras_offset,
+			   allocator);
 }
 
-static void struct_ptr_fini(const struct eu_metadata *gmetadata, void *value)
+static void struct_ptr_fini(const struct eu_metadata *gmetadata, void *value,
+			    const struct eu_allocator *allocator)
 {
 	void *s = *(void **)value;
 
 	if (s) {
-		inline_struct_fini(gmetadata, s);
-		free(s);
+		inline_struct_fini(gmetadata, s, allocator);
+		eu_allocator_free(allocator, s);
 		*(void **)value = NULL;
 	}
 }
@@ -436,63 +1556,53 @@ void eu_struct_extras_fini(const struct eu_metadata *smd, void *v_extras)
 	if (smd->fini != inline_struct_fini)
 		abort();
 
-	struct_extras_fini((const struct eu_struct_metadata *)smd, v_extras);
+	struct_extras_fini((const struct eu_struct_metadata *)smd, v_extras,
+			   &eu_default_allocator);
 }
 
-static void struct_parse_frame_destroy(struct eu_stack_frame *gframe)
+static void struct_parse_frame_destroy(struct eu_stack_frame *gframe,
+				       void *v_ep)
 {
 	struct struct_parse_frame *frame = (struct struct_parse_frame *)gframe;
+	struct eu_parse *ep = v_ep;
 
-	inline_struct_fini(&frame->metadata->base, frame->result);
+	inline_struct_fini(&frame->metadata->base, frame->result,
+			   ep->heap.allocator);
 
 	/* To avoid fini functions being called multiple times. */
 	memset(frame->result, 0, frame->metadata->base.size);
 
 	if (frame->result_ptr) {
-		free(frame->result);
+		eu_free(&ep->heap, frame->result);
 		*frame->result_ptr = NULL;
 	}
 }
 
-static __inline__ int struct_member_present(const struct eu_struct_member *m,
-					    unsigned char *p)
-{
-	if (m->presence_offset >= 0)
-		return !!(p[m->presence_offset] & m->presence_bit);
-	else
-		return !!*(void **)(p + m->offset);
-}
-
 static struct eu_value inline_struct_get(struct eu_value val,
 					 struct eu_string_ref name)
 {
 	const struct eu_struct_metadata *md
 		= (const struct eu_struct_metadata *)val.metadata;
+	const struct eu_struct_member *m;
 	size_t i;
 	unsigned char *s = val.value;
 	struct eu_generic_members *extras;
-	char *em;
 
-	for (i = 0; i < md->n_members; i++) {
-		const struct eu_struct_member *m = &md->members[i];
-		if (m->name_len == name.len
-		    && !memcmp(m->name, name.chars, name.len)) {
-			if (struct_member_present(m, s))
-				return eu_value(s + m->offset, m->metadata);
-			else
-				return eu_value_none;
-		}
+	m = lookup_member(md, name.chars, name.len);
+	if (m) {
+		if (struct_member_present(m, s))
+			return eu_value(s + m->offset, m->metadata);
+		else
+			return eu_value_none;
 	}
 
 	extras = (void *)(s + md->extras_offset);
-	em = extras->members;
-	for (i = 0; i < extras->len; i++) {
-		if (eu_string_ref_equal(*(struct eu_string_ref *)em, name))
-			return eu_value(em + md->extra_member_value_offset,
-					md->extra_value_metadata);
-
-		em += md->extra_member_size;
-	}
+	i = lookup_extra(md, extras, name, NULL);
+	if (i < extras->len)
+		return eu_value((char *)extras->members
+				+ i * md->extra_member_size
+				+ md->extra_member_value_offset,
+				md->extra_value_metadata);
 
 	return eu_value_none;
 }
@@ -726,7 +1836,13 @@ static const struct eu_struct_metadata object_metadata = {
 	offsetof(struct eu_variant_member, value),
 	0,
 	NULL,
-	&eu_variant_metadata
+	&eu_variant_metadata,
+	NULL,
+	NULL,
+	0,
+	NULL,
+	0,
+	NULL
 };
 
 struct eu_object *eu_variant_assign_object(struct eu_variant *var)
@@ -741,7 +1857,8 @@ struct eu_object *eu_variant_assign_object(struct eu_variant *var)
 void eu_object_fini(struct eu_object *obj)
 {
 	if (obj->members.len)
-		struct_extras_fini(&object_metadata, &obj->members);
+		struct_extras_fini(&object_metadata, &obj->members,
+				   &eu_default_allocator);
 }
 
 struct eu_value eu_object_value(struct eu_object *obj)
@@ -764,12 +1881,27 @@ enum eu_result eu_variant_object(const void *unused_metadata,
 	return struct_parse(&object_metadata.base, ep, &result->u.object, NULL);
 }
 
-static int introduce_struct(struct eu_struct_descriptor_v1 *d,
-			    struct eu_introduce_chain *chain)
+static void release_struct_metadata(struct eu_metadata *gmd)
 {
-	struct eu_introduce_chain struct_chain;
-	struct eu_introduce_chain struct_ptr_chain;
+	struct eu_struct_metadata *md = (struct eu_struct_metadata *)gmd;
+
+	free((void *)md->member_index);
+	free(md->member_successor);
+	free((void *)md->members);
+	free(md);
+}
+
+static void release_struct_ptr_metadata(struct eu_metadata *md)
+{
+	/* The members etc. are shared with the struct metadata */
+	free(md);
+}
 
+static const struct eu_metadata *introduce_struct(
+					struct eu_struct_descriptor_v1 *d,
+					const struct eu_type_descriptor *want,
+					struct eu_introduce_chain **chain)
+{
 	struct eu_struct_metadata *md = malloc(sizeof *md);
 	struct eu_struct_metadata *pmd = malloc(sizeof *md);
 	struct eu_struct_member *members
@@ -779,15 +1911,33 @@ static int introduce_struct(struct eu_struct_descriptor_v1 *d,
 	if (unlikely(md == NULL || pmd == NULL || members == NULL))
 		goto error;
 
-	struct_chain.descriptor = &d->struct_base;
-	struct_chain.metadata = &md->base;
-	struct_chain.next = &struct_ptr_chain;
+	md->member_index = NULL;
+	md->member_successor = NULL;
+	md->members = members;
+
+	/* From here on, the chain owns the metadata */
+	if (!eu_introduce_chain_add(chain, &d->struct_base, &md->base,
+				    release_struct_metadata))
+		goto error;
+
+	if (!eu_introduce_chain_add(chain, &d->struct_ptr_base, &pmd->base,
+				    release_struct_ptr_metadata)) {
+		free(pmd);
+		return NULL;
+	}
 
-	struct_ptr_chain.descriptor = &d->struct_ptr_base;
-	struct_ptr_chain.metadata = &pmd->base;
-	struct_ptr_chain.next = chain;
+	md->recognize_member = pmd->recognize_member = NULL;
+	md->specialized_parse = pmd->specialized_parse = NULL;
+	if (d->struct_base.kind == EU_TDESC_STRUCT_V2
+	    || d->struct_base.kind == EU_TDESC_STRUCT_V3)
+		md->recognize_member = pmd->recognize_member
+			= container_of(d, struct eu_struct_descriptor_v2, v1)
+							->recognize_member;
 
-	chain = &struct_chain;
+	if (d->struct_base.kind == EU_TDESC_STRUCT_V3)
+		md->specialized_parse = pmd->specialized_parse
+			= container_of(d, struct eu_struct_descriptor_v3,
+				       v2.v1)->parse;
 
 	md->base.json_type = pmd->base.json_type = EU_JSON_OBJECT;
 
@@ -811,19 +1961,39 @@ static int introduce_struct(struct eu_struct_descriptor_v1 *d,
 	pmd->base.to_double = eu_to_double_fail;
 	pmd->base.to_integer = eu_to_integer_fail;
 
+	if (md->specialized_parse) {
+		md->base.parse = specialized_struct_parse;
+		pmd->base.parse = specialized_struct_ptr_parse;
+	}
+
 	md->struct_size = pmd->struct_size = d->struct_size;
 	md->extras_offset = pmd->extras_offset = d->extras_offset;
 	md->extra_member_size = pmd->extra_member_size = d->extra_member_size;
 	md->extra_member_value_offset = pmd->extra_member_value_offset
 		= d->extra_member_value_offset;
 	md->n_members = pmd->n_members = d->n_members;
-	md->members = pmd->members = members;
-	md->extra_value_metadata = pmd->extra_value_metadata
-		= eu_introduce_aux(d->extra_value_descriptor, chain);
-	if (!md->extra_value_metadata)
-		goto error;
+	pmd->members = members;
+	pmd->member_index = NULL;
+	pmd->member_successor = NULL;
+	if (d->extra_value_descriptor) {
+		md->extra_value_metadata = pmd->extra_value_metadata
+			= eu_introduce_aux(d->extra_value_descriptor, chain);
+		if (!md->extra_value_metadata)
+			return NULL;
+	}
+	else {
+		md->extra_value_metadata = pmd->extra_value_metadata
+			= &skip_metadata;
+	}
 
+	/* Members without presence bits need a bitmap to detect
+	   repeats (see seen_push) */
+	md->seen_words = pmd->seen_words = 0;
 	for (i = 0; i < d->n_members; i++) {
+		if (d->members[i].presence_offset < 0)
+			md->seen_words = pmd->seen_words
+				= (d->n_members + 63) / 64;
+
 		members[i].offset = d->members[i].offset;
 		members[i].name_len = d->members[i].name_len;
 		members[i].presence_offset = d->members[i].presence_offset;
@@ -832,39 +2002,50 @@ static int introduce_struct(struct eu_struct_descriptor_v1 *d,
 		members[i].metadata = eu_introduce_aux(d->members[i].descriptor,
 						       chain);
 		if (!members[i].metadata)
-			goto error;
+			return NULL;
 	}
 
-	*d->struct_base.metadata = &md->base;
-	*d->struct_ptr_base.metadata = &pmd->base;
-	return 1;
+	if (!build_member_index(md))
+		return NULL;
+
+	pmd->member_index = md->member_index;
+	pmd->member_index_mask = md->member_index_mask;
+
+	if (d->n_members) {
+		/* Initially, predict the declaration order */
+		md->member_successor
+			= malloc((d->n_members + 1) * sizeof(unsigned int));
+		if (!md->member_successor)
+			return NULL;
+
+		for (i = 0; i <= d->n_members; i++)
+			md->member_successor[i] = i;
+	}
+
+	pmd->member_successor = md->member_successor;
+
+	return want == &d->struct_base ? &md->base : &pmd->base;
 
  error:
 	free(md);
 	free(pmd);
 	free(members);
-	return 0;
+	return NULL;
 }
 
 const struct eu_metadata *eu_introduce_struct(const struct eu_type_descriptor *d,
-					      struct eu_introduce_chain *c)
+					      struct eu_introduce_chain **c)
 {
 	struct eu_struct_descriptor_v1 *sd
 		= container_of(d, struct eu_struct_descriptor_v1, struct_base);
-	if (introduce_struct(sd, c))
-		return *d->metadata;
-	else
-		return NULL;
+	return introduce_struct(sd, d, c);
 }
 
 const struct eu_metadata *eu_introduce_struct_ptr(
 					const struct eu_type_descriptor *d,
-					struct eu_introduce_chain *c)
+					struct eu_introduce_chain **c)
 {
 	struct eu_struct_descriptor_v1 *sd
 	      = container_of(d, struct eu_struct_descriptor_v1, struct_ptr_base);
-	if (introduce_struct(sd, c))
-		return *d->metadata;
-	else
-		return NULL;
+	return introduce_struct(sd, d, c);
 }
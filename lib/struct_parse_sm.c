@@ -25,20 +25,20 @@ RESUME_ONLY(case STRUCT_PARSE_OPEN:)
 	for (;;) {
 		/* Record the start of the member name */
 		ep->input = ++p;
-		for (;; p++) {
-			if (p == end)
-				goto pause_in_member_name;
+		p = eu_scan_string(p, end);
+		if (p == end)
+			goto pause_in_member_name;
 
-			switch (*p) {
-			case '\"': goto member_name_done;
-			case '\\': goto unescape_member_name;
-			default: break;
-			}
+		switch (*p) {
+		case '\"': goto member_name_done;
+		case '\\': goto unescape_member_name;
+		default: goto error;
 		}
 
 	member_name_done:
-		member_metadata = add_member(metadata, result, ep->input,
-					     p, &member_value);
+		member_metadata = add_member(metadata, ep, result,
+					     &member_slot, seen_base,
+					     ep->input, p, &member_value);
 	looked_up_member:
 		if (!member_metadata)
 			goto error;
@@ -117,6 +117,7 @@ RESUME_ONLY(case STRUCT_PARSE_COMMA:)
 	}
 
  done:
+	seen_pop(ep, seen_base);
 	ep->input = p + 1;
 	return EU_OK;
 
@@ -142,16 +143,18 @@ RESUME_ONLY(case STRUCT_PARSE_COMMA:)
 	frame->result_ptr = result_ptr;
 	frame->member_metadata = member_metadata;
 	frame->member_value = member_value;
+	frame->member_slot = member_slot;
+	frame->seen_base = seen_base;
 	frame->unescape = unescape;
 	return EU_PAUSED;
 
  unescape_member_name:
-	/* Skip the backslash, and scan forward to find the end of the
-	   member name */
-	do {
-		if (++p == end)
-			goto pause_unescape_member_name;
-	} while (*p != '\"' || quotes_escaped(p));
+	/* Scan forward to find the end of the member name */
+	if (!scan_escaped_string(&p, end))
+		goto error;
+
+	if (p == end)
+		goto pause_unescape_member_name;
 
 	if (!eu_stack_reserve_scratch(&ep->stack, p - ep->input))
 		goto error_input_set;
@@ -163,7 +166,8 @@ RESUME_ONLY(case STRUCT_PARSE_COMMA:)
 		if (!unescaped_end || unescape)
 			goto error_input_set;
 
-		member_metadata = add_member(metadata, result,
+		member_metadata = add_member(metadata, ep, result,
+					     &member_slot, seen_base,
 					     eu_stack_scratch(&ep->stack),
 					     unescaped_end, &member_value);
 		eu_stack_reset_scratch(&ep->stack);
@@ -193,7 +197,11 @@ pause_unescape_member_name:
 	ep->input = p;
  error_input_set:
 	if (result_ptr) {
-		free(result);
+		if (!ep->heap.arena)
+			inline_struct_fini(&metadata->base, result,
+					   ep->heap.allocator);
+
+		eu_free(&ep->heap, result);
 		*result_ptr = NULL;
 	}
 
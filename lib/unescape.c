@@ -114,12 +114,23 @@ char *eu_unescape(struct eu_parse *ep, const char *end, char *dest,
 	while (p != end) {
 		char c, magic, unescaped;
 
-		c = *p++;
-		if (c != '\\') {
-			*dest++ = c;
+		if (*p != '\\') {
+			/* Copy the run of characters up to the next
+			   escape sequence in one go. */
+			const char *run_end = memchr(p, '\\', end - p);
+			size_t run_len;
+
+			if (!run_end)
+				run_end = end;
+
+			run_len = run_end - p;
+			memcpy(dest, p, run_len);
+			dest += run_len;
+			p = run_end;
 			continue;
 		}
 
+		p++;
 		state = UES_BACKSLASH;
 		if (p == end)
 			goto pause;
@@ -14,36 +14,32 @@ int eu_finish_unescape(struct eu_parse *ep, eu_unescape_state_t *ues,
 char *eu_unicode_to_utf8(eu_unicode_char_t uc, char *dest);
 int eu_unicode_utf8_length(eu_unicode_char_t uc);
 
-/* Determine whether a double-quotes character was it escaped, by
-   scanning backwards counting backslashes.  This function should be
-   called with a double-quotes character preceding 'p', so we don't
-   need to check for running off the start of the buffer. */
-static __inline__ int quotes_escaped(const char *p)
+/* Scan forward from the backslash at *pp to find the double-quotes
+   character that terminates a string, skipping over escape
+   sequences.  *pp is left pointing at the double-quotes, or at end if
+   the input ran out first.  Returns 0 if an unescaped control
+   character was found. */
+static __inline__ int scan_escaped_string(const char **pp, const char *end)
 {
-	size_t backslashes = 0;
+	const char *p = *pp;
 
-	while (*--p == '\\')
-		backslashes++;
+	for (;;) {
+		/* Skip the backslash and the escaped character */
+		if (end - p <= 2) {
+			p = end;
+			break;
+		}
 
-	/* The double-quotes is escaped if preceded by an odd number
-	   of backslashes. */
-	return (backslashes & 1);
-}
-
-/* Determine whether a double-quotes character was it escaped, by
-   scanning backwards counting backslashes.  'start' marks the start
-   of available character, and should not be inside an esape
-   sequence. */
-static __inline__ int quotes_escaped_bounded(const char *p, const char *start)
-{
-	size_t backslashes = 0;
+		p = eu_scan_string(p + 2, end);
+		if (p == end || *p == '\"')
+			break;
 
-	while (p != start && *--p == '\\')
-		backslashes++;
+		if (*p != '\\')
+			return 0;
+	}
 
-	/* The double-quotes is escaped if preceded by an odd number
-	   of backslashes. */
-	return (backslashes & 1);
+	*pp = p;
+	return 1;
 }
 
 #endif
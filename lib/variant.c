@@ -64,12 +64,74 @@ static const unsigned char char_types[UCHAR_MAX+1] CACHE_ALIGN = {
 	['n'] = CHAR_TYPE_N,
 };
 
+/* Lazy values (EU_PARSE_LAZY) */
+
+struct lazy {
+	const char *json;
+	size_t len;
+	unsigned int options;
+};
+
+STATIC_ASSERT(sizeof(struct lazy) <= sizeof(((struct eu_variant *)0)->u));
+
+static const struct eu_metadata lazy_object_metadata;
+static const struct eu_metadata lazy_array_metadata;
+
+/* Skip over the object or array at ep->input, if it lies within the
+   input buffer. */
+static int parse_lazy(struct eu_parse *ep, struct eu_variant *result,
+		      const struct eu_metadata *lazy_metadata)
+{
+	struct lazy *lazy = (struct lazy *)&result->u;
+	const char *end;
+
+	/* Deferring the whole document would gain nothing, as any
+	   access has to parse it.  eu_variant_materialize allocates
+	   with the default allocator, and struct lazy has no room to
+	   record another, so parses with their own allocator (or an
+	   arena) are eager. */
+	if (result == ep->result || ep->heap.arena
+	    || ep->heap.allocator != &eu_default_allocator)
+		return 0;
+
+	end = eu_skip_container(ep->input, ep->input_end);
+	if (!end)
+		return 0;
+
+	result->metadata = lazy_metadata;
+	lazy->json = ep->input;
+	lazy->len = end - ep->input;
+	lazy->options = ep->options;
+	ep->input = end;
+	return 1;
+}
+
+static enum eu_result brace(const void *misc, struct eu_parse *ep,
+			    struct eu_variant *result)
+{
+	if (unlikely(ep->options & EU_PARSE_LAZY)
+	    && parse_lazy(ep, result, &lazy_object_metadata))
+		return EU_OK;
+
+	return eu_variant_object(misc, ep, result);
+}
+
+static enum eu_result bracket(const void *misc, struct eu_parse *ep,
+			      struct eu_variant *result)
+{
+	if (unlikely(ep->options & EU_PARSE_LAZY)
+	    && parse_lazy(ep, result, &lazy_array_metadata))
+		return EU_OK;
+
+	return eu_variant_array(misc, ep, result);
+}
+
 static const struct char_type_slot char_type_slots[CHAR_TYPE_MAX] = {
 	[CHAR_TYPE_INVALID] = { invalid, NULL },
 	[CHAR_TYPE_WS] = { whitespace, &eu_variant_metadata },
 	[CHAR_TYPE_DQUOTES] = { eu_variant_string, &eu_string_metadata },
-	[CHAR_TYPE_BRACE] = { eu_variant_object, NULL },
-	[CHAR_TYPE_BRACKET] = { eu_variant_array, NULL },
+	[CHAR_TYPE_BRACE] = { brace, NULL },
+	[CHAR_TYPE_BRACKET] = { bracket, NULL },
 	[CHAR_TYPE_NUMBER] = { eu_variant_number, NULL },
 	[CHAR_TYPE_T] = { eu_variant_bool, &eu_bool_true },
 	[CHAR_TYPE_F] = { eu_variant_bool, &eu_bool_false },
@@ -106,24 +168,27 @@ static enum eu_result variant_generate(const struct eu_metadata *metadata,
 void eu_variant_fini(struct eu_variant *variant)
 {
 	if (variant->metadata)
-		variant->metadata->fini(variant->metadata, &variant->u);
+		variant->metadata->fini(variant->metadata, &variant->u,
+					&eu_default_allocator);
 }
 
 void eu_variant_reset(struct eu_variant *variant)
 {
 	if (variant->metadata) {
-		variant->metadata->fini(variant->metadata, &variant->u);
+		variant->metadata->fini(variant->metadata, &variant->u,
+					&eu_default_allocator);
 		variant->metadata = NULL;
 	}
 }
 
-static void variant_fini(const struct eu_metadata *metadata, void *value)
+static void variant_fini(const struct eu_metadata *metadata, void *value,
+			 const struct eu_allocator *allocator)
 {
 	struct eu_variant *var = value;
 	(void)metadata;
 
 	if (var->metadata) {
-		var->metadata->fini(var->metadata, &var->u);
+		var->metadata->fini(var->metadata, &var->u, allocator);
 		var->metadata = NULL;
 	}
 }
@@ -172,3 +237,153 @@ const struct eu_metadata eu_variant_metadata = {
 	variant_to_double,
 	variant_to_integer,
 };
+
+/* Parse a lazy value with *epp, creating it if it is NULL and
+   otherwise resetting it, so that a series of values can be
+   materialized with one parse. */
+static int materialize(struct eu_variant *variant, struct eu_parse **epp)
+{
+	struct lazy *lazy = (struct lazy *)&variant->u;
+	struct eu_variant result;
+	struct eu_parse *ep = *epp;
+
+	/* The outermost value of a parse is never lazy, so this
+	   parses one level of it */
+	if (ep) {
+		eu_parse_reset(ep, eu_variant_value(&result));
+	}
+	else {
+		ep = *epp = eu_parse_create(eu_variant_value(&result));
+		if (!ep)
+			return 0;
+	}
+
+	eu_parse_set_options(ep, lazy->options);
+	if (!eu_parse(ep, lazy->json, lazy->len) || !eu_parse_finish(ep)) {
+		/* The parse still refers to result, so it can't be
+		   reused */
+		eu_parse_destroy(ep);
+		*epp = NULL;
+		return 0;
+	}
+
+	*variant = result;
+	return 1;
+}
+
+static __inline__ int is_lazy(const struct eu_metadata *md)
+{
+	return md == &lazy_object_metadata || md == &lazy_array_metadata;
+}
+
+int eu_variant_materialize(struct eu_variant *variant)
+{
+	struct eu_parse *ep = NULL;
+	int ok;
+
+	if (likely(!is_lazy(variant->metadata)))
+		return 1;
+
+	ok = materialize(variant, &ep);
+	if (ep)
+		eu_parse_destroy(ep);
+
+	return ok;
+}
+
+static struct eu_variant *lazy_variant(void *value)
+{
+	return container_of(value, struct eu_variant, u);
+}
+
+int eu_value_materialize(struct eu_value val, struct eu_parse **ep)
+{
+	struct eu_variant *var;
+
+	if (val.metadata == &eu_variant_metadata)
+		var = val.value;
+	else if (is_lazy(val.metadata))
+		var = lazy_variant(val.value);
+	else
+		return 1;
+
+	return !is_lazy(var->metadata) || materialize(var, ep);
+}
+
+static enum eu_result lazy_parse(const struct eu_metadata *metadata,
+				 struct eu_parse *ep, void *result)
+{
+	(void)metadata;
+	(void)ep;
+	(void)result;
+	return EU_ERROR;
+}
+
+static enum eu_result lazy_generate(const struct eu_metadata *metadata,
+				    struct eu_generate *eg, void *value)
+{
+	struct eu_variant *var = lazy_variant(value);
+
+	/* Lazy values nested within this one share its parse */
+	if (!eu_value_materialize(eu_value(value, metadata),
+				  &eg->materialize))
+		return EU_ERROR;
+
+	return var->metadata->generate(var->metadata, eg, &var->u);
+}
+
+static struct eu_value lazy_get(struct eu_value val,
+				struct eu_string_ref name)
+{
+	struct eu_variant *var = lazy_variant(val.value);
+
+	if (!eu_variant_materialize(var))
+		return eu_value_none;
+
+	return eu_value_get(peek(var), name);
+}
+
+static int lazy_object_iter_init(struct eu_value val,
+				 struct eu_object_iter *iter)
+{
+	struct eu_variant *var = lazy_variant(val.value);
+
+	return eu_variant_materialize(var)
+		&& eu_object_iter_init(iter, peek(var));
+}
+
+static size_t lazy_object_size(struct eu_value val)
+{
+	struct eu_variant *var = lazy_variant(val.value);
+
+	if (!eu_variant_materialize(var))
+		return 0;
+
+	return eu_object_size(peek(var));
+}
+
+static const struct eu_metadata lazy_object_metadata = {
+	EU_JSON_OBJECT,
+	sizeof(struct lazy),
+	lazy_parse,
+	lazy_generate,
+	eu_noop_fini,
+	lazy_get,
+	lazy_object_iter_init,
+	lazy_object_size,
+	eu_to_double_fail,
+	eu_to_integer_fail,
+};
+
+static const struct eu_metadata lazy_array_metadata = {
+	EU_JSON_ARRAY,
+	sizeof(struct lazy),
+	lazy_parse,
+	lazy_generate,
+	eu_noop_fini,
+	lazy_get,
+	eu_object_iter_init_fail,
+	eu_object_size_fail,
+	eu_to_double_fail,
+	eu_to_integer_fail,
+};
@@ -3,14 +3,15 @@ PROJECT_CFLAGS:=-I$(SROOT)include -D_GNU_SOURCE
 # The euphemus library source files
 LIB_SRCS=$(addprefix lib/,euphemus.c stack.c parse.c generate.c path.c \
 	struct.c array.c string.c variant.c number.c bool.c null.c unescape.c \
-	escape.c)
+	escape.c scan.c arena.c powers_of_5.c powers_of_10.c \
+	skip.c ndjson.c)
 
 SRCS+=$(LIB_SRCS) schemac/schemac.c schemac/schema_schema.c
 SRCS+=$(addprefix test/,test.c test_codegen.c test_schema.c test_common.c \
-	util.c test_parse.c)
+	util.c test_parse.c deep_perf.c)
 
 # Main exectuables that get built
-EXECUTABLES=schemac/schemac test/test_parse
+EXECUTABLES=schemac/schemac test/test_parse test/deep_perf
 
 # parse_perf requires json-c to build
 ifneq "$(wildcard /usr/include/json/json.h)" ""
@@ -19,6 +20,10 @@ EXECUTABLES+=test/parse_perf
 HDROBJS_/usr/include/json/json.h:=-ljson
 endif
 
+# ndjson.c uses threads
+HDROBJS_/usr/include/pthread.h:=-pthread
+OBJNEEDS_-pthread:=
+
 # Test executables that get built
 TEST_EXECUTABLES=test/test test/test_codegen
 
@@ -37,7 +42,7 @@ $(foreach E,$(EXECUTABLES) $(TEST_EXECUTABLES),$(eval MAINOBJ_$(ROOT)$(E):=$(ROO
 # Even with .DELETE_ON_ERROR, make will only delete one of the
 # targets, hence the 'rm' here.
 $(ROOT)test/test_schema.c $(ROOT)test/test_schema.h: $(ROOT)test/test_schema.json $(ROOT)schemac/schemac
-	$(ROOT)schemac/schemac -c $(ROOT)test/test_schema.c -i $(ROOT)test/test_schema.h $< || (rm -f $(ROOT)test/test_schema.c $(ROOT)test/test_schema.h ; false)
+	$(ROOT)schemac/schemac -S -c $(ROOT)test/test_schema.c -i $(ROOT)test/test_schema.h $< || (rm -f $(ROOT)test/test_schema.c $(ROOT)test/test_schema.h ; false)
 
 # Because this is generated, it starts with HDROBJS_$(ROOT), not HDROBJS_$(SROOT)
 HDROBJS_$(ROOT)test/test_schema.h:=$(ROOT)test/test_schema.o
@@ -10,18 +10,26 @@ static const struct eu_struct_member_descriptor_v1 named_schemas_members[0] = {
 const struct eu_metadata *struct_named_schemas_metadata_ptr;
 const struct eu_metadata *struct_named_schemas_ptr_metadata_ptr;
 
-const struct eu_struct_descriptor_v1 struct_named_schemas_descriptor = {
-	{ &struct_named_schemas_metadata_ptr, EU_TDESC_STRUCT_V1 },
-	{ &struct_named_schemas_ptr_metadata_ptr, EU_TDESC_STRUCT_PTR_V1 },
-	sizeof(struct named_schemas),
-	offsetof(struct named_schemas, extras),
-	sizeof(struct struct_schema_member),
-	offsetof(struct struct_schema_member, value),
-	sizeof(named_schemas_members) / sizeof(struct eu_struct_member_descriptor_v1),
-	named_schemas_members,
-	&struct_schema_descriptor.struct_base
+const struct eu_struct_descriptor_v2 struct_named_schemas_descriptor = {
+	{
+		{ &struct_named_schemas_metadata_ptr, EU_TDESC_STRUCT_V2 },
+		{ &struct_named_schemas_ptr_metadata_ptr, EU_TDESC_STRUCT_PTR_V2 },
+		sizeof(struct named_schemas),
+		offsetof(struct named_schemas, extras),
+		sizeof(struct struct_schema_member),
+		offsetof(struct struct_schema_member, value),
+		sizeof(named_schemas_members) / sizeof(struct eu_struct_member_descriptor_v1),
+		named_schemas_members,
+		&struct_schema_descriptor.v1.struct_base
+	},
+	NULL
 };
 
+void named_schemas_init(struct named_schemas *p)
+{
+	memset(p, 0, sizeof *p);
+}
+
 void named_schemas_fini(struct named_schemas *p)
 {
 	if (p->extras.len)
@@ -36,7 +44,7 @@ void named_schemas_destroy(struct named_schemas *p)
 	}
 }
 
-static const struct eu_struct_member_descriptor_v1 schema_members[8] = {
+static const struct eu_struct_member_descriptor_v1 schema_members[12] = {
 	{
 		offsetof(struct schema, ref),
 		4,
@@ -49,7 +57,7 @@ static const struct eu_struct_member_descriptor_v1 schema_members[8] = {
 		11,
 		-1, 0,
 		"definitions",
-		&struct_named_schemas_descriptor.struct_ptr_base
+		&struct_named_schemas_descriptor.v1.struct_ptr_base
 	},
 	{
 		offsetof(struct schema, type),
@@ -70,21 +78,35 @@ static const struct eu_struct_member_descriptor_v1 schema_members[8] = {
 		10,
 		-1, 0,
 		"properties",
-		&struct_named_schemas_descriptor.struct_ptr_base
+		&struct_named_schemas_descriptor.v1.struct_ptr_base
 	},
 	{
 		offsetof(struct schema, additionalProperties),
 		20,
 		-1, 0,
 		"additionalProperties",
-		&struct_schema_descriptor.struct_ptr_base
+		&eu_variant_descriptor
 	},
 	{
 		offsetof(struct schema, additionalItems),
 		15,
 		-1, 0,
 		"additionalItems",
-		&struct_schema_descriptor.struct_ptr_base
+		&struct_schema_descriptor.v1.struct_ptr_base
+	},
+	{
+		offsetof(struct schema, minItems),
+		8,
+		0 / CHAR_BIT, 1 << (0 % CHAR_BIT),
+		"minItems",
+		&eu_integer_descriptor
+	},
+	{
+		offsetof(struct schema, maxItems),
+		8,
+		1 / CHAR_BIT, 1 << (1 % CHAR_BIT),
+		"maxItems",
+		&eu_integer_descriptor
 	},
 	{
 		offsetof(struct schema, euphemusStructName),
@@ -93,23 +115,121 @@ static const struct eu_struct_member_descriptor_v1 schema_members[8] = {
 		"euphemusStructName",
 		&eu_string_descriptor
 	},
+	{
+		offsetof(struct schema, euphemusExpectedItems),
+		21,
+		2 / CHAR_BIT, 1 << (2 % CHAR_BIT),
+		"euphemusExpectedItems",
+		&eu_integer_descriptor
+	},
+	{
+		offsetof(struct schema, euphemusChunked),
+		15,
+		3 / CHAR_BIT, 1 << (3 % CHAR_BIT),
+		"euphemusChunked",
+		&eu_bool_descriptor
+	},
 };
 
+static int schema_recognize_member(const char *name, size_t len)
+{
+	switch (len) {
+	case 4:
+		switch ((unsigned char)name[0]) {
+		case 36:
+			if (!memcmp(name, "$ref", 4))
+				return 0;
+			break;
+		case 't':
+			if (!memcmp(name, "type", 4))
+				return 2;
+			break;
+		}
+		break;
+
+	case 5:
+		if (!memcmp(name, "title", 5))
+			return 3;
+		break;
+
+	case 8:
+		switch ((unsigned char)name[1]) {
+		case 'a':
+			if (!memcmp(name, "maxItems", 8))
+				return 8;
+			break;
+		case 'i':
+			if (!memcmp(name, "minItems", 8))
+				return 7;
+			break;
+		}
+		break;
+
+	case 10:
+		if (!memcmp(name, "properties", 10))
+			return 4;
+		break;
+
+	case 11:
+		if (!memcmp(name, "definitions", 11))
+			return 1;
+		break;
+
+	case 15:
+		switch ((unsigned char)name[0]) {
+		case 'a':
+			if (!memcmp(name, "additionalItems", 15))
+				return 6;
+			break;
+		case 'e':
+			if (!memcmp(name, "euphemusChunked", 15))
+				return 11;
+			break;
+		}
+		break;
+
+	case 18:
+		if (!memcmp(name, "euphemusStructName", 18))
+			return 9;
+		break;
+
+	case 20:
+		if (!memcmp(name, "additionalProperties", 20))
+			return 5;
+		break;
+
+	case 21:
+		if (!memcmp(name, "euphemusExpectedItems", 21))
+			return 10;
+		break;
+	}
+
+	return -1;
+}
+
 const struct eu_metadata *struct_schema_metadata_ptr;
 const struct eu_metadata *struct_schema_ptr_metadata_ptr;
 
-const struct eu_struct_descriptor_v1 struct_schema_descriptor = {
-	{ &struct_schema_metadata_ptr, EU_TDESC_STRUCT_V1 },
-	{ &struct_schema_ptr_metadata_ptr, EU_TDESC_STRUCT_PTR_V1 },
-	sizeof(struct schema),
-	offsetof(struct schema, extras),
-	sizeof(struct eu_variant_member),
-	offsetof(struct eu_variant_member, value),
-	sizeof(schema_members) / sizeof(struct eu_struct_member_descriptor_v1),
-	schema_members,
-	&eu_variant_descriptor
+const struct eu_struct_descriptor_v2 struct_schema_descriptor = {
+	{
+		{ &struct_schema_metadata_ptr, EU_TDESC_STRUCT_V2 },
+		{ &struct_schema_ptr_metadata_ptr, EU_TDESC_STRUCT_PTR_V2 },
+		sizeof(struct schema),
+		offsetof(struct schema, extras),
+		sizeof(struct eu_variant_member),
+		offsetof(struct eu_variant_member, value),
+		sizeof(schema_members) / sizeof(struct eu_struct_member_descriptor_v1),
+		schema_members,
+		&eu_variant_descriptor
+	},
+	schema_recognize_member
 };
 
+void schema_init(struct schema *p)
+{
+	memset(p, 0, sizeof *p);
+}
+
 void schema_fini(struct schema *p)
 {
 	eu_string_fini(&p->ref);
@@ -117,7 +237,7 @@ void schema_fini(struct schema *p)
 	eu_string_fini(&p->type);
 	eu_string_fini(&p->title);
 	if (p->properties) named_schemas_destroy(p->properties);
-	if (p->additionalProperties) schema_destroy(p->additionalProperties);
+	eu_variant_fini(&p->additionalProperties);
 	if (p->additionalItems) schema_destroy(p->additionalItems);
 	eu_string_fini(&p->euphemusStructName);
 	if (p->extras.len)
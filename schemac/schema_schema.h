@@ -19,24 +19,31 @@ struct named_schemas {
 
 extern const struct eu_metadata *struct_named_schemas_metadata_ptr;
 extern const struct eu_metadata *struct_named_schemas_ptr_metadata_ptr;
-extern const struct eu_struct_descriptor_v1 struct_named_schemas_descriptor;
+extern const struct eu_struct_descriptor_v2 struct_named_schemas_descriptor;
 
 static __inline__ const struct eu_metadata *struct_named_schemas_metadata(void)
 {
-	if (struct_named_schemas_metadata_ptr)
-		return struct_named_schemas_metadata_ptr;
+	const struct eu_metadata *md
+		= __atomic_load_n(&struct_named_schemas_metadata_ptr, __ATOMIC_ACQUIRE);
+
+	if (md)
+		return md;
 	else
-		return eu_introduce(&struct_named_schemas_descriptor.struct_base);
+		return eu_introduce(&struct_named_schemas_descriptor.v1.struct_base);
 }
 
 static __inline__ const struct eu_metadata *struct_named_schemas_ptr_metadata(void)
 {
-	if (struct_named_schemas_ptr_metadata_ptr)
-		return struct_named_schemas_ptr_metadata_ptr;
+	const struct eu_metadata *md
+		= __atomic_load_n(&struct_named_schemas_ptr_metadata_ptr, __ATOMIC_ACQUIRE);
+
+	if (md)
+		return md;
 	else
-		return eu_introduce(&struct_named_schemas_descriptor.struct_ptr_base);
+		return eu_introduce(&struct_named_schemas_descriptor.v1.struct_ptr_base);
 }
 
+void named_schemas_init(struct named_schemas *p);
 void named_schemas_fini(struct named_schemas *p);
 void named_schemas_destroy(struct named_schemas *p);
 
@@ -68,37 +75,49 @@ struct eu_variant_members {
 #endif
 
 struct schema {
+	unsigned char presence_bits[(4 - 1) / CHAR_BIT + 1];
 	struct eu_string ref;
 	struct named_schemas *definitions;
 	struct eu_string type;
 	struct eu_string title;
 	struct named_schemas *properties;
-	struct schema *additionalProperties;
+	struct eu_variant additionalProperties;
 	struct schema *additionalItems;
+	eu_integer_t minItems;
+	eu_integer_t maxItems;
 	struct eu_string euphemusStructName;
+	eu_integer_t euphemusExpectedItems;
+	eu_bool_t euphemusChunked;
 	struct eu_variant_members extras;
 };
 
 extern const struct eu_metadata *struct_schema_metadata_ptr;
 extern const struct eu_metadata *struct_schema_ptr_metadata_ptr;
-extern const struct eu_struct_descriptor_v1 struct_schema_descriptor;
+extern const struct eu_struct_descriptor_v2 struct_schema_descriptor;
 
 static __inline__ const struct eu_metadata *struct_schema_metadata(void)
 {
-	if (struct_schema_metadata_ptr)
-		return struct_schema_metadata_ptr;
+	const struct eu_metadata *md
+		= __atomic_load_n(&struct_schema_metadata_ptr, __ATOMIC_ACQUIRE);
+
+	if (md)
+		return md;
 	else
-		return eu_introduce(&struct_schema_descriptor.struct_base);
+		return eu_introduce(&struct_schema_descriptor.v1.struct_base);
 }
 
 static __inline__ const struct eu_metadata *struct_schema_ptr_metadata(void)
 {
-	if (struct_schema_ptr_metadata_ptr)
-		return struct_schema_ptr_metadata_ptr;
+	const struct eu_metadata *md
+		= __atomic_load_n(&struct_schema_ptr_metadata_ptr, __ATOMIC_ACQUIRE);
+
+	if (md)
+		return md;
 	else
-		return eu_introduce(&struct_schema_descriptor.struct_ptr_base);
+		return eu_introduce(&struct_schema_descriptor.v1.struct_ptr_base);
 }
 
+void schema_init(struct schema *p);
 void schema_fini(struct schema *p);
 void schema_destroy(struct schema *p);
 
@@ -112,6 +131,54 @@ static __inline__ struct eu_value schema_to_eu_value(struct schema *p)
 	return eu_value(p, struct_schema_metadata());
 }
 
+static __inline__ void schema_set_minItems_present(struct schema *p, int present) {
+	if (present)
+		p->presence_bits[0 / CHAR_BIT] |= 1 << (0 % CHAR_BIT);
+	else
+		p->presence_bits[0 / CHAR_BIT] &= ~(1 << (0 % CHAR_BIT));
+}
+
+static __inline__ void schema_set_minItems(struct schema *p, eu_integer_t val) {
+	p->minItems = val;
+	schema_set_minItems_present(p, 1);
+}
+
+static __inline__ void schema_set_maxItems_present(struct schema *p, int present) {
+	if (present)
+		p->presence_bits[1 / CHAR_BIT] |= 1 << (1 % CHAR_BIT);
+	else
+		p->presence_bits[1 / CHAR_BIT] &= ~(1 << (1 % CHAR_BIT));
+}
+
+static __inline__ void schema_set_maxItems(struct schema *p, eu_integer_t val) {
+	p->maxItems = val;
+	schema_set_maxItems_present(p, 1);
+}
+
+static __inline__ void schema_set_euphemusExpectedItems_present(struct schema *p, int present) {
+	if (present)
+		p->presence_bits[2 / CHAR_BIT] |= 1 << (2 % CHAR_BIT);
+	else
+		p->presence_bits[2 / CHAR_BIT] &= ~(1 << (2 % CHAR_BIT));
+}
+
+static __inline__ void schema_set_euphemusExpectedItems(struct schema *p, eu_integer_t val) {
+	p->euphemusExpectedItems = val;
+	schema_set_euphemusExpectedItems_present(p, 1);
+}
+
+static __inline__ void schema_set_euphemusChunked_present(struct schema *p, int present) {
+	if (present)
+		p->presence_bits[3 / CHAR_BIT] |= 1 << (3 % CHAR_BIT);
+	else
+		p->presence_bits[3 / CHAR_BIT] &= ~(1 << (3 % CHAR_BIT));
+}
+
+static __inline__ void schema_set_euphemusChunked(struct schema *p, eu_bool_t val) {
+	p->euphemusChunked = val;
+	schema_set_euphemusChunked_present(p, 1);
+}
+
 #ifndef STRUCT_SCHEMA_MEMBERS_DEFINED
 #define STRUCT_SCHEMA_MEMBERS_DEFINED
 
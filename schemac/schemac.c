@@ -34,6 +34,15 @@ static void *xalloc(size_t s)
         die("malloc(%ld) failed", (long)s);
 }
 
+static void *xrealloc(void *p, size_t s)
+{
+	void *res = realloc(p, s);
+	if (res)
+		return res;
+
+	die("realloc(%ld) failed", (long)s);
+}
+
 static char *xsprintf(const char *fmt, ...)
 	__attribute__ ((format (printf, 1, 2)));
 
@@ -96,6 +105,9 @@ struct definition {
 
 struct codegen {
 	int inline_funcs;
+
+	/* Generate schema-specialized parse functions */
+	int specialize;
 	int error_count;
 
 	const char *source_path;
@@ -106,6 +118,9 @@ struct codegen {
 	FILE *h_out;
 	struct type_info *type_infos_to_destroy;
 
+	/* Schemas converted from variants by variant_to_schema */
+	struct converted_schema *converted_schemas;
+
 	struct definition *defs;
 	size_t n_defs;
 
@@ -391,11 +406,13 @@ static char *remove_extension(const char *path)
 static void codegen_init(struct codegen *codegen, const char *source_path)
 {
 	codegen->inline_funcs = 1;
+	codegen->specialize = 0;
 	codegen->error_count = 0;
 	codegen->source_path = source_path;
 	codegen->c_out_path = codegen->h_out_path = NULL;
 	codegen->c_out = codegen->h_out = NULL;
 	codegen->type_infos_to_destroy = NULL;
+	codegen->converted_schemas = NULL;
 	codegen->defs = NULL;
 	codegen->n_defs = 0;
 
@@ -411,9 +428,15 @@ static void codegen_init(struct codegen *codegen, const char *source_path)
 		= make_builtin_type(codegen, "struct eu_variant", "eu_variant");
 }
 
+struct converted_schema {
+	struct schema schema;
+	struct converted_schema *next;
+};
+
 static void codegen_fini(struct codegen *codegen)
 {
 	struct type_info *ti, *next;
+	struct converted_schema *cs, *next_cs;
 
 	for (ti = codegen->type_infos_to_destroy; ti;) {
 		next = ti->next_to_destroy;
@@ -421,6 +444,12 @@ static void codegen_fini(struct codegen *codegen)
 		ti = next;
 	}
 
+	for (cs = codegen->converted_schemas; cs; cs = next_cs) {
+		next_cs = cs->next;
+		schema_fini(&cs->schema);
+		free(cs);
+	}
+
 	free(codegen->defs);
 
 	free(codegen->c_out_path);
@@ -506,9 +535,20 @@ struct struct_type_info {
 
 	struct type_info *extras_type;
 
+	/* Unknown members are skipped, due to "additionalProperties":
+	   false */
+	int closed;
+
 	char *metadata_func_name;
 	char *ptr_metadata_func_name;
 	char *descriptor_name;
+
+	/* The C expression for the eu_struct_descriptor_v1 within the
+	   descriptor */
+	char *descriptor_v1_expr;
+
+	/* The name of the specialized parse function, or NULL */
+	char *parse_func_name;
 };
 
 static struct type_info_ops struct_type_info_ops;
@@ -542,8 +582,19 @@ static struct type_info *alloc_struct(struct schema *schema,
 	sti->descriptor_name
 		= xsprintf("struct_%.*s_descriptor",
 			   (int)sti->struct_name.len, sti->struct_name.chars);
+	sti->descriptor_v1_expr
+		= xsprintf(codegen->specialize ? "%s.v2.v1" : "%s.v1",
+			   sti->descriptor_name);
+
+	sti->parse_func_name = NULL;
+	if (codegen->specialize)
+		sti->parse_func_name
+			= xsprintf("%.*s_parse_specialized",
+				   (int)sti->struct_name.len,
+				   sti->struct_name.chars);
 
 	sti->extras_type = NULL;
+	sti->closed = 0;
 	sti->members = NULL;
 	sti->members_len = 0;
 
@@ -560,13 +611,63 @@ static struct type_info *alloc_struct(struct schema *schema,
 			   (int)sti->struct_name.len, sti->struct_name.chars);
 
 	sti->base.descriptor_ptr_expr[REQUIRED]
-		= xsprintf("&%s.struct_base", sti->descriptor_name);
+		= xsprintf("&%s.struct_base", sti->descriptor_v1_expr);
 	sti->base.descriptor_ptr_expr[OPTIONAL]
-		= xsprintf("&%s.struct_ptr_base", sti->descriptor_name);
+		= xsprintf("&%s.struct_ptr_base", sti->descriptor_v1_expr);
 
 	return &sti->base;
 }
 
+/* additionalProperties can be a boolean rather than a schema, so the
+   schema of schemas declares it as a variant.  We convert a schema
+   held in a variant by generating it as JSON and parsing that.  The
+   converted schemas live as long as the codegen. */
+static struct schema *variant_to_schema(struct codegen *codegen,
+					struct eu_variant *var)
+{
+	struct converted_schema *cs;
+	struct eu_generate *eg;
+	struct eu_parse *parse;
+	char *buf = NULL;
+	size_t len = 0, capacity = 0;
+	int ok;
+
+	eg = eu_generate_create(eu_variant_value(var));
+	if (!eg)
+		die("eu_generate_create failed");
+
+	do {
+		capacity = capacity ? capacity * 2 : 1000;
+		buf = xrealloc(buf, capacity);
+		len += eu_generate(eg, buf + len, capacity - len);
+	} while (len == capacity);
+
+	ok = eu_generate_ok(eg);
+	eu_generate_destroy(eg);
+
+	cs = xalloc(sizeof *cs);
+	if (ok) {
+		parse = eu_parse_create(schema_to_eu_value(&cs->schema));
+		if (!parse)
+			die("eu_parse_create failed");
+
+		ok = eu_parse(parse, buf, len) && eu_parse_finish(parse);
+		eu_parse_destroy(parse);
+	}
+
+	if (!ok) {
+		codegen_error(codegen, "bad schema");
+		free(cs);
+		free(buf);
+		return NULL;
+	}
+
+	free(buf);
+	cs->next = codegen->converted_schemas;
+	codegen->converted_schemas = cs;
+	return &cs->schema;
+}
+
 /* Convert a JSON string to one that is a valid C identifier. */
 static char *sanitize_name(struct eu_string_ref name)
 {
@@ -609,10 +710,21 @@ static void struct_fill(struct type_info *ti, struct codegen *codegen,
 		}
 	}
 
-	if (schema->additionalProperties)
-		sti->extras_type = resolve_type(codegen,
-						schema->additionalProperties,
-						eu_string_ref_null);
+	if (!schema->additionalProperties.metadata)
+		return;
+
+	if (eu_value_type(eu_variant_value(&schema->additionalProperties))
+							== EU_JSON_BOOL) {
+		sti->closed = !schema->additionalProperties.u.bool;
+	}
+	else {
+		struct schema *extras_schema
+			= variant_to_schema(codegen,
+					    &schema->additionalProperties);
+		if (extras_schema)
+			sti->extras_type = resolve_type(codegen, extras_schema,
+							eu_string_ref_null);
+	}
 }
 
 static void emit_inlinish_func_decl(struct codegen *codegen, const char *fmt,
@@ -744,6 +856,313 @@ static void print_escaped(FILE *out, struct eu_string_ref str)
 	}
 }
 
+/* Member name recognizers.  We switch on the length of the name, and
+   then on the byte position that best distinguishes the members of
+   that length, before confirming the match with memcmp. */
+
+static int compare_members_by_len(const void *a, const void *b)
+{
+	const struct member_info *ma = *(const struct member_info **)a;
+	const struct member_info *mb = *(const struct member_info **)b;
+
+	if (ma->json_name.len != mb->json_name.len)
+		return ma->json_name.len < mb->json_name.len ? -1 : 1;
+
+	return ma < mb ? -1 : ma > mb;
+}
+
+static size_t recognizer_switch_pos;
+
+static int compare_members_by_byte(const void *a, const void *b)
+{
+	const struct member_info *ma = *(const struct member_info **)a;
+	const struct member_info *mb = *(const struct member_info **)b;
+	unsigned char ca = ma->json_name.chars[recognizer_switch_pos];
+	unsigned char cb = mb->json_name.chars[recognizer_switch_pos];
+
+	if (ca != cb)
+		return ca < cb ? -1 : 1;
+
+	return ma < mb ? -1 : ma > mb;
+}
+
+/* Find the byte position with the most distinct values among a group
+   of members with names of the same length. */
+static size_t best_switch_pos(struct member_info **group, size_t n)
+{
+	size_t len = group[0]->json_name.len;
+	size_t pos, best_pos = 0, best_count = 0;
+
+	for (pos = 0; pos < len; pos++) {
+		char seen[256];
+		size_t i, count = 0;
+
+		memset(seen, 0, sizeof seen);
+		for (i = 0; i < n; i++) {
+			unsigned char c = group[i]->json_name.chars[pos];
+			if (!seen[c]) {
+				seen[c] = 1;
+				count++;
+			}
+		}
+
+		if (count > best_count) {
+			best_count = count;
+			best_pos = pos;
+		}
+	}
+
+	return best_pos;
+}
+
+static void recognizer_match(struct struct_type_info *sti,
+			     struct member_info *mi, FILE *out,
+			     const char *indent)
+{
+	fprintf(out, "%sif (!memcmp(name, \"", indent);
+	print_escaped(out, mi->json_name);
+	fprintf(out, "\", %d))\n%s\treturn %d;\n",
+		(int)mi->json_name.len, indent, (int)(mi - sti->members));
+}
+
+/* Emits the recognizer function, and returns its name, or NULL if the
+   struct has no members. */
+static char *struct_define_recognizer(struct struct_type_info *sti,
+				      struct codegen *codegen)
+{
+	FILE *out = codegen->c_out;
+	struct member_info **sorted;
+	char *name;
+	size_t i, j, k;
+
+	if (!sti->members_len)
+		return NULL;
+
+	name = xsprintf("%.*s_recognize_member",
+			(int)sti->struct_name.len, sti->struct_name.chars);
+
+	sorted = xalloc(sti->members_len * sizeof *sorted);
+	for (i = 0; i < sti->members_len; i++)
+		sorted[i] = &sti->members[i];
+
+	qsort(sorted, sti->members_len, sizeof *sorted,
+	      compare_members_by_len);
+
+	fprintf(out,
+		"static int %s(const char *name, size_t len)\n"
+		"{\n"
+		"\tswitch (len) {\n",
+		name);
+
+	for (i = 0; i < sti->members_len; i = j) {
+		size_t len = sorted[i]->json_name.len;
+
+		for (j = i + 1;
+		     j < sti->members_len && sorted[j]->json_name.len == len;
+		     j++);
+
+		fprintf(out, "%s\tcase %d:\n", i ? "\n" : "", (int)len);
+
+		if (len == 0) {
+			fprintf(out, "\t\treturn %d;\n",
+				(int)(sorted[i] - sti->members));
+			continue;
+		}
+
+		if (j - i == 1) {
+			recognizer_match(sti, sorted[i], out, "\t\t");
+			fprintf(out, "\t\tbreak;\n");
+			continue;
+		}
+
+		recognizer_switch_pos = best_switch_pos(sorted + i, j - i);
+		qsort(sorted + i, j - i, sizeof *sorted,
+		      compare_members_by_byte);
+
+		fprintf(out, "\t\tswitch ((unsigned char)name[%d]) {\n",
+			(int)recognizer_switch_pos);
+
+		for (k = i; k < j; k++) {
+			unsigned char c
+			      = sorted[k]->json_name.chars[recognizer_switch_pos];
+
+			if (k == i || c != (unsigned char)sorted[k - 1]
+					->json_name.chars[recognizer_switch_pos]) {
+				if (isalnum(c))
+					fprintf(out, "\t\tcase '%c':\n", c);
+				else
+					fprintf(out, "\t\tcase %d:\n", c);
+			}
+
+			recognizer_match(sti, sorted[k], out, "\t\t\t");
+
+			if (k + 1 == j || c != (unsigned char)sorted[k + 1]
+					->json_name.chars[recognizer_switch_pos])
+				fprintf(out, "\t\t\tbreak;\n");
+		}
+
+		fprintf(out,
+			"\t\t}\n"
+			"\t\tbreak;\n");
+	}
+
+	fprintf(out, "\t}\n\n");
+
+	/* If all the names are empty, we never look at them */
+	if (!sorted[sti->members_len - 1]->json_name.len)
+		fprintf(out, "\t(void)name;\n");
+
+	fprintf(out,
+		"\treturn -1;\n"
+		"}\n\n");
+
+	free(sorted);
+	return name;
+}
+
+/* Specialized parse functions.  These parse an object directly from
+   the input buffer, calling the parse functions for members directly,
+   and recording in *point how far they got in case they stop short.
+   See eu_struct_descriptor_v3. */
+
+static void specialized_parse_member(struct member_info *mi, int index,
+				     struct codegen *codegen)
+{
+	FILE *out = codegen->c_out;
+	struct type_info *ti = mi->type;
+	const char *value_func = NULL;
+
+	/* Members without presence bits are present if their first
+	   field (a pointer) is set, as it is even for empty strings
+	   and arrays.  Leave repeated members to the general
+	   parser. */
+	if (ti->no_presence_bit)
+		fprintf(out,
+			"\t\t\tif (*(void **)&result->%s)\n"
+			"\t\t\t\treturn NULL;\n\n",
+			mi->c_name);
+
+	fprintf(out, "\t\t\tpoint->member = %d;\n", index);
+
+	if (ti == codegen->string_type)
+		value_func = "eu_parse_string_value";
+	else if (ti == codegen->integer_type)
+		value_func = "eu_parse_integer_value";
+	else if (ti == codegen->number_type)
+		value_func = "eu_parse_double_value";
+	else if (ti == codegen->bool_type)
+		value_func = "eu_parse_bool_value";
+
+	if (value_func)
+		fprintf(out, "\t\t\tp = %s(ep, p, end, &result->%s);\n",
+			value_func, mi->c_name);
+	else
+		fprintf(out,
+			"\t\t\tp = eu_parse_value(ep, p, end, %s,\n"
+			"\t\t\t\t\t   &result->%s);\n",
+			ti->descriptor_ptr_expr[OPTIONAL], mi->c_name);
+}
+
+static void struct_define_specialized_parse(struct struct_type_info *sti,
+					    struct codegen *codegen,
+					    const char *recognizer_name)
+{
+	FILE *out = codegen->c_out;
+	const char *indent = recognizer_name ? "\t\t" : "\t";
+	size_t i;
+	int presence_count;
+
+	fprintf(codegen->h_out,
+		"const char *%s(struct eu_parse *ep, const char *p,\n"
+		"\t\tconst char *end, void *result,\n"
+		"\t\tstruct eu_struct_parse_point *point);\n",
+		sti->parse_func_name);
+
+	fprintf(out,
+		"const char *%s(struct eu_parse *ep, const char *p,\n"
+		"\t\tconst char *end, void *v_result,\n"
+		"\t\tstruct eu_struct_parse_point *point)\n"
+		"{\n"
+		"\tstruct %.*s *result = v_result;\n"
+		"\tconst char *name, *name_end;\n\n"
+		"\tp = eu_skip_whitespace(p + 1, end);\n"
+		"\tif (p == end)\n"
+		"\t\treturn NULL;\n\n"
+		"\tif (*p == '}')\n"
+		"\t\treturn p + 1;\n\n"
+		"\tfor (;;) {\n"
+		"\t\tif (*p != '\\\"')\n"
+		"\t\t\treturn NULL;\n\n"
+		"\t\tname = p + 1;\n"
+		"\t\tname_end = eu_scan_member_name(name, end);\n"
+		"\t\tif (!name_end)\n"
+		"\t\t\treturn NULL;\n\n"
+		"\t\tp = eu_skip_whitespace(name_end + 1, end);\n"
+		"\t\tif (p == end || *p != ':')\n"
+		"\t\t\treturn NULL;\n\n"
+		"\t\tp = eu_skip_whitespace(p + 1, end);\n"
+		"\t\tif (p == end)\n"
+		"\t\t\treturn NULL;\n\n",
+		sti->parse_func_name,
+		(int)sti->struct_name.len, sti->struct_name.chars);
+
+	if (recognizer_name) {
+		fprintf(out, "\t\tswitch (%s(name, name_end - name)) {\n",
+			recognizer_name);
+
+		for (i = 0, presence_count = 0; i < sti->members_len; i++) {
+			struct member_info *mi = &sti->members[i];
+
+			fprintf(out, "\t\tcase %d:\n", (int)i);
+
+			/* Leave repeated members to the general
+			   parser */
+			if (!mi->type->no_presence_bit) {
+				fprintf(out,
+		    "\t\t\tif (result->presence_bits[%d / CHAR_BIT] & (1 << (%d %% CHAR_BIT)))\n"
+		    "\t\t\t\treturn NULL;\n\n"
+		    "\t\t\tresult->presence_bits[%d / CHAR_BIT] |= 1 << (%d %% CHAR_BIT);\n",
+					presence_count, presence_count,
+					presence_count, presence_count);
+				presence_count++;
+			}
+
+			specialized_parse_member(mi, (int)i, codegen);
+			fprintf(out, "\t\t\tbreak;\n\n");
+		}
+
+		fprintf(out, "\t\tdefault:\n");
+	}
+
+	fprintf(out,
+		"%s\tp = eu_parse_extra_member(ep, p, end, %s(), result,\n"
+		"%s\t\t\t\t      name, name_end);\n",
+		indent, sti->metadata_func_name, indent);
+
+	if (recognizer_name)
+		fprintf(out,
+			"\t\t\tbreak;\n"
+			"\t\t}\n");
+
+	fprintf(out,
+		"\n"
+		"\t\tif (!p)\n"
+		"\t\t\treturn NULL;\n\n"
+		"\t\tpoint->p = p;\n"
+		"\t\tp = eu_skip_whitespace(p, end);\n"
+		"\t\tif (p == end)\n"
+		"\t\t\treturn NULL;\n\n"
+		"\t\tif (*p == '}')\n"
+		"\t\t\treturn p + 1;\n\n"
+		"\t\tif (*p != ',')\n"
+		"\t\t\treturn NULL;\n\n"
+		"\t\tp = eu_skip_whitespace(p + 1, end);\n"
+		"\t\tif (p == end)\n"
+		"\t\t\treturn NULL;\n"
+		"\t}\n"
+		"}\n\n");
+}
+
 static void struct_define(struct type_info *ti, struct codegen *codegen)
 {
 	struct struct_type_info *sti = (void *)ti;
@@ -751,6 +1170,9 @@ static void struct_define(struct type_info *ti, struct codegen *codegen)
 	int presence_count;
 	struct type_info *extras_type;
 	char *metadata_ptr_name, *ptr_metadata_ptr_name;
+	char *recognizer_name;
+	const char *indent;
+	int version;
 
 	/* The definitions of any types used in this struct. */
 	for (i = 0; i < sti->members_len; i++) {
@@ -832,17 +1254,23 @@ static void struct_define(struct type_info *ti, struct codegen *codegen)
 
 	fprintf(codegen->c_out, "};\n\n");
 
+	recognizer_name = struct_define_recognizer(sti, codegen);
+
 	metadata_ptr_name = xsprintf("struct_%.*s_metadata_ptr",
 			      (int)sti->struct_name.len, sti->struct_name.chars);
 	ptr_metadata_ptr_name = xsprintf("struct_%.*s_ptr_metadata_ptr",
 			      (int)sti->struct_name.len, sti->struct_name.chars);
 
+	if (codegen->specialize)
+		struct_define_specialized_parse(sti, codegen, recognizer_name);
+
 	fprintf(codegen->h_out,
 		"extern const struct eu_metadata *%s;\n"
 		"extern const struct eu_metadata *%s;\n"
-		"extern const struct eu_struct_descriptor_v1 %s;\n\n",
+		"extern const struct eu_struct_descriptor_%s %s;\n\n",
 		metadata_ptr_name,
 		ptr_metadata_ptr_name,
+		codegen->specialize ? "v3" : "v2",
 		sti->descriptor_name);
 
 	fprintf(codegen->c_out,
@@ -851,52 +1279,83 @@ static void struct_define(struct type_info *ti, struct codegen *codegen)
 		metadata_ptr_name,
 		ptr_metadata_ptr_name);
 
+	/* The v3 descriptor wraps the v2 descriptor, so needs an
+	   extra level of indentation */
+	indent = codegen->specialize ? "\t" : "";
+	version = codegen->specialize ? 3 : 2;
+
 	fprintf(codegen->c_out,
-		"const struct eu_struct_descriptor_v1 %s = {\n"
-		"\t{ &%s, EU_TDESC_STRUCT_V1 },\n"
-		"\t{ &%s, EU_TDESC_STRUCT_PTR_V1 },\n"
-		"\tsizeof(struct %.*s),\n"
-		"\toffsetof(struct %.*s, extras),\n"
-		"\tsizeof(struct %s),\n"
-		"\toffsetof(struct %s, value),\n"
-		"\tsizeof(%.*s_members) / sizeof(struct eu_struct_member_descriptor_v1),\n"
-		"\t%.*s_members,\n"
-		"\t%s\n"
-		"};\n\n",
-		sti->descriptor_name,
-		metadata_ptr_name,
-		ptr_metadata_ptr_name,
-		(int)sti->struct_name.len, sti->struct_name.chars,
-		(int)sti->struct_name.len, sti->struct_name.chars,
-		extras_type->member_struct_name,
-		extras_type->member_struct_name,
-		(int)sti->struct_name.len, sti->struct_name.chars,
-		(int)sti->struct_name.len, sti->struct_name.chars,
-		extras_type->descriptor_ptr_expr[REQUIRED]);
+		"const struct eu_struct_descriptor_v%d %s = {\n",
+		version, sti->descriptor_name);
+
+	if (codegen->specialize)
+		fprintf(codegen->c_out, "\t{\n");
+
+	fprintf(codegen->c_out,
+		"%s\t{\n"
+		"%s\t\t{ &%s, EU_TDESC_STRUCT_V%d },\n"
+		"%s\t\t{ &%s, EU_TDESC_STRUCT_PTR_V%d },\n"
+		"%s\t\tsizeof(struct %.*s),\n"
+		"%s\t\toffsetof(struct %.*s, extras),\n"
+		"%s\t\tsizeof(struct %s),\n"
+		"%s\t\toffsetof(struct %s, value),\n"
+		"%s\t\tsizeof(%.*s_members) / sizeof(struct eu_struct_member_descriptor_v1),\n"
+		"%s\t\t%.*s_members,\n"
+		"%s\t\t%s\n"
+		"%s\t},\n"
+		"%s\t%s\n",
+		indent,
+		indent, metadata_ptr_name, version,
+		indent, ptr_metadata_ptr_name, version,
+		indent, (int)sti->struct_name.len, sti->struct_name.chars,
+		indent, (int)sti->struct_name.len, sti->struct_name.chars,
+		indent, extras_type->member_struct_name,
+		indent, extras_type->member_struct_name,
+		indent, (int)sti->struct_name.len, sti->struct_name.chars,
+		indent, (int)sti->struct_name.len, sti->struct_name.chars,
+		indent, sti->closed
+				? "NULL"
+				: extras_type->descriptor_ptr_expr[REQUIRED],
+		indent,
+		indent, recognizer_name ? recognizer_name : "NULL");
+
+	if (codegen->specialize)
+		fprintf(codegen->c_out,
+			"\t},\n"
+			"\t%s\n",
+			sti->parse_func_name);
+
+	fprintf(codegen->c_out, "};\n\n");
+
+	free(recognizer_name);
 
 	fprintf(codegen->h_out,
 		"static __inline__ const struct eu_metadata *%s(void)\n"
 		"{\n"
-		"\tif (%s)\n"
-		"\t\treturn %s;\n"
+		"\tconst struct eu_metadata *md\n"
+		"\t\t= __atomic_load_n(&%s, __ATOMIC_ACQUIRE);\n\n"
+		"\tif (md)\n"
+		"\t\treturn md;\n"
 		"\telse\n"
 		"\t\treturn eu_introduce(&%s.struct_base);\n"
 		"}\n\n",
 		sti->metadata_func_name,
-		metadata_ptr_name, metadata_ptr_name,
-		sti->descriptor_name);
+		metadata_ptr_name,
+		sti->descriptor_v1_expr);
 
 	fprintf(codegen->h_out,
 		"static __inline__ const struct eu_metadata *%s(void)\n"
 		"{\n"
-		"\tif (%s)\n"
-		"\t\treturn %s;\n"
+		"\tconst struct eu_metadata *md\n"
+		"\t\t= __atomic_load_n(&%s, __ATOMIC_ACQUIRE);\n\n"
+		"\tif (md)\n"
+		"\t\treturn md;\n"
 		"\telse\n"
 		"\t\treturn eu_introduce(&%s.struct_ptr_base);\n"
 		"}\n\n",
 		sti->ptr_metadata_func_name,
-		ptr_metadata_ptr_name, ptr_metadata_ptr_name,
-		sti->descriptor_name);
+		ptr_metadata_ptr_name,
+		sti->descriptor_v1_expr);
 
 	free(metadata_ptr_name);
 	free(ptr_metadata_ptr_name);
@@ -973,6 +1432,8 @@ static void struct_destroy(struct type_info *ti)
 	free(sti->metadata_func_name);
 	free(sti->ptr_metadata_func_name);
 	free(sti->descriptor_name);
+	free(sti->descriptor_v1_expr);
+	free(sti->parse_func_name);
 	free((void *)sti->base.base_name);
 	free(sti->members);
 	free(sti);
@@ -1003,6 +1464,14 @@ struct array_type_info {
 	char *metadata_func_name;
 	char *descriptor_name;
 	struct type_info *element_type;
+
+	/* Hints about the number of elements, or zero */
+	eu_integer_t min_items;
+	eu_integer_t max_items;
+	eu_integer_t expected_items;
+
+	/* Whether to use chunked storage */
+	eu_bool_t chunked;
 };
 
 static char *string_ref_to_cstr(struct eu_string_ref s)
@@ -1016,6 +1485,13 @@ static char *string_ref_to_cstr(struct eu_string_ref s)
 
 static struct type_info_ops array_type_info_ops;
 
+/* Whether the descriptor needs the eu_array_descriptor_v2 layout */
+static int array_descriptor_v2(struct array_type_info *ati)
+{
+	return ati->chunked || ati->min_items || ati->max_items
+		|| ati->expected_items;
+}
+
 static struct type_info *alloc_array(struct schema *schema,
 				     struct codegen *codegen,
 				     struct eu_string_ref name)
@@ -1024,6 +1500,11 @@ static struct type_info *alloc_array(struct schema *schema,
 	char *cname;
 
 	ati->element_type = NULL;
+	ati->min_items = schema->minItems > 0 ? schema->minItems : 0;
+	ati->max_items = schema->maxItems > 0 ? schema->maxItems : 0;
+	ati->expected_items = schema->euphemusExpectedItems > 0
+		? schema->euphemusExpectedItems : 0;
+	ati->chunked = schema->euphemusChunked;
 
 	if (!eu_string_ref_ok(name)) {
 		/* This is not safe, as it might be a reference to
@@ -1051,7 +1532,8 @@ static struct type_info *alloc_array(struct schema *schema,
 		= xsprintf("struct %s ", cname);
 	ati->base.descriptor_ptr_expr[REQUIRED]
 		= ati->base.descriptor_ptr_expr[OPTIONAL]
-		= xsprintf("&%s.base", ati->descriptor_name);
+		= xsprintf(array_descriptor_v2(ati) ? "&%s.v1.base" : "&%s.base",
+			   ati->descriptor_name);
 
 	return &ati->base;
 }
@@ -1066,10 +1548,69 @@ static void array_fill(struct type_info *ti, struct codegen *codegen,
 						 eu_string_ref_null);
 }
 
-static void array_define(struct type_info *ti, struct codegen *codegen)
+static void array_define_chunked(struct type_info *ti,
+				 struct codegen *codegen)
+{
+	struct array_type_info *ati = (void *)ti;
+	const char *el_type = ati->element_type->c_type_name[REQUIRED];
+
+	fprintf(codegen->h_out, "struct %s {\n", ti->base_name);
+	declare(ati->element_type, codegen->h_out, "**chunks", REQUIRED);
+	fprintf(codegen->h_out,
+		"\tsize_t len;\n\n"
+		"\tstruct {\n"
+		"\t\tsize_t capacity;\n"
+		"\t\tsize_t chunks_capacity;\n"
+		"\t\tunsigned int shift;\n"
+		"\t} priv;\n"
+		"};\n\n");
+
+	fprintf(codegen->h_out,
+		"static __inline__ %s*%s_at(struct %s *array, size_t i) {\n"
+		"\treturn eu_chunked_array_at((struct eu_chunked_array *)array,\n"
+		"\t                           sizeof(**array->chunks), i);\n"
+		"}\n\n",
+		el_type, ti->base_name, ti->base_name);
+
+	fprintf(codegen->h_out,
+		"static __inline__ %s*%s_push(struct %s *array) {\n"
+		"\t%s*el;\n\n"
+		"\tif (array->len < array->priv.capacity\n"
+		"\t    || eu_chunked_array_grow((struct eu_chunked_array *)array,\n"
+		"\t                             sizeof(**array->chunks))) {\n"
+		"\t\tel = %s_at(array, array->len++);\n"
+		"\t\tmemset(el, 0, sizeof *el);\n"
+		"\t\treturn el;\n"
+		"\t}\n"
+		"\telse {\n"
+		"\t\treturn NULL;\n"
+		"\t}\n"
+		"}\n\n",
+		el_type, ti->base_name, ti->base_name, el_type, ti->base_name);
+
+	fprintf(codegen->h_out,
+		"static __inline__ %s*%s_compact(struct %s *array,\n"
+		"                                 const struct eu_allocator *allocator) {\n"
+		"\treturn eu_chunked_array_compact((struct eu_chunked_array *)array,\n"
+		"\t                                sizeof(**array->chunks),\n"
+		"\t                                allocator);\n"
+		"}\n\n",
+		el_type, ti->base_name, ti->base_name);
+
+	fprintf(codegen->h_out,
+		"static __inline__ void %s_iter_init(struct eu_chunked_array_iter *iter,\n"
+		"                                    struct %s *array) {\n"
+		"\teu_chunked_array_iter_init(iter,\n"
+		"\t                           (struct eu_chunked_array *)array,\n"
+		"\t                           sizeof(**array->chunks));\n"
+		"}\n\n",
+		ti->base_name, ti->base_name);
+}
+
+static void array_define_contiguous(struct type_info *ti,
+				    struct codegen *codegen)
 {
 	struct array_type_info *ati = (void *)ti;
-	char *metadata_ptr_name;
 
 	fprintf(codegen->h_out, "struct %s {\n", ti->base_name);
 	declare(ati->element_type, codegen->h_out, "*a", REQUIRED);
@@ -1082,16 +1623,36 @@ static void array_define(struct type_info *ti, struct codegen *codegen)
 
 	fprintf(codegen->h_out,
 		"static __inline__ %s*%s_push(struct %s *array) {\n"
+		"\t%s*el;\n\n"
 		"\tif (array->len < array->priv.capacity\n"
 		"\t    || eu_array_grow((struct eu_array *)array,\n"
-		"\t                     sizeof(*array->a)))\n"
-		"\t\treturn array->a + array->len++;\n"
-		"\telse\n"
+		"\t                     sizeof(*array->a))) {\n"
+		"\t\tel = array->a + array->len++;\n"
+		"\t\tmemset(el, 0, sizeof *el);\n"
+		"\t\treturn el;\n"
+		"\t}\n"
+		"\telse {\n"
 		"\t\treturn NULL;\n"
-		"\t}\n\n",
+		"\t}\n"
+		"}\n\n",
 		ati->element_type->c_type_name[REQUIRED],
 		ti->base_name,
-		ti->base_name);
+		ti->base_name,
+		ati->element_type->c_type_name[REQUIRED]);
+}
+
+static void array_define(struct type_info *ti, struct codegen *codegen)
+{
+	struct array_type_info *ati = (void *)ti;
+	char *metadata_ptr_name;
+
+	/* The inline functions need the element type to be complete */
+	define_type(ati->element_type, codegen);
+
+	if (ati->chunked)
+		array_define_chunked(ti, codegen);
+	else
+		array_define_contiguous(ti, codegen);
 
 	/* Descriptor definition */
 
@@ -1099,32 +1660,57 @@ static void array_define(struct type_info *ti, struct codegen *codegen)
 
 	fprintf(codegen->h_out,
 		"extern const struct eu_metadata *%s;\n"
-		"extern const struct eu_array_descriptor_v1 %s;\n\n",
+		"extern const struct eu_array_descriptor_v%d %s;\n\n",
 		metadata_ptr_name,
+		array_descriptor_v2(ati) ? 2 : 1,
 		ati->descriptor_name);
 
-	fprintf(codegen->c_out,
-		"const struct eu_metadata *%s;\n\n"
-		"const struct eu_array_descriptor_v1 %s = {\n"
-		"\t{ &%s, EU_TDESC_ARRAY_V1 },\n"
-		"\t%s\n"
-		"};\n\n",
-		metadata_ptr_name,
-		ati->descriptor_name,
-		metadata_ptr_name,
-		ati->element_type->descriptor_ptr_expr[REQUIRED]);
+	if (array_descriptor_v2(ati))
+		fprintf(codegen->c_out,
+			"const struct eu_metadata *%s;\n\n"
+			"const struct eu_array_descriptor_v2 %s = {\n"
+			"\t{\n"
+			"\t\t{ &%s, %s },\n"
+			"\t\t%s\n"
+			"\t},\n"
+			"\t%ld,\n"
+			"\t%ld,\n"
+			"\t%ld\n"
+			"};\n\n",
+			metadata_ptr_name,
+			ati->descriptor_name,
+			metadata_ptr_name,
+			ati->chunked ? "EU_TDESC_CHUNKED_ARRAY_V1"
+				     : "EU_TDESC_ARRAY_V2",
+			ati->element_type->descriptor_ptr_expr[REQUIRED],
+			(long)ati->min_items,
+			(long)ati->max_items,
+			(long)ati->expected_items);
+	else
+		fprintf(codegen->c_out,
+			"const struct eu_metadata *%s;\n\n"
+			"const struct eu_array_descriptor_v1 %s = {\n"
+			"\t{ &%s, EU_TDESC_ARRAY_V1 },\n"
+			"\t%s\n"
+			"};\n\n",
+			metadata_ptr_name,
+			ati->descriptor_name,
+			metadata_ptr_name,
+			ati->element_type->descriptor_ptr_expr[REQUIRED]);
 
 	fprintf(codegen->h_out,
 		"static __inline__ const struct eu_metadata *%s(void)\n"
 		"{\n"
-		"\tif (%s)\n"
-		"\t\treturn %s;\n"
+		"\tconst struct eu_metadata *md\n"
+		"\t\t= __atomic_load_n(&%s, __ATOMIC_ACQUIRE);\n\n"
+		"\tif (md)\n"
+		"\t\treturn md;\n"
 		"\telse\n"
-		"\t\treturn eu_introduce(&%s.base);\n"
+		"\t\treturn eu_introduce(%s);\n"
 		"}\n\n",
 		ati->metadata_func_name,
-		metadata_ptr_name, metadata_ptr_name,
-		ati->descriptor_name);
+		metadata_ptr_name,
+		ti->descriptor_ptr_expr[REQUIRED]);
 
 	free(metadata_ptr_name);
 }
@@ -1202,7 +1788,7 @@ static int is_empty_schema(struct schema *schema)
 {
 	return !schema->ref.chars
 		&& !schema->type.chars
-		&& !schema->additionalProperties
+		&& !schema->additionalProperties.metadata
 		&& !schema->euphemusStructName.chars
 		&& !schema->extras.len;
 }
@@ -1465,10 +2051,11 @@ static void parse_schema_file(struct codegen *codegen, struct eu_value dest)
 static void usage(char *cmd)
 {
 	fprintf(stderr,
-		"Usage: %s [ -c <path> ] [ -i <path> ] <JSON schema file>\n"
+		"Usage: %s [ -c <path> ] [ -i <path> ] [ -S ] <JSON schema file>\n"
 		"Options\n"
 		"\t-c\tSet the path at which to generate the C source file\n"
 		"\t-i\tSet the path at which to generate the H header file\n"
+		"\t-S\tGenerate schema-specialized parse functions\n"
 		"\t-h\tShow this message\n\n",
 		cmd);
 	exit(1);
@@ -1481,8 +2068,9 @@ int main(int argc, char **argv)
 	struct schema schema;
 	char *c_out_path = NULL;
 	char *h_out_path = NULL;
+	int specialize = 0;
 
-	while ((c = getopt(argc, argv, "c:i:h")) != -1) {
+	while ((c = getopt(argc, argv, "c:i:Sh")) != -1) {
 		switch (c) {
 		case 'c':
 			c_out_path = xstrdup(optarg);
@@ -1492,6 +2080,10 @@ int main(int argc, char **argv)
 			h_out_path = xstrdup(optarg);
 			break;
 
+		case 'S':
+			specialize = 1;
+			break;
+
 		case 'h':
 			usage(argv[0]);
 		}
@@ -1507,6 +2099,8 @@ int main(int argc, char **argv)
 	if (h_out_path)
 		codegen.h_out_path = h_out_path;
 
+	codegen.specialize = specialize;
+
 	parse_schema_file(&codegen, schema_to_eu_value(&schema));
 	if (!codegen.error_count) {
 		do_codegen(&codegen, &schema);
@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <euphemus.h>
+
+#include "test_common.h"
+
+/* Parse a deeply nested document fed in small chunks, as from a
+   network connection.  Every chunk boundary pauses the parse with
+   the whole depth of the document on the stack. */
+
+static char *make_deep(int depth, size_t *len_out)
+{
+	static const char open[] = "[{\"a\":";
+	static const char close[] = "}]";
+	size_t open_len = strlen(open), close_len = strlen(close);
+	size_t len = (open_len + close_len) * depth + 1;
+	char *json = malloc(len);
+	char *p = json;
+	int i;
+
+	if (!json)
+		return NULL;
+
+	for (i = 0; i < depth; i++, p += open_len)
+		memcpy(p, open, open_len);
+
+	*p++ = '1';
+
+	for (i = 0; i < depth; i++, p += close_len)
+		memcpy(p, close, close_len);
+
+	*len_out = len;
+	return json;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int parse_deep(const char *json, size_t len, size_t chunk)
+{
+	struct eu_parse *parse;
+	struct eu_variant var;
+	int ok;
+
+	parse = eu_parse_create(eu_variant_value(&var));
+	ok = parse_chunked(parse, json, len, chunk);
+	eu_parse_destroy(parse);
+	if (ok)
+		eu_variant_fini(&var);
+
+	return ok;
+}
+
+int main(int argc, char **argv)
+{
+	static const size_t chunks[] = { 1, 64 };
+	int depth = argc > 1 ? atoi(argv[1]) : 10000;
+	int iterations = argc > 2 ? atoi(argv[2]) : 10;
+	size_t len, c;
+	char *json;
+	int i;
+
+	if (argc > 3 || depth <= 0 || iterations <= 0) {
+		fprintf(stderr, "usage: %s [ depth [ iterations ] ]\n", argv[0]);
+		exit(1);
+	}
+
+	json = make_deep(depth, &len);
+	if (!json)
+		goto error;
+
+	for (c = 0; c < sizeof chunks / sizeof chunks[0]; c++) {
+		double start = now(), elapsed;
+
+		for (i = 0; i < iterations; i++)
+			if (!parse_deep(json, len, chunks[c]))
+				goto error;
+
+		elapsed = now() - start;
+		printf("depth %d, %lu-byte chunks: %.3f ms/parse, %.1f MB/s\n",
+		       depth, (unsigned long)chunks[c],
+		       elapsed * 1000 / iterations,
+		       len * (double)iterations / elapsed / 1e6);
+	}
+
+	free(json);
+	return 0;
+
+ error:
+	fprintf(stderr, "parse error\n");
+	return 1;
+}
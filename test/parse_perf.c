@@ -20,19 +20,25 @@ int main(int argc, char **argv)
 	json = read_file(argc == 2 ? argv[1] : NULL, &json_len);
 
 #if 1
-	for (i = 0; i < 10000; i++) {
+	{
 		struct eu_parse *parse;
 		struct eu_variant var;
 
+		/* Reuse one parse, as a worker handling many messages
+		   would. */
 		parse = eu_parse_create(eu_variant_value(&var));
-		if (!eu_parse(parse, json, json_len))
-			goto error;
+		for (i = 0; i < 10000; i++) {
+			eu_parse_reset(parse, eu_variant_value(&var));
+			if (!eu_parse(parse, json, json_len))
+				goto error;
 
-		if (!eu_parse_finish(parse))
-			goto error;
+			if (!eu_parse_finish(parse))
+				goto error;
+
+			eu_variant_fini(&var);
+		}
 
 		eu_parse_destroy(parse);
-		eu_variant_fini(&var);
 	}
 #else
 	for (i = 0; i < 10000; i++) {
@@ -1,4 +1,6 @@
 #include <string.h>
+#include <stdio.h>
+#include <pthread.h>
 
 #include <euphemus.h>
 
@@ -21,6 +23,144 @@ static void test_parse_string(void)
 		   eu_string_fini(&result));
 }
 
+static void test_parse_long_string(void)
+{
+	/* Long enough to exercise the vectorized scanning, with escapes
+	   at various alignments. */
+	TEST_PARSE("\"0123456789abcdefghijklmnopqrstuvwxyz0123456789ABCDEF"
+		   "\\n0123456789abcdefghijklmnopqrstuvwxyz0123456789\\\\"
+		   "\\\"0123456789abcdefghi\\u0041\"",
+		   struct eu_string,
+		   eu_string_value,
+		   require(eu_string_ref_equal(eu_string_to_ref(&result),
+		       eu_cstr("0123456789abcdefghijklmnopqrstuvwxyz0123456789ABCDEF"
+			       "\n0123456789abcdefghijklmnopqrstuvwxyz0123456789\\"
+			       "\"0123456789abcdefghiA"))),
+		   eu_string_fini(&result));
+}
+
+static void test_parse_whitespace(void)
+{
+	static const char ws_chars[] = " \t\n\r";
+	char ws[80];
+	char text[1000];
+	int len, i;
+
+	/* Runs of whitespace of various lengths, long enough to
+	   exercise the vectorized scanning. */
+	for (len = 0; len < 70; len++) {
+		for (i = 0; i < len; i++)
+			ws[i] = ws_chars[(i * 7 + len) % 4];
+
+		ws[len] = 0;
+
+		strcpy(text, ws);
+		strcat(text, "[");
+		strcat(text, ws);
+		strcat(text, "1");
+		strcat(text, ws);
+		strcat(text, ",");
+		strcat(text, ws);
+		strcat(text, "{\"a\"");
+		strcat(text, ws);
+		strcat(text, ":");
+		strcat(text, ws);
+		strcat(text, "true}");
+		strcat(text, ws);
+		strcat(text, "]");
+		strcat(text, ws);
+
+		TEST_PARSE(text, struct eu_variant, eu_variant_value,
+			   require(eu_value_type(eu_variant_value(&result))
+				   == EU_JSON_ARRAY);
+			   require(result.u.array.len == 2),
+			   eu_variant_fini(&result));
+	}
+}
+
+static void check_bad_string(const char *json)
+{
+	struct eu_parse *parse;
+	struct eu_string result;
+	size_t len = strlen(json);
+	size_t i;
+
+	parse = eu_parse_create(eu_string_value(&result));
+	require(!eu_parse(parse, json, len));
+	eu_parse_destroy(parse);
+
+	parse = eu_parse_create(eu_string_value(&result));
+	for (i = 0;; i++) {
+		char c;
+
+		require(i < len);
+		c = json[i];
+		if (!eu_parse(parse, &c, 1))
+			break;
+	}
+
+	eu_parse_destroy(parse);
+}
+
+static void test_parse_bad_string(void)
+{
+	/* Control characters must be escaped */
+	check_bad_string("\"0123456789abcdefghijklmnopqrstuvwxyz\n\"");
+	check_bad_string("\"\\n0123456789abcdefghijklmnopqrstuvwxyz\t\"");
+	check_bad_string("\"\\wrong\"");
+}
+
+static int points_into(struct eu_string_ref str, const char *buf, size_t len)
+{
+	return str.chars >= buf && str.chars + str.len <= buf + len;
+}
+
+static void test_parse_borrow_strings(void)
+{
+	const char *json = "{\"a\":\"plain\",\"b\":\"esc\\n\",\"c\":[\"x\"]}";
+	size_t len = strlen(json);
+	struct eu_parse *parse;
+	struct eu_variant var;
+	struct eu_value val;
+	struct eu_string_ref str;
+
+	parse = eu_parse_create(eu_variant_value(&var));
+	eu_parse_set_options(parse, EU_PARSE_BORROW_STRINGS);
+	require(eu_parse(parse, json, len));
+	require(eu_parse_finish(parse));
+	eu_parse_destroy(parse);
+
+	val = eu_variant_value(&var);
+	str = eu_value_to_string_ref(eu_value_get_cstr(val, "a"));
+	require(eu_string_ref_equal(str, eu_cstr("plain")));
+	require(points_into(str, json, len));
+
+	/* Strings that needed unescaping are owned */
+	str = eu_value_to_string_ref(eu_value_get_cstr(val, "b"));
+	require(eu_string_ref_equal(str, eu_cstr("esc\n")));
+	require(!points_into(str, json, len));
+
+	str = eu_value_to_string_ref(eu_get_path(val, eu_cstr("/c/0")));
+	require(eu_string_ref_equal(str, eu_cstr("x")));
+	require(points_into(str, json, len));
+	eu_variant_fini(&var);
+
+	/* As are strings split across eu_parse calls */
+	json = "\"split\"";
+	len = strlen(json);
+	parse = eu_parse_create(eu_variant_value(&var));
+	eu_parse_set_options(parse, EU_PARSE_BORROW_STRINGS);
+	require(eu_parse(parse, json, 3));
+	require(eu_parse(parse, json + 3, len - 3));
+	require(eu_parse_finish(parse));
+	eu_parse_destroy(parse);
+
+	str = eu_value_to_string_ref(eu_variant_value(&var));
+	require(eu_string_ref_equal(str, eu_cstr("split")));
+	require(!points_into(str, json, len));
+	eu_variant_fini(&var);
+}
+
 static void test_parse_number(void)
 {
 	TEST_PARSE("  123456789.0123456789e0  ",
@@ -57,6 +197,66 @@ static void test_parse_number(void)
 		   require(result == 1000000000000000000000000.0),);
 }
 
+/* Integers of every length, so that each digit count is seen by the
+   multi-digit conversion in the number parser. */
+static void test_parse_integers(void)
+{
+	char digits[20];
+	char text[50];
+	eu_integer_t expected = 0;
+	int len;
+
+	for (len = 1; len <= 18; len++) {
+		expected = expected * 10 + len % 10;
+		digits[len - 1] = '0' + len % 10;
+		digits[len] = 0;
+
+		TEST_PARSE(digits, eu_integer_t, eu_integer_value,
+			   require(result == expected),);
+
+		strcpy(text, "[-");
+		strcat(text, digits);
+		strcat(text, ",");
+		strcat(text, digits);
+		strcat(text, "]  ");
+		TEST_PARSE(text, struct eu_variant, eu_variant_value,
+			   require(eu_value_to_integer(eu_get_path(
+					eu_variant_value(&result),
+					eu_cstr("/0"))).value == -expected);
+			   require(eu_value_to_integer(eu_get_path(
+					eu_variant_value(&result),
+					eu_cstr("/1"))).value == expected),
+			   eu_variant_fini(&result));
+
+		if (len <= 15) {
+			strcpy(text, digits);
+			strcat(text, ".5e1          ");
+			TEST_PARSE(text, double, eu_double_value,
+				   require(result == expected * 10.0 + 5),);
+		}
+	}
+}
+
+static void test_parse_doubles(void)
+{
+	static const char *const cases[] = {
+		"0.1", "-0.0", "1e23", "1e-300", "4.9e-324", "2e-324", "1e-400",
+		"2.2250738585072011e-308", "2.2250738585072014e-308",
+		"1.7976931348623157e308", "9007199254740993.0",
+		"9007199254740992.5", "7.2057594037927933e16",
+		"123456789012345678901234.5", "0.000000000000000000000001", NULL
+	};
+	const char *const *c;
+
+	for (c = cases; *c; c++) {
+		double expected = strtod(*c, NULL);
+
+		TEST_PARSE(*c, double, eu_double_value,
+			   require(!memcmp(&result, &expected,
+					   sizeof result)),);
+	}
+}
+
 static void test_parse_number_truncated(void)
 {
 	struct eu_parse *parse;
@@ -132,6 +332,29 @@ static void test_parse_variant(void)
 		   eu_variant_fini(&result));
 }
 
+static void check_escaped_member_names(struct eu_variant *var)
+{
+	struct eu_value val = eu_get_path(eu_variant_value(var),
+					  eu_cstr("/0"));
+
+	val = eu_value_get_cstr(val, "gr\303\274n");
+	require(eu_value_type(val) == EU_JSON_OBJECT);
+	val = eu_value_get_cstr(val, "\344\270\255x");
+	require(eu_value_to_integer(val).value == 1);
+}
+
+/* Member names with \u escapes, within nested values, so that the
+   splits land inside the escapes with enclosing frames on the
+   stack */
+static void test_parse_escaped_member_names(void)
+{
+	TEST_PARSE("[{\"gr\\u00fcn\":{\"\\u4E2Dx\":1}}]",
+		   struct eu_variant,
+		   eu_variant_value,
+		   check_escaped_member_names(&result),
+		   eu_variant_fini(&result));
+}
+
 static void test_parse_deep(void)
 {
 	int depth = 100;
@@ -191,6 +414,182 @@ static void test_parse_deep(void)
 	free(s);
 }
 
+struct documents {
+	char buf[100];
+	size_t len;
+	int limit;
+};
+
+static int collect_document(struct eu_value value, void *data)
+{
+	struct documents *docs = data;
+	struct eu_generate *gen = eu_generate_create(value);
+
+	docs->len += eu_generate(gen, docs->buf + docs->len,
+				 sizeof docs->buf - docs->len - 1);
+	require(eu_generate_ok(gen));
+	eu_generate_destroy(gen);
+	docs->buf[docs->len++] = '|';
+
+	eu_variant_fini(value.value);
+	return --docs->limit != 0;
+}
+
+static void test_parse_multiple(void)
+{
+	const char *json = "{\"a\":1}\n[1,2]\n\"x\" 3 4\n{}{}true null\n-5";
+	const char *expect = "{\"a\":1}|[1,2]|\"x\"|3|4|{}|{}|true|null|-5|";
+	size_t len = strlen(json);
+	struct eu_parse *parse;
+	struct eu_variant var;
+	struct documents docs;
+	size_t chunk;
+
+	for (chunk = 1; chunk <= len; chunk++) {
+		docs.len = 0;
+		docs.limit = -1;
+		parse = eu_parse_create(eu_variant_value(&var));
+		eu_parse_set_document_callback(parse, collect_document, &docs);
+		require(parse_chunked(parse, json, len, chunk));
+		eu_parse_destroy(parse);
+		require(docs.len == strlen(expect));
+		require(!memcmp(docs.buf, expect, docs.len));
+	}
+
+	/* The stream can end with whitespace, or be empty */
+	docs.len = 0;
+	parse = eu_parse_create(eu_variant_value(&var));
+	eu_parse_set_document_callback(parse, collect_document, &docs);
+	require(eu_parse(parse, " ", 1));
+	require(eu_parse_finish(parse));
+	require(eu_parse(parse, "\n", 1));
+	require(eu_parse_finish(parse));
+	eu_parse_destroy(parse);
+	require(docs.len == 0);
+
+	/* But not with an incomplete document */
+	parse = eu_parse_create(eu_variant_value(&var));
+	eu_parse_set_document_callback(parse, collect_document, &docs);
+	require(eu_parse(parse, "1 [2", 4));
+	require(!eu_parse_finish(parse));
+	eu_parse_destroy(parse);
+
+	/* Errors in a later document are detected */
+	docs.len = 0;
+	parse = eu_parse_create(eu_variant_value(&var));
+	eu_parse_set_document_callback(parse, collect_document, &docs);
+	require(!eu_parse(parse, "1 ]", 3));
+	eu_parse_destroy(parse);
+	require(docs.len == 2);
+
+	/* The callback can stop the parse */
+	docs.len = 0;
+	docs.limit = 2;
+	parse = eu_parse_create(eu_variant_value(&var));
+	eu_parse_set_document_callback(parse, collect_document, &docs);
+	require(!eu_parse(parse, json, len));
+	require(!eu_parse_finish(parse));
+	eu_parse_destroy(parse);
+	require(docs.len == 14);
+}
+
+struct records {
+	const char *buf;
+	pthread_mutex_t lock;
+	long next;
+	long sum;
+	long limit;
+};
+
+static long record_number(struct eu_value value, size_t offset,
+			  const char *buf)
+{
+	struct eu_value n = eu_value_get_cstr(value, "n");
+	long i;
+
+	require(eu_value_to_integer(n).ok);
+	i = eu_value_to_integer(n).value;
+	require(atol(strchr(buf + offset, ':') + 1) == i);
+	eu_value_fini(value, &eu_default_allocator);
+	return i;
+}
+
+static int ordered_record(struct eu_value value, size_t offset, void *data)
+{
+	struct records *recs = data;
+
+	require(record_number(value, offset, recs->buf) == recs->next);
+	return ++recs->next != recs->limit;
+}
+
+static int unordered_record(struct eu_value value, size_t offset,
+			    void *data)
+{
+	struct records *recs = data;
+	long i = record_number(value, offset, recs->buf);
+
+	pthread_mutex_lock(&recs->lock);
+	recs->next++;
+	recs->sum += i;
+	pthread_mutex_unlock(&recs->lock);
+	return 1;
+}
+
+static void test_parse_ndjson(void)
+{
+	/* Enough records for several batches */
+	long count = 30000, i;
+	char *buf = malloc(count * 40), *p = buf;
+	const struct eu_metadata *md;
+	struct records recs;
+	struct eu_variant var;
+	unsigned int threads;
+
+	for (i = 0; i < count; i++) {
+		p += sprintf(p, "{\"n\":%ld,\"s\":\"x\"}%s", i,
+			     i % 3 == 0 ? "\r\n" : "\n");
+		if (i % 1000 == 0)
+			*p++ = '\n';
+	}
+
+	md = eu_variant_value(&var).metadata;
+	recs.buf = buf;
+	pthread_mutex_init(&recs.lock, NULL);
+
+	for (threads = 1; threads <= 4; threads++) {
+		recs.next = 0;
+		recs.limit = -1;
+		require(eu_parse_ndjson(md, buf, p - buf, threads,
+					EU_NDJSON_ORDERED, ordered_record,
+					&recs));
+		require(recs.next == count);
+
+		recs.next = recs.sum = 0;
+		require(eu_parse_ndjson(md, buf, p - buf, threads, 0,
+					unordered_record, &recs));
+		require(recs.next == count);
+		require(recs.sum == count * (count - 1) / 2);
+
+		/* The callback can stop it */
+		recs.next = 0;
+		recs.limit = count / 2;
+		require(!eu_parse_ndjson(md, buf, p - buf, threads,
+					 EU_NDJSON_ORDERED, ordered_record,
+					 &recs));
+		require(recs.next == count / 2);
+	}
+
+	/* A bad record */
+	*strchr(buf + count * 10, '{') = ']';
+	require(!eu_parse_ndjson(md, buf, p - buf, 4, EU_NDJSON_ORDERED,
+				 ordered_record, &recs));
+	require(!eu_parse_ndjson(md, buf, p - buf, 4, 0,
+				 unordered_record, &recs));
+
+	pthread_mutex_destroy(&recs.lock);
+	free(buf);
+}
+
 static void parse_variant(const char *json, struct eu_variant *var)
 {
 	struct eu_parse *parse;
@@ -243,6 +642,87 @@ static void test_path(void)
 	eu_variant_fini(&var);
 }
 
+static void parse_lazy_chunked(const char *json, size_t chunk,
+			       struct eu_variant *var)
+{
+	require(parse_with_options(eu_variant_value(var), json, chunk,
+				   EU_PARSE_LAZY, NULL));
+}
+
+static void test_parse_lazy(void)
+{
+	const char *json = "{\"a\":{\"b\":[1,{\"c\":\"]\\\"}\"}],"
+		"\"d\":\"[\\\\\"},\"e\":[[],{},[[\"x\"]]],\"f\":true}";
+	const char *bad = "{\"ok\":[1],\"bad\":[1,{\"x\":2]}}";
+	struct eu_variant var;
+	struct eu_value val;
+	struct eu_object_iter iter;
+	struct eu_variant_array *array;
+	struct eu_generate *gen;
+	char buf[100];
+	size_t chunk, len;
+	int members;
+
+	/* Whether the values are lazy or not depends on how the
+	   input gets split up, but it makes no difference to what is
+	   seen through the eu_value functions */
+	for (chunk = 1; chunk <= strlen(json); chunk++) {
+		parse_lazy_chunked(json, chunk, &var);
+		val = eu_variant_value(&var);
+		require(eu_value_type(val) == EU_JSON_OBJECT);
+		require(eu_object_size(val) == 3);
+
+		val = eu_get_path(eu_variant_value(&var), eu_cstr("/a/b/1/c"));
+		require(eu_string_ref_equal(eu_value_to_string_ref(val),
+					    eu_cstr("]\"}")));
+
+		val = eu_get_path(eu_variant_value(&var), eu_cstr("/e"));
+		require(eu_value_type(val) == EU_JSON_ARRAY);
+		array = (struct eu_variant_array *)eu_value_to_array(val);
+		require(array->len == 3);
+		val = eu_get_path(eu_variant_value(&array->a[2]),
+				  eu_cstr("/0/0"));
+		require(eu_string_ref_equal(eu_value_to_string_ref(val),
+					    eu_cstr("x")));
+
+		require(eu_object_iter_init(&iter,
+				eu_get_path(eu_variant_value(&var),
+					    eu_cstr("/a"))));
+		for (members = 0; eu_object_iter_next(&iter); members++);
+		eu_object_iter_fini(&iter);
+		require(members == 2);
+
+		/* Generating a partly materialized value */
+		gen = eu_generate_create(eu_variant_value(&var));
+		len = eu_generate(gen, buf, sizeof buf);
+		require(eu_generate_ok(gen));
+		eu_generate_destroy(gen);
+		require(len == strlen(json) && !memcmp(buf, json, len));
+
+		eu_variant_fini(&var);
+	}
+
+	/* Errors within a lazy value only show up on access */
+	parse_lazy_chunked("{\"ok\":[1],\"bad\":[1,,2]}", 100, &var);
+	val = eu_get_path(eu_variant_value(&var), eu_cstr("/ok/0"));
+	require(eu_value_to_double(val).value == 1);
+	require(!eu_value_ok(eu_get_path(eu_variant_value(&var),
+					 eu_cstr("/bad/0"))));
+	eu_variant_fini(&var);
+
+	/* But mismatched brackets fail the parse */
+	require(!parse_with_options(eu_variant_value(&var), bad, strlen(bad),
+				    EU_PARSE_LAZY, NULL));
+
+	/* eu_variant_materialize */
+	parse_lazy_chunked("[[1],[2,{}]]", 100, &var);
+	require(eu_variant_materialize(&var));
+	require(var.u.array.len == 2);
+	require(eu_variant_materialize(&var.u.array.a[1]));
+	require(var.u.array.a[1].u.array.len == 2);
+	eu_variant_fini(&var);
+}
+
 static void check_size(const char *json, size_t size)
 {
 	struct eu_variant var;
@@ -260,6 +740,346 @@ static void test_size(void)
 	check_size("{\"baz\":{},\"x\":\"y\"}", 2);
 }
 
+static void test_large_object(void)
+{
+	struct eu_object obj;
+	struct eu_variant var, *v;
+	struct eu_value val;
+	char name[16], *json, *p;
+	int i;
+
+	/* Enough members to use the hash index, and to grow it */
+	eu_object_init(&obj);
+	for (i = 0; i < 1000; i++) {
+		sprintf(name, "k%d", i);
+		require(v = eu_object_get(&obj, eu_cstr(name)));
+		eu_variant_assign_integer(v, i);
+	}
+
+	require(obj.members.len == 1000);
+	for (i = 0; i < 1000; i++) {
+		sprintf(name, "k%d", i);
+		require(v = eu_object_get(&obj, eu_cstr(name)));
+		require(v->u.integer == i);
+	}
+
+	require(!eu_value_ok(eu_value_get_cstr(eu_object_value(&obj), "k")));
+	require(obj.members.len == 1000);
+	eu_object_fini(&obj);
+
+	/* A parsed object, where a repeated member name finds the first
+	   occurrence */
+	json = p = malloc(100 * 16 + 20);
+	*p++ = '{';
+	for (i = 0; i < 100; i++)
+		p += sprintf(p, "\"k%d\":%d,", i, i);
+
+	strcpy(p, "\"k5\":-1}");
+	parse_variant(json, &var);
+	free(json);
+
+	for (i = 0; i < 100; i++) {
+		sprintf(name, "k%d", i);
+		val = eu_value_get_cstr(eu_variant_value(&var), name);
+		require(eu_value_to_integer(val).value == i);
+	}
+
+	require(eu_object_size(eu_variant_value(&var)) == 101);
+	eu_variant_fini(&var);
+}
+
+static void check_duplicate_members(const char *json, int members,
+				    struct eu_arena *arena, size_t chunk)
+{
+	struct eu_variant var;
+	struct eu_value val;
+	char name[16];
+	int i;
+
+	require(parse_with_options(eu_variant_value(&var), json, chunk,
+				   EU_PARSE_DUPLICATES_LAST, arena));
+	val = eu_variant_value(&var);
+	require(eu_object_size(val) == (size_t)members);
+	for (i = 0; i < members; i++) {
+		sprintf(name, "k%d", i);
+		require(eu_value_to_integer(eu_value_get_cstr(val, name)).value
+			== (i == 5 ? -2 : i));
+	}
+
+	if (!arena)
+		eu_variant_fini(&var);
+
+	require(parse_with_options(eu_variant_value(&var), json, chunk,
+				   EU_PARSE_DUPLICATES_FIRST, arena));
+	val = eu_variant_value(&var);
+	require(eu_object_size(val) == (size_t)members);
+	for (i = 0; i < members; i++) {
+		sprintf(name, "k%d", i);
+		require(eu_value_to_integer(eu_value_get_cstr(val, name)).value
+			== i);
+	}
+
+	if (!arena)
+		eu_variant_fini(&var);
+
+	require(!parse_with_options(eu_variant_value(&var), json, chunk,
+				    EU_PARSE_DUPLICATES_ERROR, arena));
+}
+
+static void test_duplicate_members(void)
+{
+	static const int sizes[] = { 6, 100 };
+	static const size_t chunks[] = { 1, 7, 10000 };
+	struct eu_arena *arena;
+	char *json, *p;
+	size_t s, c;
+	int i, a;
+
+	for (s = 0; s < sizeof sizes / sizeof sizes[0]; s++) {
+		/* The repeated values of k5 are structured, to check
+		   that they are skipped properly */
+		json = p = malloc(sizes[s] * 16 + 50);
+		*p++ = '{';
+		for (i = 0; i < sizes[s]; i++)
+			p += sprintf(p, "\"k%d\":%d,", i, i);
+
+		strcpy(p, "\"k5\":[{\"x\":\"]\"}],\"k5\":-2}");
+
+		for (a = 0; a < 2; a++) {
+			arena = a ? eu_arena_create() : NULL;
+			for (c = 0; c < sizeof chunks / sizeof chunks[0]; c++)
+				check_duplicate_members(json, sizes[s], arena,
+							chunks[c]);
+
+			if (arena)
+				eu_arena_destroy(arena);
+		}
+
+		free(json);
+	}
+}
+
+static void test_allocator(void)
+{
+	const char *json = "{\"a\":[\"b\",{\"c\":\"d\\n\"}],\"e\":1.5}";
+	size_t len = strlen(json);
+	long count = 0;
+	struct eu_allocator allocator = {
+		counting_alloc,
+		counting_realloc,
+		counting_free,
+		NULL
+	};
+	struct eu_parse *parse;
+	struct eu_generate *gen;
+	struct eu_arena *arena;
+	struct eu_variant var;
+	char buf[100];
+	size_t i;
+
+	allocator.user = &count;
+
+	/* Parse byte by byte, so that the stack gets used */
+	parse = eu_parse_create_with_allocator(eu_variant_value(&var),
+					       &allocator);
+	require(parse);
+	for (i = 0; i < len; i++)
+		require(eu_parse(parse, json + i, 1));
+
+	require(eu_parse_finish(parse));
+	eu_parse_destroy(parse);
+	require(count > 0);
+
+	gen = eu_generate_create_with_allocator(eu_variant_value(&var),
+						&allocator);
+	require(gen);
+	require(eu_generate(gen, buf, sizeof buf) == len);
+	require(eu_generate_ok(gen));
+	eu_generate_destroy(gen);
+	require(!memcmp(buf, json, len));
+
+	/* Members are added with the object's allocator */
+	require(eu_object_get(&var.u.object, eu_cstr("f")));
+	eu_value_fini(eu_variant_value(&var), &allocator);
+	require(count == 0);
+
+	/* EU_PARSE_LAZY is ignored, so everything comes from the
+	   parse's allocator */
+	parse = eu_parse_create_with_allocator(eu_variant_value(&var),
+					       &allocator);
+	require(parse);
+	eu_parse_set_options(parse, EU_PARSE_LAZY);
+	require(eu_parse(parse, json, len));
+	require(eu_parse_finish(parse));
+	eu_parse_destroy(parse);
+	require(eu_string_ref_equal(eu_value_to_string_ref(
+			eu_get_path(eu_variant_value(&var), eu_cstr("/a/1/c"))),
+				    eu_cstr("d\n")));
+	eu_value_fini(eu_variant_value(&var), &allocator);
+	require(count == 0);
+
+	/* Unfinished parses */
+	for (i = 0; i < len; i++) {
+		parse = eu_parse_create_with_allocator(eu_variant_value(&var),
+						       &allocator);
+		require(eu_parse(parse, json, i));
+		eu_parse_destroy(parse);
+		require(count == 0);
+	}
+
+	/* Arena chunks come from the arena's allocator */
+	arena = eu_arena_create_with_allocator(&allocator);
+	parse = eu_parse_create(eu_variant_value(&var));
+	eu_parse_set_arena(parse, arena);
+	require(eu_parse(parse, json, len));
+	require(eu_parse_finish(parse));
+	eu_parse_destroy(parse);
+	require(count > 0);
+
+	/* Members can be found but not added */
+	require(eu_object_get(&var.u.object, eu_cstr("e")));
+	require(!eu_object_get(&var.u.object, eu_cstr("f")));
+	eu_arena_destroy(arena);
+	require(count == 0);
+}
+
+static void *failing_alloc(void *user, size_t size)
+{
+	(void)user;
+	(void)size;
+	return NULL;
+}
+
+static void *failing_realloc(void *user, void *ptr, size_t size)
+{
+	(void)user;
+	(void)ptr;
+	(void)size;
+	return NULL;
+}
+
+static void test_reset(void)
+{
+	const char *json = "{\"a\":[\"b\",{\"c\":\"d\\n\"}],\"e\":1.5}";
+	size_t len = strlen(json);
+	long count = 0;
+	struct eu_allocator allocator = {
+		counting_alloc,
+		counting_realloc,
+		counting_free,
+		NULL
+	};
+	struct eu_parse *parse;
+	struct eu_generate *gen;
+	struct eu_arena *arena;
+	struct eu_variant var, var2;
+	char buf[100];
+	size_t i, j;
+	int k;
+
+	allocator.user = &count;
+
+	/* Resetting an unfinished parse cleans up the result */
+	parse = eu_parse_create_with_allocator(eu_variant_value(&var),
+					       &allocator);
+	require(parse);
+	require(eu_parse(parse, json, len / 2));
+	eu_parse_reset(parse, eu_variant_value(&var));
+	require(eu_parse(parse, json, len));
+	require(eu_parse_finish(parse));
+	eu_parse_destroy(parse);
+	eu_value_fini(eu_variant_value(&var), &allocator);
+	require(count == 0);
+
+	/* Parse the results into an arena, so that after warming up,
+	   the parse itself should not allocate. */
+	arena = eu_arena_create();
+	parse = eu_parse_create_with_allocator(eu_variant_value(&var),
+					       &allocator);
+	require(parse);
+	eu_parse_set_arena(parse, arena);
+	gen = eu_generate_create_with_allocator(eu_variant_value(&var),
+						&allocator);
+	require(gen);
+
+	for (k = 0; k < 6; k++) {
+		if (k == 3) {
+			allocator.alloc = failing_alloc;
+			allocator.realloc = failing_realloc;
+		}
+
+		eu_parse_reset(parse, eu_variant_value(&var));
+		for (i = 0; i < len; i++)
+			require(eu_parse(parse, json + i, 1));
+
+		require(eu_parse_finish(parse));
+
+		/* Generate into a small buffer, so that the stack
+		   gets used */
+		eu_generate_reset(gen, eu_variant_value(&var));
+		for (i = 0; i < len; i += j) {
+			j = eu_generate(gen, buf + i, 3);
+			require(j);
+		}
+
+		require(eu_generate(gen, buf + i, sizeof buf - i) == 0);
+		require(eu_generate_ok(gen));
+		require(!memcmp(buf, json, len));
+
+		/* An unfinished parse */
+		eu_parse_reset(parse, eu_variant_value(&var2));
+		require(eu_parse(parse, json, len - 1));
+	}
+
+	eu_parse_destroy(parse);
+	eu_generate_destroy(gen);
+	eu_arena_destroy(arena);
+	require(count == 0);
+}
+
+static const char *first_member_name(struct eu_variant *var)
+{
+	return var->u.object.members.members[0].name.chars;
+}
+
+static void test_interned_names(void)
+{
+	const char *json = "[{\"abc\":1},{\"abc\":2}]";
+	size_t len = strlen(json);
+	struct eu_parse *parse;
+	struct eu_variant var, var2;
+	struct eu_variant_array *a;
+	size_t i;
+
+	/* Repeated member names are shared, including when they are
+	   split between input buffers */
+	parse = eu_parse_create(eu_variant_value(&var));
+	for (i = 0; i < len; i++)
+		require(eu_parse(parse, json + i, 1));
+
+	require(eu_parse_finish(parse));
+
+	a = &var.u.array;
+	require(first_member_name(&a->a[0]) == first_member_name(&a->a[1]));
+
+	/* And across documents after a reset */
+	eu_parse_reset(parse, eu_variant_value(&var2));
+	require(eu_parse(parse, json, len));
+	require(eu_parse_finish(parse));
+	eu_parse_destroy(parse);
+
+	require(first_member_name(&a->a[0])
+		== first_member_name(&var2.u.array.a[0]));
+
+	/* A shared name outlives the objects that have been finished,
+	   and the parse */
+	eu_variant_assign_null(&a->a[0]);
+	eu_variant_fini(&var2);
+	require(eu_value_to_integer(eu_value_get_cstr(
+				eu_variant_value(&a->a[1]), "abc")).value == 2);
+	eu_variant_fini(&var);
+}
+
 static void test_gen_string(void)
 {
 	struct eu_string str;
@@ -302,6 +1122,81 @@ static void test_gen_number(void)
 
 	num = -1.234567891234567e-10;
 	test_gen(eu_double_value(&num), eu_cstr("-1.234567891234567e-10"));
+
+	/* Shortest round-trip representations */
+	num = 0.1;
+	test_gen(eu_double_value(&num), eu_cstr("0.1"));
+
+	num = 0.3;
+	test_gen(eu_double_value(&num), eu_cstr("0.3"));
+
+	num = -0.000001234;
+	test_gen(eu_double_value(&num), eu_cstr("-0.000001234"));
+
+	num = 1e-8;
+	test_gen(eu_double_value(&num), eu_cstr("1e-8"));
+
+	num = 5e-324;
+	test_gen(eu_double_value(&num), eu_cstr("5e-324"));
+
+	num = 1.7976931348623157e308;
+	test_gen(eu_double_value(&num), eu_cstr("1.7976931348623157e+308"));
+
+	num = 9223372036854775808.0;
+	test_gen(eu_double_value(&num), eu_cstr("9223372036854776000"));
+
+	num = 1e21;
+	test_gen(eu_double_value(&num), eu_cstr("1e+21"));
+
+	/* The longest fixed notation output */
+	num = -1.0000000000000001e-7;
+	test_gen(eu_double_value(&num),
+		 eu_cstr("-0.00000010000000000000001"));
+}
+
+static void test_gen_longest_double(void)
+{
+	/* Generating the longest double output into buffers of about
+	   that size must not overrun them. */
+	double num = -1.0000000000000001e-7;
+	struct eu_string_ref expected
+		= eu_cstr("-0.00000010000000000000001");
+	struct eu_generate *eg;
+	char out[32];
+	size_t size, len, total;
+	char *buf;
+
+	require(expected.len == 26);
+
+	for (size = expected.len - 2; size <= expected.len; size++) {
+		eg = eu_generate_create(eu_double_value(&num));
+		total = 0;
+		do {
+			buf = malloc(size);
+			len = eu_generate(eg, buf, size);
+			require(len <= size && total + len <= sizeof out);
+			memcpy(out + total, buf, len);
+			total += len;
+			free(buf);
+		} while (len);
+
+		require(eu_generate_ok(eg));
+		eu_generate_destroy(eg);
+		require(eu_string_ref_equal(eu_string_ref(out, total),
+					    expected));
+	}
+}
+
+static void test_gen_integer(void)
+{
+	eu_integer_t num = 7;
+	test_gen(eu_integer_value(&num), eu_cstr("7"));
+
+	num = -1234567890123;
+	test_gen(eu_integer_value(&num), eu_cstr("-1234567890123"));
+
+	num = -(eu_integer_t)9223372036854775807 - 1;
+	test_gen(eu_integer_value(&num), eu_cstr("-9223372036854775808"));
 }
 
 static void test_gen_variant(void)
@@ -385,20 +1280,37 @@ static void test_gen_array(void)
 int main(void)
 {
 	test_parse_string();
+	test_parse_long_string();
+	test_parse_bad_string();
+	test_parse_whitespace();
+	test_parse_borrow_strings();
 	test_parse_number();
+	test_parse_integers();
+	test_parse_doubles();
 	test_parse_number_truncated();
 	test_parse_bool();
 	test_parse_variant();
+	test_parse_escaped_member_names();
 	test_parse_deep();
+	test_parse_multiple();
+	test_parse_ndjson();
+	test_parse_lazy();
 	test_non_numbers();
 
 	test_path();
 	test_size();
+	test_large_object();
+	test_duplicate_members();
+	test_allocator();
+	test_reset();
+	test_interned_names();
 
 	test_gen_string();
 	test_gen_null();
 	test_gen_bool();
 	test_gen_number();
+	test_gen_longest_double();
+	test_gen_integer();
 	test_gen_variant();
 	test_gen_object();
 	test_gen_array();
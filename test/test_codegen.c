@@ -1,4 +1,6 @@
+#include <stdio.h>
 #include <string.h>
+#include <pthread.h>
 
 #include <euphemus.h>
 
@@ -6,6 +8,118 @@
 #include "test_schema.h"
 #include "test_parse_macro.h"
 
+#define INTRODUCE_THREADS 4
+#define INTRODUCE_DESCRIPTORS 4
+
+struct introduce_thread {
+	pthread_t tid;
+	unsigned int start;
+	const struct eu_metadata *md[INTRODUCE_DESCRIPTORS];
+};
+
+static const struct eu_type_descriptor *const
+introduce_descriptors[INTRODUCE_DESCRIPTORS + 1] = {
+	&struct_test_schema_descriptor.v2.v1.struct_base,
+	&struct_bar_array_descriptor.base,
+	&struct_bar_descriptor.v2.v1.struct_ptr_base,
+	&struct_wide_descriptor.v2.v1.struct_base,
+	NULL
+};
+
+static void *introduce_thread(void *v_it)
+{
+	struct introduce_thread *it = v_it;
+	unsigned int i, j;
+
+	/* Each thread starts at a different descriptor, so that they
+	   race over overlapping sets of metadata */
+	for (i = 0; i < INTRODUCE_DESCRIPTORS; i++) {
+		j = (it->start + i) % INTRODUCE_DESCRIPTORS;
+		it->md[j] = eu_introduce(introduce_descriptors[j]);
+	}
+
+	return NULL;
+}
+
+static void test_concurrent_introduce(void)
+{
+	struct introduce_thread threads[INTRODUCE_THREADS];
+	unsigned int i, j;
+
+	for (i = 0; i < INTRODUCE_THREADS; i++) {
+		threads[i].start = i;
+		require(!pthread_create(&threads[i].tid, NULL,
+					introduce_thread, &threads[i]));
+	}
+
+	for (i = 0; i < INTRODUCE_THREADS; i++)
+		require(!pthread_join(threads[i].tid, NULL));
+
+	/* Every thread got the published metadata */
+	for (i = 0; i < INTRODUCE_THREADS; i++)
+		for (j = 0; j < INTRODUCE_DESCRIPTORS; j++)
+			require(threads[i].md[j]
+				== *introduce_descriptors[j]->metadata);
+
+	require(eu_introduce_all(introduce_descriptors));
+}
+
+/* The generated accessors for types not reached by
+   test_concurrent_introduce, so they are introduced on first use */
+static const struct eu_metadata *(*const accessors[])(void) = {
+	struct_chunked_metadata,
+	record_array_metadata,
+	struct_record_ptr_metadata,
+	struct_closed_metadata,
+	struct_closed_ptr_metadata
+};
+
+#define ACCESSORS (sizeof accessors / sizeof accessors[0])
+
+struct accessor_thread {
+	pthread_t tid;
+	unsigned int start;
+	const struct eu_metadata *md[ACCESSORS];
+};
+
+static void *accessor_thread(void *v_at)
+{
+	struct accessor_thread *at = v_at;
+	unsigned int i, j;
+
+	for (i = 0; i < ACCESSORS; i++) {
+		j = (at->start + i) % ACCESSORS;
+		at->md[j] = accessors[j]();
+	}
+
+	return NULL;
+}
+
+static void test_concurrent_accessors(void)
+{
+	struct accessor_thread threads[INTRODUCE_THREADS];
+	unsigned int i, j;
+
+	for (i = 0; i < INTRODUCE_THREADS; i++) {
+		threads[i].start = i;
+		require(!pthread_create(&threads[i].tid, NULL,
+					accessor_thread, &threads[i]));
+	}
+
+	for (i = 0; i < INTRODUCE_THREADS; i++)
+		require(!pthread_join(threads[i].tid, NULL));
+
+	/* Every thread got the published metadata, and later calls
+	   return it too */
+	for (i = 0; i < INTRODUCE_THREADS; i++)
+		for (j = 0; j < ACCESSORS; j++)
+			require(threads[i].md[j] && threads[i].md[j]
+				== accessors[j]());
+
+	require(struct_record_metadata()
+		== struct_record_metadata_ptr);
+}
+
 static void check_test_schema(struct test_schema *test_schema)
 {
 	require(eu_string_ref_equal(eu_string_to_ref(&test_schema->str),
@@ -92,6 +206,222 @@ static void test_extras(void)
 		   test_schema_fini(&result));
 }
 
+static void check_wide(struct wide *wide, struct eu_value val)
+{
+	require(wide->alpha == 1);
+	require(wide->bravo == 2);
+	require(wide->charlie == 3);
+	require(wide->delta == 4);
+	require(wide->echo == 5);
+	require(wide->foxtrot == 6);
+	require(wide->golf == 7);
+	require(wide->hotel == 8);
+	require(wide->india == 9);
+	require(wide->juliett == 10);
+	require(wide->kilo == 11);
+	require(eu_string_ref_equal(eu_string_to_ref(&wide->lima),
+				   eu_cstr("twelve")));
+	require(eu_object_size(val) == 13);
+	require(eu_value_to_integer(eu_value_get_cstr(val, "kilo")).value
+		== 11);
+	require(eu_value_ok(eu_value_get_cstr(val, "zulu")));
+	require(!eu_value_ok(eu_value_get_cstr(val, "mike")));
+}
+
+static const char wide_json[]
+	= "{\"lima\":\"twelve\",\"alpha\":1,\"bravo\":2,\"charlie\":3,"
+	  "\"delta\":4,\"echo\":5,\"foxtrot\":6,\"zulu\":null,\"golf\":7,"
+	  "\"hotel\":8,\"india\":9,\"juliett\":10,\"kilo\":11}";
+
+static void test_wide_struct(void)
+{
+	TEST_PARSE(wide_json,
+		   struct wide,
+		   wide_to_eu_value,
+		   check_wide(&result, wide_to_eu_value(&result)),
+		   wide_fini(&result));
+}
+
+static void test_specialized_parse(void)
+{
+	struct wide wide;
+	struct eu_parse *parse;
+	struct eu_parse_stats stats;
+	size_t half = strlen(wide_json) / 2;
+
+	/* With the whole object available, the specialized parse
+	   function handles it without involving the generic parser. */
+	parse = eu_parse_create(wide_to_eu_value(&wide));
+	require(eu_parse(parse, wide_json, strlen(wide_json)));
+	require(eu_parse_finish(parse));
+	eu_parse_get_stats(parse, &stats);
+	eu_parse_destroy(parse);
+
+	require(stats.member_predict_hits + stats.member_predict_misses == 0);
+	check_wide(&wide, wide_to_eu_value(&wide));
+	wide_fini(&wide);
+
+	/* Otherwise, the generic parser takes over where it stopped,
+	   so it only sees the members after the split. */
+	parse = eu_parse_create(wide_to_eu_value(&wide));
+	require(eu_parse(parse, wide_json, half));
+	require(eu_parse(parse, wide_json + half, strlen(wide_json) - half));
+	require(eu_parse_finish(parse));
+	eu_parse_get_stats(parse, &stats);
+	eu_parse_destroy(parse);
+
+	require(stats.member_predict_hits + stats.member_predict_misses != 0);
+	require(stats.member_predict_hits + stats.member_predict_misses < 13);
+	check_wide(&wide, wide_to_eu_value(&wide));
+	wide_fini(&wide);
+}
+
+#define NESTED_BAR_DEPTH 20
+
+static void test_specialized_parse_nested(void)
+{
+	char buf[NESTED_BAR_DEPTH * 8 + 20];
+	char *p = buf;
+	struct bar bar;
+	struct bar *b;
+	struct eu_parse *parse;
+	struct eu_parse_stats stats;
+	size_t i, split;
+
+	for (i = 0; i < NESTED_BAR_DEPTH; i++) {
+		memcpy(p, "{\"bar\":", 7);
+		p += 7;
+	}
+
+	strcpy(p, "{\"str\":\"xyz\"}");
+	split = p - buf + 9;
+	p += strlen(p);
+	for (i = 0; i < NESTED_BAR_DEPTH; i++)
+		*p++ = '}';
+
+	/* Running out of input within the innermost string leaves the
+	   enclosing objects to be resumed, not parsed again. */
+	parse = eu_parse_create(bar_to_eu_value(&bar));
+	require(eu_parse(parse, buf, split));
+	require(eu_parse(parse, buf + split, p - buf - split));
+	require(eu_parse_finish(parse));
+	eu_parse_get_stats(parse, &stats);
+	eu_parse_destroy(parse);
+
+	require(stats.member_predict_hits + stats.member_predict_misses == 0);
+	for (i = 0, b = &bar; i < NESTED_BAR_DEPTH; i++)
+		b = b->bar;
+
+	require(b->str.len == 3 && !memcmp(b->str.chars, "xyz", 3));
+	bar_fini(&bar);
+
+	/* An error within the innermost object is reported directly. */
+	memcpy(buf + split - 8, "\"bar\":1", 7);
+	parse = eu_parse_create(bar_to_eu_value(&bar));
+	require(!eu_parse(parse, buf, p - buf));
+	eu_parse_get_stats(parse, &stats);
+	eu_parse_destroy(parse);
+
+	require(stats.member_predict_hits + stats.member_predict_misses == 0);
+}
+
+/* A V2 descriptor for struct wide, which lacks the specialized parse
+   function, so that the generic parser gets used with the member
+   recognizer. */
+static struct eu_struct_descriptor_v2 wide_v2_descriptor;
+static const struct eu_metadata *wide_v2_metadata_ptr;
+static const struct eu_metadata *wide_v2_ptr_metadata_ptr;
+
+static struct eu_value wide_v2_to_eu_value(struct wide *p)
+{
+	return eu_value(p, eu_introduce(&wide_v2_descriptor.v1.struct_base));
+}
+
+static void test_wide_struct_v2(void)
+{
+	wide_v2_descriptor = struct_wide_descriptor.v2;
+	wide_v2_descriptor.v1.struct_base.metadata = &wide_v2_metadata_ptr;
+	wide_v2_descriptor.v1.struct_base.kind = EU_TDESC_STRUCT_V2;
+	wide_v2_descriptor.v1.struct_ptr_base.metadata
+		= &wide_v2_ptr_metadata_ptr;
+	wide_v2_descriptor.v1.struct_ptr_base.kind = EU_TDESC_STRUCT_PTR_V2;
+
+	TEST_PARSE(wide_json,
+		   struct wide,
+		   wide_v2_to_eu_value,
+		   check_wide(&result, wide_v2_to_eu_value(&result)),
+		   eu_value_fini(wide_v2_to_eu_value(&result),
+				 &eu_default_allocator));
+}
+
+/* A V2 descriptor for struct wide of its own, so that its member
+   prediction only learns from test_member_prediction.  The
+   specialized parse function does not do prediction. */
+static struct eu_struct_descriptor_v2 prediction_descriptor;
+static const struct eu_metadata *prediction_metadata_ptr;
+static const struct eu_metadata *prediction_ptr_metadata_ptr;
+
+static void test_member_prediction(void)
+{
+	struct wide wide;
+	struct eu_parse *parse;
+	struct eu_parse_stats stats;
+	int i;
+
+	prediction_descriptor = struct_wide_descriptor.v2;
+	prediction_descriptor.v1.struct_base.metadata
+		= &prediction_metadata_ptr;
+	prediction_descriptor.v1.struct_base.kind = EU_TDESC_STRUCT_V2;
+	prediction_descriptor.v1.struct_ptr_base.metadata
+		= &prediction_ptr_metadata_ptr;
+	prediction_descriptor.v1.struct_ptr_base.kind
+		= EU_TDESC_STRUCT_PTR_V2;
+
+	/* The first parse teaches the metadata the member order, so
+	   that in the second, only the extra member should miss. */
+	for (i = 0; i < 2; i++) {
+		parse = eu_parse_create(eu_value(&wide, eu_introduce(
+				&prediction_descriptor.v1.struct_base)));
+		require(eu_parse(parse, wide_json, strlen(wide_json)));
+		require(eu_parse_finish(parse));
+		eu_parse_get_stats(parse, &stats);
+		eu_parse_destroy(parse);
+
+		check_wide(&wide, wide_to_eu_value(&wide));
+		wide_fini(&wide);
+	}
+
+	require(stats.member_predict_hits == 12);
+	require(stats.member_predict_misses == 1);
+}
+
+/* A V1 descriptor for struct wide, which lacks the generated member
+   recognizer, so that the member hash table gets used instead. */
+static struct eu_struct_descriptor_v1 wide_v1_descriptor;
+static const struct eu_metadata *wide_v1_metadata_ptr;
+static const struct eu_metadata *wide_v1_ptr_metadata_ptr;
+
+static struct eu_value wide_v1_to_eu_value(struct wide *p)
+{
+	return eu_value(p, eu_introduce(&wide_v1_descriptor.struct_base));
+}
+
+static void test_wide_struct_v1(void)
+{
+	wide_v1_descriptor = struct_wide_descriptor.v2.v1;
+	wide_v1_descriptor.struct_base.metadata = &wide_v1_metadata_ptr;
+	wide_v1_descriptor.struct_base.kind = EU_TDESC_STRUCT_V1;
+	wide_v1_descriptor.struct_ptr_base.metadata = &wide_v1_ptr_metadata_ptr;
+	wide_v1_descriptor.struct_ptr_base.kind = EU_TDESC_STRUCT_PTR_V1;
+
+	TEST_PARSE(wide_json,
+		   struct wide,
+		   wide_v1_to_eu_value,
+		   check_wide(&result, wide_v1_to_eu_value(&result)),
+		   eu_value_fini(wide_v1_to_eu_value(&result),
+				 &eu_default_allocator));
+}
+
 static void test_path(void)
 {
 	struct test_schema test_schema;
@@ -229,6 +559,498 @@ static void test_escaped_member_names(void)
 	test_schema_fini(&ts);
 }
 
+static void check_closed(struct closed *closed)
+{
+	require(closed->a == 1);
+	require(eu_string_ref_equal(eu_string_to_ref(&closed->b),
+				    eu_cstr("hi")));
+	require(closed->extras.len == 0);
+	require(eu_object_size(closed_to_eu_value(closed)) == 2);
+}
+
+/* Check that json fails to parse, whole and split at each point */
+static void check_bad_closed(const char *json)
+{
+	struct closed closed;
+	struct eu_parse *parse;
+	size_t len = strlen(json), i;
+
+	for (i = 0; i <= len; i++) {
+		require(parse = eu_parse_create(closed_to_eu_value(&closed)));
+		require(!eu_parse(parse, json, i)
+			|| !eu_parse(parse, json + i, len - i)
+			|| !eu_parse_finish(parse));
+		eu_parse_destroy(parse);
+	}
+}
+
+static void test_closed_struct(void)
+{
+	/* Unknown members are skipped, whatever they contain */
+	TEST_PARSE("{\"x\":{\"y\":[1,\"}]\\\"\",{\"z\":null}]},\"a\":1,"
+		   "\"s\" : \"\\\"}\" ,\"b\":\"hi\",\"n\":-1.5e3,\"t\":true,"
+		   "\"e\":[],\"o\": {}}",
+		   struct closed,
+		   closed_to_eu_value,
+		   check_closed(&result),
+		   closed_fini(&result));
+
+	check_bad_closed("{\"x\":}");
+	check_bad_closed("{\"x\":\"\n\"}");
+	check_bad_closed("{\"x\":[1,2},\"a\":1}");
+	check_bad_closed("{\"x\":{\"y\":[\"]\"}]},\"a\":1}");
+}
+
+static char *sized_json(size_t small, size_t big, size_t plain)
+{
+	char *json = malloc((small + big + plain) * 8 + 50);
+	char *p = json;
+	size_t i;
+
+	require(json);
+	p += sprintf(p, "{\"small\":[");
+	for (i = 0; i < small; i++)
+		p += sprintf(p, i ? ",%lu" : "%lu", (unsigned long)i);
+
+	p += sprintf(p, "],\"big\":[");
+	for (i = 0; i < big; i++)
+		p += sprintf(p, i ? ",%lu" : "%lu", (unsigned long)i);
+
+	p += sprintf(p, "],\"plain\":[");
+	for (i = 0; i < plain; i++)
+		p += sprintf(p, i ? ",%lu" : "%lu", (unsigned long)i);
+
+	strcpy(p, "]}");
+	return json;
+}
+
+static void check_sized_array(eu_integer_t *a, size_t len, size_t expected)
+{
+	size_t i;
+
+	require(len == expected);
+	for (i = 0; i < len; i++)
+		require(a[i] == (eu_integer_t)i);
+}
+
+static void check_sized(struct sized *sized, size_t small, size_t big,
+			size_t plain)
+{
+	check_sized_array(sized->small.a, sized->small.len, small);
+	check_sized_array(sized->big.a, sized->big.len, big);
+	check_sized_array(sized->plain.a, sized->plain.len, plain);
+}
+
+/* The capacity beyond the length is not initialized, so push has to
+   zero the element it adds */
+static void check_push_zeroes(struct plain_array *array)
+{
+	eu_integer_t *el;
+
+	memset(array->a + array->len, 0xff,
+	       (array->priv.capacity - array->len) * sizeof *array->a);
+	el = plain_array_push(array);
+	require(el && *el == 0);
+}
+
+/* Parse, checking the capacities of the resulting arrays */
+static void parse_sized(size_t plain, size_t small_capacity,
+			size_t big_capacity, size_t plain_capacity)
+{
+	char *json = sized_json(2, 20, plain);
+	struct sized sized;
+	struct eu_parse *parse;
+
+	parse = eu_parse_create(sized_to_eu_value(&sized));
+	require(eu_parse(parse, json, strlen(json)));
+	require(eu_parse_finish(parse));
+	eu_parse_destroy(parse);
+
+	check_sized(&sized, 2, 20, plain);
+	require(sized.small.priv.capacity == small_capacity);
+	require(sized.big.priv.capacity == big_capacity);
+	require(sized.plain.priv.capacity == plain_capacity);
+	if (sized.plain.len < sized.plain.priv.capacity)
+		check_push_zeroes(&sized.plain);
+
+	/* Likewise after growing the array */
+	sized.plain.len = sized.plain.priv.capacity;
+	require(eu_array_grow((struct eu_array *)&sized.plain,
+			      sizeof *sized.plain.a));
+	check_push_zeroes(&sized.plain);
+	sized_fini(&sized);
+	free(json);
+}
+
+static void test_array_sizing(void)
+{
+	char *sized;
+
+	/* The hints size the small and big arrays, and the big array
+	   gets trimmed.  The plain array grows by doubling until it
+	   has a previous length to go on. */
+	parse_sized(100, 3, 20, 128);
+	parse_sized(100, 3, 20, 100);
+
+	/* A shorter array grows to the previous length, then gets
+	   trimmed */
+	parse_sized(10, 3, 20, 10);
+	parse_sized(100, 3, 20, 128);
+	parse_sized(5, 3, 20, 8);
+
+	/* Arrays that exceed their hints */
+	sized = sized_json(5, 3, 30);
+	TEST_PARSE(sized,
+		   struct sized,
+		   sized_to_eu_value,
+		   check_sized(&result, 5, 3, 30),
+		   sized_fini(&result));
+	free(sized);
+}
+
+static char *records_json(size_t n)
+{
+	char *json = malloc(n * 50 + 20);
+	char *p = json;
+	size_t i;
+
+	require(json);
+	p += sprintf(p, "{\"records\":[");
+	for (i = 0; i < n; i++)
+		p += sprintf(p, "%s{\"id\":%lu,\"name\":\"n%lu\",\"tags\":%s}",
+			     i ? "," : "", (unsigned long)i, (unsigned long)i,
+			     i % 3 ? "[\"a\",\"b\"]" : "[]");
+
+	strcpy(p, "]}");
+	return json;
+}
+
+static void check_record(struct record *r, size_t i)
+{
+	char name[20];
+
+	sprintf(name, "n%lu", (unsigned long)i);
+	require(r->id == (eu_integer_t)i);
+	require(eu_string_ref_equal(eu_string_to_ref(&r->name),
+				    eu_cstr(name)));
+	require(r->tags.len == (i % 3 ? 2u : 0u));
+}
+
+static void check_records(struct chunked *c, size_t n)
+{
+	struct eu_chunked_array_iter iter;
+	struct eu_value val;
+	char path[40];
+	size_t i;
+
+	require(c->records.len == n);
+	for (i = 0; i < n; i++)
+		check_record(record_array_at(&c->records, i), i);
+
+	record_array_iter_init(&iter, &c->records);
+	for (i = 0; eu_chunked_array_iter_next(&iter); i++)
+		check_record(iter.element, i);
+
+	require(i == n);
+
+	if (n) {
+		sprintf(path, "/records/%lu/id", (unsigned long)(n - 1));
+		val = eu_get_path(chunked_to_eu_value(c), eu_cstr(path));
+		require(eu_value_to_integer(val).value
+			== (eu_integer_t)(n - 1));
+	}
+
+	sprintf(path, "/records/%lu", (unsigned long)n);
+	require(!eu_value_ok(eu_get_path(chunked_to_eu_value(c),
+					 eu_cstr(path))));
+}
+
+static void push_record(struct chunked *c, size_t i)
+{
+	struct record *r;
+	char name[20];
+
+	require(r = record_array_push(&c->records));
+	record_set_id(r, i);
+	sprintf(name, "n%lu", (unsigned long)i);
+	require(eu_string_assign(&r->name, eu_cstr(name)));
+	if (i % 3) {
+		require(eu_string_assign(eu_string_array_push(&r->tags),
+					 eu_cstr("a")));
+		require(eu_string_assign(eu_string_array_push(&r->tags),
+					 eu_cstr("b")));
+	}
+}
+
+/* Generate in chunks of the given size, and compare with json */
+static void check_records_gen(struct chunked *c, const char *json,
+			      size_t chunk)
+{
+	size_t len = strlen(json), n, out = 0;
+	char *buf = malloc(len + chunk);
+	struct eu_generate *eg = eu_generate_create(chunked_to_eu_value(c));
+
+	while ((n = eu_generate(eg, buf + out, chunk)))
+		out += n;
+
+	require(eu_generate_ok(eg));
+	eu_generate_destroy(eg);
+	require(out == len && !memcmp(buf, json, len));
+	free(buf);
+}
+
+static void test_chunked_array(void)
+{
+	static const size_t chunks[] = { 1, 1000, 1000000 };
+	char *json = records_json(2500);
+	size_t len = strlen(json), c, i;
+	unsigned int shift;
+	struct eu_parse *parse;
+	struct eu_arena *arena;
+	struct chunked ch;
+	struct record *a;
+	char *records;
+	long count = 0;
+	struct eu_allocator allocator = {
+		counting_alloc,
+		counting_realloc,
+		counting_free,
+		&count
+	};
+
+	for (c = 0; c < sizeof chunks / sizeof chunks[0]; c++) {
+		parse = eu_parse_create(chunked_to_eu_value(&ch));
+		require(parse_chunked(parse, json, len, chunks[c]));
+		eu_parse_destroy(parse);
+
+		require(ch.records.priv.capacity > 2048);
+		check_records(&ch, 2500);
+		check_records_gen(&ch, json, chunks[c]);
+		chunked_fini(&ch);
+	}
+
+	arena = eu_arena_create();
+	parse = eu_parse_create(chunked_to_eu_value(&ch));
+	eu_parse_set_arena(parse, arena);
+	require(eu_parse(parse, json, len));
+	require(eu_parse_finish(parse));
+	eu_parse_destroy(parse);
+	check_records(&ch, 2500);
+	eu_arena_destroy(arena);
+
+	/* Compaction, and pushing before and after it */
+	parse = eu_parse_create(chunked_to_eu_value(&ch));
+	require(eu_parse(parse, json, len));
+	require(eu_parse_finish(parse));
+	eu_parse_destroy(parse);
+	shift = ch.records.priv.shift;
+	push_record(&ch, 2500);
+
+	require(a = record_array_compact(&ch.records,
+					&eu_default_allocator));
+	require(ch.records.priv.capacity == 2501);
+	for (i = 0; i < 2501; i++) {
+		require(record_array_at(&ch.records, i) == a + i);
+		check_record(a + i, i);
+	}
+
+	for (i = 2501; i < 5000; i++)
+		push_record(&ch, i);
+
+	check_records(&ch, 5000);
+
+	/* An array that fits in one chunk after shrinking keeps the
+	   usual chunk size when compacted */
+	for (i = 10; i < 5000; i++)
+		record_fini(record_array_at(&ch.records, i));
+
+	ch.records.len = 10;
+	require(record_array_compact(&ch.records, &eu_default_allocator));
+	require(ch.records.priv.capacity == 10);
+	require(ch.records.priv.shift == shift);
+	check_records(&ch, 10);
+	chunked_fini(&ch);
+
+	/* Compaction with the allocator the array was parsed with */
+	parse = eu_parse_create_with_allocator(chunked_to_eu_value(&ch),
+					       &allocator);
+	require(eu_parse(parse, json, len));
+	require(eu_parse_finish(parse));
+	eu_parse_destroy(parse);
+	require(record_array_compact(&ch.records, &allocator));
+	check_records(&ch, 2500);
+	eu_value_fini(chunked_to_eu_value(&ch), &allocator);
+	require(count == 0);
+	free(json);
+
+	/* Small arrays, which only use part of the first chunk */
+	records = records_json(5);
+	TEST_PARSE(records,
+		   struct chunked,
+		   chunked_to_eu_value,
+		   check_records(&result, 5),
+		   chunked_fini(&result));
+	free(records);
+
+	records = records_json(0);
+	TEST_PARSE(records,
+		   struct chunked,
+		   chunked_to_eu_value,
+		   check_records(&result, 0),
+		   chunked_fini(&result));
+	free(records);
+}
+
+static void check_duplicates(struct test_schema *ts, const char *str,
+			     eu_integer_t i, const char *quux, size_t extras)
+{
+	struct eu_value val = test_schema_to_eu_value(ts);
+
+	require(eu_string_ref_equal(eu_string_to_ref(&ts->str),
+				    eu_cstr(str)));
+	require(ts->int_ == i);
+	require(ts->extras.len == extras);
+	require(eu_string_ref_equal(
+			eu_value_to_string_ref(eu_value_get_cstr(val, "quux")),
+			eu_cstr(quux)));
+}
+
+static void test_duplicates(void)
+{
+	const char *json = "{\"str\":\"a\",\"quux\":\"x\",\"int_\":1,"
+		"\"str\":\"b\",\"int_\":2,\"quux\":\"y\"}";
+	static const size_t chunks[] = { 1, 5, 1000 };
+	struct eu_arena *arena;
+	struct test_schema ts;
+	struct eu_value val = test_schema_to_eu_value(&ts);
+	size_t c;
+	int a;
+
+	for (a = 0; a < 2; a++) {
+		arena = a ? eu_arena_create() : NULL;
+
+		for (c = 0; c < sizeof chunks / sizeof chunks[0]; c++) {
+			require(parse_with_options(val, json, chunks[c], 0,
+						   arena));
+			check_duplicates(&ts, "b", 2, "x", 2);
+			if (!arena)
+				test_schema_fini(&ts);
+
+			require(parse_with_options(val, json, chunks[c],
+						   EU_PARSE_DUPLICATES_LAST,
+						   arena));
+			check_duplicates(&ts, "b", 2, "y", 1);
+			if (!arena)
+				test_schema_fini(&ts);
+
+			require(parse_with_options(val, json, chunks[c],
+						   EU_PARSE_DUPLICATES_FIRST,
+						   arena));
+			check_duplicates(&ts, "a", 1, "x", 1);
+			if (!arena)
+				test_schema_fini(&ts);
+
+			require(!parse_with_options(val, json, chunks[c],
+						    EU_PARSE_DUPLICATES_ERROR,
+						    arena));
+			require(!parse_with_options(val,
+				"{\"bar\":{},\"bar\":{}}", chunks[c],
+				EU_PARSE_DUPLICATES_ERROR, arena));
+			require(!parse_with_options(val,
+				"{\"quux\":1,\"quux\":1}", chunks[c],
+				EU_PARSE_DUPLICATES_ERROR, arena));
+
+			/* Repeats of members without presence bits, after
+			   empty values */
+			require(!parse_with_options(val,
+				"{\"array\":[],\"str\":\"x\",\"array\":[]}",
+				chunks[c], EU_PARSE_DUPLICATES_ERROR, arena));
+			require(!parse_with_options(val,
+				"{\"bar\":{\"str\":\"\",\"baz\":{},"
+				"\"str\":\"\"}}", chunks[c],
+				EU_PARSE_DUPLICATES_ERROR, arena));
+
+			require(parse_with_options(val,
+				"{\"str\":\"\",\"array\":[],\"str\":\"x\","
+				"\"array\":[{}]}", chunks[c],
+				EU_PARSE_DUPLICATES_FIRST, arena));
+			require(ts.str.len == 0);
+			require(ts.array.len == 0);
+			if (!arena)
+				test_schema_fini(&ts);
+
+			/* Each object keeps track of its own members */
+			require(parse_with_options(val,
+				"{\"str\":\"\",\"bar\":{\"str\":\"\","
+				"\"baz\":{\"str\":\"\"}},"
+				"\"array\":[{\"str\":\"\"},{\"str\":\"\"}]}",
+				chunks[c], EU_PARSE_DUPLICATES_ERROR, arena));
+			require(ts.bar && ts.bar->baz && ts.array.len == 2);
+			if (!arena)
+				test_schema_fini(&ts);
+		}
+
+		if (arena)
+			eu_arena_destroy(arena);
+	}
+}
+
+/* A V1 descriptor for struct test_schema in which the number members
+   lack presence bits, as a hand-written descriptor might have it.
+   Their values can be all zero bits, so the struct alone doesn't show
+   whether they have been seen. */
+static struct eu_struct_descriptor_v1 no_bits_descriptor;
+static struct eu_struct_member_descriptor_v1 no_bits_members[16];
+static const struct eu_metadata *no_bits_metadata_ptr;
+static const struct eu_metadata *no_bits_ptr_metadata_ptr;
+
+static void test_duplicates_without_presence_bits(void)
+{
+	static const size_t chunks[] = { 1, 5, 1000 };
+	struct test_schema ts;
+	struct eu_value val;
+	size_t i, c;
+
+	no_bits_descriptor = struct_test_schema_descriptor.v2.v1;
+	no_bits_descriptor.struct_base.metadata = &no_bits_metadata_ptr;
+	no_bits_descriptor.struct_base.kind = EU_TDESC_STRUCT_V1;
+	no_bits_descriptor.struct_ptr_base.metadata = &no_bits_ptr_metadata_ptr;
+	no_bits_descriptor.struct_ptr_base.kind = EU_TDESC_STRUCT_PTR_V1;
+
+	require(no_bits_descriptor.n_members <= 16);
+	for (i = 0; i < no_bits_descriptor.n_members; i++) {
+		no_bits_members[i] = no_bits_descriptor.members[i];
+		if (!strcmp(no_bits_members[i].name, "num")
+		    || !strcmp(no_bits_members[i].name, "int_"))
+			no_bits_members[i].presence_offset = -1;
+	}
+
+	no_bits_descriptor.members = no_bits_members;
+	val = eu_value(&ts, eu_introduce(&no_bits_descriptor.struct_base));
+
+	for (c = 0; c < sizeof chunks / sizeof chunks[0]; c++) {
+		require(!parse_with_options(val,
+				"{\"int_\":0,\"num\":1,\"int_\":0}",
+				chunks[c], EU_PARSE_DUPLICATES_ERROR, NULL));
+		require(!parse_with_options(val,
+				"{\"bar\":{\"str\":\"\"},\"num\":0,"
+				"\"str\":\"\",\"num\":0}",
+				chunks[c], EU_PARSE_DUPLICATES_ERROR, NULL));
+
+		require(parse_with_options(val,
+				"{\"num\":0,\"int_\":0,\"num\":2,\"int_\":3}",
+				chunks[c], EU_PARSE_DUPLICATES_FIRST, NULL));
+		require(ts.num == 0 && ts.int_ == 0);
+		test_schema_fini(&ts);
+
+		require(parse_with_options(val,
+				"{\"num\":0,\"int_\":0,\"num\":2,\"int_\":3}",
+				chunks[c], EU_PARSE_DUPLICATES_LAST, NULL));
+		require(ts.num == 2 && ts.int_ == 3);
+		test_schema_fini(&ts);
+	}
+}
+
 static void test_int(struct eu_string_ref json, eu_integer_t i)
 {
 	struct test_schema ts;
@@ -289,17 +1111,32 @@ static void test_bad_ints(void)
 
 int main(void)
 {
+	/* This comes first, so that the metadata isn't already
+	   introduced */
+	test_concurrent_introduce();
+	test_concurrent_accessors();
 	test_struct_ptr();
 	test_bad_struct_ptr();
 	test_inline_struct();
 	test_nested();
 	test_extras();
+	test_wide_struct();
+	test_specialized_parse();
+	test_specialized_parse_nested();
+	test_wide_struct_v2();
+	test_member_prediction();
+	test_wide_struct_v1();
 	test_path();
 	test_path_extras();
 	test_size();
 	test_gen_struct();
 	test_gen_parsed_struct();
 	test_escaped_member_names();
+	test_closed_struct();
+	test_duplicates();
+	test_duplicates_without_presence_bits();
+	test_array_sizing();
+	test_chunked_array();
 	test_big_ints();
 	test_bad_ints();
 	return 0;
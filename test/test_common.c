@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <euphemus.h>
 
@@ -69,6 +70,37 @@ void test_gen(struct eu_value value, struct eu_string_ref expected)
 	free(buf2);
 }
 
+int parse_chunked(struct eu_parse *parse, const char *json, size_t len,
+		  size_t chunk)
+{
+	size_t i, n;
+
+	for (i = 0; i < len; i += n) {
+		n = len - i < chunk ? len - i : chunk;
+		if (!eu_parse(parse, json + i, n))
+			return 0;
+	}
+
+	return eu_parse_finish(parse);
+}
+
+int parse_with_options(struct eu_value value, const char *json,
+		       size_t chunk, unsigned int options,
+		       struct eu_arena *arena)
+{
+	struct eu_parse *parse;
+	int ok;
+
+	parse = eu_parse_create(value);
+	eu_parse_set_options(parse, options);
+	if (arena)
+		eu_parse_set_arena(parse, arena);
+
+	ok = parse_chunked(parse, json, strlen(json), chunk);
+	eu_parse_destroy(parse);
+	return ok;
+}
+
 void require_fail(const char *requirement, const char *file,
 		  int line, const char *func)
 {
@@ -76,3 +108,30 @@ void require_fail(const char *requirement, const char *file,
 		requirement, func, file, line);
 	abort();
 }
+
+/* An allocator that counts outstanding allocations */
+void *counting_alloc(void *user, size_t size)
+{
+	void *res = malloc(size);
+	if (res)
+		++*(long *)user;
+
+	return res;
+}
+
+void *counting_realloc(void *user, void *ptr, size_t size)
+{
+	void *res = realloc(ptr, size);
+	if (res && !ptr)
+		++*(long *)user;
+
+	return res;
+}
+
+void counting_free(void *user, void *ptr)
+{
+	if (ptr)
+		--*(long *)user;
+
+	free(ptr);
+}
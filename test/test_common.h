@@ -1,4 +1,21 @@
 void test_gen(struct eu_value value, struct eu_string_ref expected);
+
+/* An allocator that counts outstanding allocations in *(long *)user */
+void *counting_alloc(void *user, size_t size);
+void *counting_realloc(void *user, void *ptr, size_t size);
+void counting_free(void *user, void *ptr);
+
+/* Feed len bytes of json to parse in chunks of the given size, and
+   finish the parse.  Returns 0 as soon as a step fails. */
+int parse_chunked(struct eu_parse *parse, const char *json, size_t len,
+		  size_t chunk);
+
+/* Parse json into value with the given options and arena (or NULL),
+   in chunks of the given size */
+int parse_with_options(struct eu_value value, const char *json,
+		       size_t chunk, unsigned int options,
+		       struct eu_arena *arena);
+
 void require_fail(const char *requirement, const char *file,
 		  int line, const char *func);
 
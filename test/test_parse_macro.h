@@ -6,6 +6,7 @@ do {                                                                  \
 	size_t len = strlen(json);                                    \
 	size_t i;                                                     \
 	char *buf;                                                    \
+	struct eu_arena *arena;                                       \
                                                                       \
 	/* Test parsing in one go */                                  \
 	parse = eu_parse_create(to_value(&result));                   \
@@ -48,6 +49,34 @@ do {                                                                  \
 	check;                                                        \
 	cleanup;                                                      \
                                                                       \
+	/* Test parsing into an arena, in one go and byte by byte. */ \
+	arena = eu_arena_create();                                    \
+	require(arena);                                               \
+	parse = eu_parse_create(to_value(&result));                   \
+	eu_parse_set_arena(parse, arena);                             \
+	require(eu_parse(parse, json, len));                           \
+	require(eu_parse_finish(parse));                               \
+	eu_parse_destroy(parse);                                      \
+	check;                                                        \
+                                                                      \
+	parse = eu_parse_create(to_value(&result));                   \
+	eu_parse_set_arena(parse, arena);                             \
+	for (i = 0; i < len; i++)                                     \
+		require(eu_parse(parse, json + i, 1));                 \
+                                                                      \
+	require(eu_parse_finish(parse));                               \
+	eu_parse_destroy(parse);                                      \
+	check;                                                        \
+                                                                      \
+	for (i = 0; i < len; i++) {                                   \
+		parse = eu_parse_create(to_value(&result));           \
+		eu_parse_set_arena(parse, arena);                     \
+		require(eu_parse(parse, json, i));                     \
+		eu_parse_destroy(parse);                              \
+	}                                                             \
+                                                                      \
+	eu_arena_destroy(arena);                                      \
+                                                                      \
 	/* Test that resources are released after an unfinished parse. */ \
 	parse = eu_parse_create(to_value(&result));                   \
 	eu_parse_destroy(parse);                                      \